@@ -0,0 +1,107 @@
+/*
+ * Benchmark for DBrew rewrite time depending on number of branches
+ *
+ * Rewrites a function with a loop over a known number of iterations,
+ * containing a branch depending on an unknown parameter. With full
+ * unrolling, each iteration adds new emulator states to be checked
+ * against all states saved before (see saveEmuState).
+ *
+ * Usage: branches [-n <repetitions>] [<max. branch count>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+
+typedef long (*branchy_t)(long, long);
+
+// variables kept in registers
+__attribute__ ((noinline))
+long branchy(long n, long x)
+{
+    long s = x;
+    for(long i = 0; i < n; i++) {
+        if (x < i * 1000) s = s * 3 + i;
+        else s = s ^ i;
+    }
+    return s;
+}
+
+// same, but with variables on the stack: larger states to compare
+__attribute__ ((noinline, optimize("O0")))
+long branchy_stack(long n, long x)
+{
+    long s = x;
+    for(long i = 0; i < n; i++) {
+        if (x < i * 1000) s = s * 3 + i;
+        else s = s ^ i;
+    }
+    return s;
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// returns best time of <reps> rewrites of <f> with n known, 0 on error
+static
+double rewriteTime(branchy_t f, long n, int reps)
+{
+    double best = 0;
+
+    for(int i = 0; i < reps; i++) {
+        Rewriter* r = dbrew_new();
+        dbrew_set_capture_capacity(r, 20000, 2000, 200000);
+        dbrew_set_function(r, (uint64_t) f);
+        dbrew_config_staticpar(r, 0);
+        dbrew_config_parcount(r, 2);
+
+        double t0 = now();
+        branchy_t ff = (branchy_t) dbrew_rewrite(r, n, 0);
+        double t = now() - t0;
+
+        if ((ff == f) || (ff(n, 500 * n) != f(n, 500 * n))) {
+            dbrew_free(r);
+            return 0;
+        }
+        if ((i == 0) || (t < best)) best = t;
+        dbrew_free(r);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int reps = 5, maxN = 30;
+    int arg = 1;
+
+    while(arg < argc) {
+        if ((strcmp(argv[arg], "-n") == 0) && (arg+1 < argc))
+            reps = atoi(argv[++arg]);
+        else
+            maxN = atoi(argv[arg]);
+        arg++;
+    }
+    if (reps < 1) reps = 1;
+
+    printf("Rewrite time (best of %d) vs. branch count\n", reps);
+    printf("%8s %14s %14s\n", "branches", "regs [ms]", "stack [ms]");
+    for(int n = 5; n <= maxN; n += 5) {
+        double t1 = rewriteTime(branchy, n, reps);
+        double t2 = rewriteTime(branchy_stack, n, reps);
+        if ((t1 == 0) || (t2 == 0)) {
+            printf("%8d  rewriting failed\n", n);
+            break;
+        }
+        printf("%8d %14.3f %14.3f\n", n, 1000 * t1, 1000 * t2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Benchmark for the DBrew decoder
+ *
+ * Walks all executable segments of a loaded ELF object (default: libc)
+ * linearly through dbrew_decode and reports decoder throughput as well
+ * as the fraction of instructions the decoder does not support.
+ *
+ * Usage: decode [-v] [-n <passes>] [<object>]
+ *  <object>: substring of a loaded shared object path (default "libc.so"),
+ *            or "self" for the main executable (which includes libdbrew.a)
+ *  -v      : show decoder errors on stderr (default: suppressed)
+ */
+
+#define _GNU_SOURCE
+
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+#include "common.h"
+
+// maximum length of an x86 instruction: never decode beyond segment end
+#define MAX_INSTR_LEN 15
+
+typedef struct {
+    const char* name; // object to search for
+    uint64_t start[8], end[8];
+    char path[256];
+    int segs;
+} TextSegments;
+
+typedef struct {
+    long bbs, instrs, bytes;
+    long unsupported; // instructions the decoder failed on
+} DecodeStats;
+
+static
+int findText(struct dl_phdr_info* info, size_t size, void* data)
+{
+    TextSegments* ts = (TextSegments*) data;
+    (void) size;
+
+    if (strcmp(ts->name, "self") == 0) {
+        // the main executable comes first and has an empty name
+        if (info->dlpi_name[0] != 0) return 0;
+    }
+    else if (strstr(info->dlpi_name, ts->name) == 0)
+        return 0;
+
+    for(int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* ph = info->dlpi_phdr + i;
+        if ((ph->p_type != PT_LOAD) || !(ph->p_flags & PF_X)) continue;
+        if (ts->segs == 8) break;
+        ts->start[ts->segs] = info->dlpi_addr + ph->p_vaddr;
+        ts->end[ts->segs] = ts->start[ts->segs] + ph->p_memsz;
+        ts->segs++;
+    }
+    snprintf(ts->path, sizeof(ts->path), "%s",
+             info->dlpi_name[0] ? info->dlpi_name : "(main executable)");
+    return 1;
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// decode [start;end[ BB by BB, continuing after unsupported instructions
+static
+void decodeRange(Rewriter* r, uint64_t start, uint64_t end, DecodeStats* s)
+{
+    uint64_t a = start;
+
+    // also within BBs, instructions near <end> are not decoded
+    r->decEnd = end;
+    while(a + MAX_INSTR_LEN < end) {
+        // forget previously decoded BBs: keeps lookup cost constant and
+        // avoids running out of decoder capacity
+        r->decBBCount = 0;
+        r->decInstrCount = 0;
+
+        DBB* dbb = dbrew_decode(r, a);
+        int count = dbb->count;
+        if ((count > 0) && (dbb->instr[count - 1].type == IT_Invalid)) {
+            s->unsupported++;
+            count--;
+        }
+        s->bbs++;
+        s->instrs += count;
+        s->bytes += dbb->size;
+
+        a += (dbb->size > 0) ? dbb->size : 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    TextSegments ts;
+    DecodeStats s;
+    int passes = 3, verbose = 0;
+    int arg = 1;
+
+    ts.name = "libc.so";
+    while(arg < argc) {
+        if (strcmp(argv[arg], "-v") == 0) verbose = 1;
+        else if ((strcmp(argv[arg], "-n") == 0) && (arg+1 < argc))
+            passes = atoi(argv[++arg]);
+        else
+            ts.name = argv[arg];
+        arg++;
+    }
+    if (passes < 1) passes = 1;
+
+    ts.segs = 0;
+    if ((dl_iterate_phdr(findText, &ts) == 0) || (ts.segs == 0)) {
+        fprintf(stderr, "Error: no executable segment found for '%s'\n",
+                ts.name);
+        return 1;
+    }
+
+    uint64_t textSize = 0;
+    for(int i = 0; i < ts.segs; i++)
+        textSize += ts.end[i] - ts.start[i];
+    printf("Decoding %s: %d executable segment(s), %lu bytes, %d pass(es)\n",
+           ts.path, ts.segs, textSize, passes);
+
+    // decoder errors are logged to stderr: suppress to not measure logging
+    if (!verbose && !freopen("/dev/null", "w", stderr)) {
+        perror("Cannot redirect stderr");
+        return 1;
+    }
+
+    Rewriter* r = dbrew_new();
+    dbrew_set_decoding_capacity(r, 5000, 10);
+
+    double best = 0;
+    for(int p = 0; p < passes; p++) {
+        memset(&s, 0, sizeof(s));
+        double t0 = now();
+        for(int i = 0; i < ts.segs; i++)
+            decodeRange(r, ts.start[i], ts.end[i], &s);
+        double t = now() - t0;
+        if ((p == 0) || (t < best)) best = t;
+    }
+
+    long all = s.instrs + s.unsupported;
+    printf("  BBs decoded:       %12ld\n", s.bbs);
+    printf("  Instructions:      %12ld\n", s.instrs);
+    printf("  Unsupported:       %12ld (%.2f%% of decode attempts)\n",
+           s.unsupported, all ? 100.0 * s.unsupported / all : 0.0);
+    printf("  Time (best pass):  %12.4f s\n", best);
+    printf("  Instructions/s:    %12.3e\n", s.instrs / best);
+    printf("  Bytes/s:           %12.3e\n", s.bytes / best);
+
+    dbrew_free(r);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Benchmark for DBrew emulation speed
+ *
+ * Runs a loop with known iteration count through the emulator, with
+ * full unrolling. With all parameters known, everything is emulated
+ * ("emulate"); with the second parameter unknown, each iteration
+ * also is captured ("capture"). Reports emulated instructions/second.
+ * Dispatch overhead only shows with an optimized library: build it with
+ * "make LIBFLAGS=-O2".
+ *
+ * Usage: emulate [-n <repetitions>] [<iterations>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+#include "common.h"
+
+typedef long (*loop_t)(long, long);
+
+// variables kept in registers
+__attribute__ ((noinline))
+long loop(long n, long x)
+{
+    long s = x;
+    for(long i = 0; i < n; i++)
+        s = (s ^ i) * 3 + (i >> 1);
+    return s;
+}
+
+// same, but with variables on the stack
+__attribute__ ((noinline, optimize("O0")))
+long loop_stack(long n, long x)
+{
+    long s = x;
+    for(long i = 0; i < n; i++)
+        s = (s ^ i) * 3 + (i >> 1);
+    return s;
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// returns emulated instructions/s (best of <reps>) for <f> with n known,
+// and x known if <capture> is false. Returns 0 on error
+static
+double emuRate(loop_t f, long n, bool capture, int reps, long* count)
+{
+    double best = 0;
+
+    for(int i = 0; i < reps; i++) {
+        Rewriter* r = dbrew_new();
+        dbrew_set_capture_capacity(r, 10 * n + 100, 100, 100 * n + 1000);
+        dbrew_set_function(r, (uint64_t) f);
+        dbrew_config_parcount(r, 2);
+        dbrew_config_staticpar(r, 0);
+        if (!capture)
+            dbrew_config_staticpar(r, 1);
+
+        double t0 = now();
+        long res = (long) dbrew_emulate(r, n, 42);
+        double t = now() - t0;
+
+        *count = r->emuInstrCount;
+        dbrew_free(r);
+        if (res != f(n, 42)) return 0;
+        if ((i == 0) || (t < best)) best = t;
+    }
+    return *count / best;
+}
+
+int main(int argc, char* argv[])
+{
+    int reps = 5, n = 2000;
+    int arg = 1;
+
+    while(arg < argc) {
+        if ((strcmp(argv[arg], "-n") == 0) && (arg+1 < argc))
+            reps = atoi(argv[++arg]);
+        else
+            n = atoi(argv[arg]);
+        arg++;
+    }
+    if (reps < 1) reps = 1;
+    if (n < 1) n = 1;
+
+    printf("Emulation speed (best of %d), %d loop iterations\n", reps, n);
+    printf("%-8s %-8s %10s %14s\n",
+           "variant", "mode", "instrs", "instrs/s");
+
+    struct { const char* name; loop_t f; } v[2] = {
+        { "regs", loop }, { "stack", loop_stack }
+    };
+    for(int i = 0; i < 2; i++) {
+        for(int capture = 0; capture < 2; capture++) {
+            long count = 0;
+            double rate = emuRate(v[i].f, n, capture, reps, &count);
+            if (rate == 0) {
+                printf("%-8s %-8s  emulation failed\n", v[i].name,
+                       capture ? "capture" : "emulate");
+                return 1;
+            }
+            printf("%-8s %-8s %10ld %14.3e\n", v[i].name,
+                   capture ? "capture" : "emulate", count, rate);
+        }
+    }
+
+    return 0;
+}
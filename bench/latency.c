@@ -0,0 +1,96 @@
+/*
+ * Benchmark for DBrew rewrite latency of small functions
+ *
+ * Repeatedly specializes a small function for different values of a
+ * known parameter, reusing the same rewriter. This measures fixed costs
+ * of a rewrite (emulator reset, capturing, code generation) as seen by
+ * users doing many small specializations.
+ *
+ * Usage: latency [-n <rewrites>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+
+typedef long (*func_t)(long, long);
+
+// no stack frame
+__attribute__ ((noinline))
+long scale(long f, long x)
+{
+    if (f == 0) return 0;
+    return f * x + 1;
+}
+
+// small stack frame
+__attribute__ ((noinline, optimize("O0")))
+long scale_stack(long f, long x)
+{
+    long r = 1;
+    if (f != 0) r += f * x;
+    return r;
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// returns average time per rewrite of <f> for <n> different values of
+// the known first parameter, 0 on error
+static
+double rewriteLatency(func_t f, int n)
+{
+    Rewriter* r = dbrew_new();
+    dbrew_set_function(r, (uint64_t) f);
+    dbrew_config_staticpar(r, 0);
+    dbrew_config_parcount(r, 2);
+
+    // only check result of last rewrite: running freshly generated code
+    // has a cost (self-modifying code) we do not want to measure
+    func_t ff = 0;
+    double t0 = now();
+    for(int i = 1; i <= n; i++)
+        ff = (func_t) dbrew_rewrite(r, i, 0);
+    double t = now() - t0;
+
+    if ((ff == f) || (ff(n, 7) != f(n, 7))) {
+        dbrew_free(r);
+        return 0;
+    }
+
+    dbrew_free(r);
+    return t / n;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 20000;
+    int arg = 1;
+
+    while(arg < argc) {
+        if ((strcmp(argv[arg], "-n") == 0) && (arg+1 < argc))
+            n = atoi(argv[++arg]);
+        arg++;
+    }
+    if (n < 1) n = 1;
+
+    printf("Rewrite latency (average of %d rewrites)\n", n);
+    double t1 = rewriteLatency(scale, n);
+    double t2 = rewriteLatency(scale_stack, n);
+    if ((t1 == 0) || (t2 == 0)) {
+        printf("  rewriting failed\n");
+        return 1;
+    }
+    printf("  %-12s %10.3f us\n", "regs", 1e6 * t1);
+    printf("  %-12s %10.3f us\n", "stack", 1e6 * t2);
+
+    return 0;
+}
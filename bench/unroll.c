@@ -0,0 +1,130 @@
+/*
+ * Benchmark for partial unrolling of re-rolled loops
+ *
+ * The matrix multiplication kernel of examples/matrix.c, with the
+ * innermost loop moved into the kernel. The matrix size is known, so
+ * the loop is re-rolled into a real loop over copies of its body. Each
+ * unroll factor is compared to the original kernel. Remaining iterations
+ * not filling the unrolled body are peeled off in front of the loop.
+ *
+ * Usage: unroll [-s <matrix size>] [-r <repetitions>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+
+typedef void (*row_t)(long, double*, double*, double*, long, long);
+
+// row i of a += b[i][j] * row j of c.
+// Use an index as loop counter: no induction variable optimization
+// switching to pointers (the end pointer would be unknown)
+__attribute__ ((noinline, optimize("no-ivopts")))
+void mm_row(long s, double* a, double* b, double* c, long i, long j)
+{
+    for(long k = 0; k < s; k++)
+        a[i*s+k] += b[i*s+j] * c[j*s+k];
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static
+void init(long s, double* m, double v)
+{
+    for(long i = 0; i < s * s; i++)
+        m[i] = v + (double) (i % 7);
+}
+
+// returns best time of <reps> matrix multiplications using <f>
+static
+double runTime(row_t f, long s, double* a, double* b, double* c, int reps)
+{
+    double best = 0;
+
+    for(int r = 0; r < reps; r++) {
+        init(s, a, 0.0);
+        double t0 = now();
+        for(long i = 0; i < s; i++)
+            for(long j = 0; j < s; j++)
+                f(s, a, b, c, i, j);
+        double t = now() - t0;
+        if ((r == 0) || (t < best)) best = t;
+    }
+    return best;
+}
+
+// rewrite kernel for size <s> with loop unrolled by <factor>, 0 on error
+static
+row_t rewrite(Rewriter* r, long s, int factor)
+{
+    dbrew_set_function(r, (uint64_t) mm_row);
+    dbrew_config_parcount(r, 6);
+    dbrew_config_staticpar(r, 0);
+    dbrew_config_loop_unroll(r, 0, factor);
+
+    row_t ff = (row_t) dbrew_rewrite(r, s, 0, 0, 0, 0, 0);
+    if (ff == mm_row) return 0;
+    return ff;
+}
+
+int main(int argc, char* argv[])
+{
+    long s = 102;
+    int reps = 10;
+    int arg = 1;
+    int factors[] = { 1, 2, 3, 4, 8, 0 };
+
+    while(arg < argc) {
+        if ((strcmp(argv[arg], "-s") == 0) && (arg+1 < argc))
+            s = atol(argv[++arg]);
+        if ((strcmp(argv[arg], "-r") == 0) && (arg+1 < argc))
+            reps = atoi(argv[++arg]);
+        arg++;
+    }
+    if (s < 1) s = 1;
+    if (reps < 1) reps = 1;
+
+    double* a1 = (double*) malloc(s * s * sizeof(double));
+    double* a2 = (double*) malloc(s * s * sizeof(double));
+    double* b = (double*) malloc(s * s * sizeof(double));
+    double* c = (double*) malloc(s * s * sizeof(double));
+    init(s, b, 2.0);
+    init(s, c, 3.0);
+
+    printf("Matrix multiplication kernel loop (size %ld, best of %d runs)\n",
+           s, reps);
+    double t1 = runTime(mm_row, s, a1, b, c, reps);
+    printf("  %-8s %9.3f ms\n", "orig", 1e3 * t1);
+    for(int i = 0; factors[i] > 0; i++) {
+        Rewriter* r = dbrew_new();
+        row_t ff = rewrite(r, s, factors[i]);
+        if (!ff) {
+            printf("  unroll %d: rewriting failed\n", factors[i]);
+            return 1;
+        }
+
+        double t2 = runTime(ff, s, a2, b, c, reps);
+        if (memcmp(a1, a2, s * s * sizeof(double)) != 0) {
+            printf("  unroll %d: wrong result\n", factors[i]);
+            return 1;
+        }
+        printf("  unroll %d %9.3f ms (%d bytes)\n",
+               factors[i], 1e3 * t2, dbrew_generated_size(r));
+        dbrew_free(r);
+    }
+
+    free(a1);
+    free(a2);
+    free(b);
+    free(c);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Benchmark for devirtualization of C++ virtual calls
+ *
+ * A polymorphic kernel applies a virtual function to each element of
+ * an array. The object is passed as known pointer, but
+ * its data members stay unknown (they may change between calls). With
+ * C++ vtables enabled, DBrew resolves the virtual call and inlines it.
+ *
+ * Usage: virtual [-n <array size>] [-r <repetitions>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbrew.h"
+
+struct Op {
+    virtual double apply(double x) const = 0;
+    virtual ~Op() {}
+};
+
+struct Scale : Op {
+    double f;
+    Scale(double _f) : f(_f) {}
+    double apply(double x) const { return f * x; }
+};
+
+struct Offset : Op {
+    double d;
+    Offset(double _d) : d(_d) {}
+    double apply(double x) const { return x + d; }
+};
+
+typedef void (*map_t)(const Op*, const double*, double*, long);
+
+// as if compiled separately from the classes: no speculative inlining
+__attribute__ ((noinline, optimize("no-devirtualize-speculatively")))
+void map(const Op* op, const double* x, double* y, long n)
+{
+    for(long i = 0; i < n; i++)
+        y[i] = op->apply(x[i]);
+}
+
+static
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// returns best time of <reps> runs of <f>
+static
+double runTime(map_t f, const Op* op, const double* x, double* y, long n,
+               int reps)
+{
+    double best = 0;
+
+    for(int i = 0; i < reps; i++) {
+        double t0 = now();
+        f(op, x, y, n);
+        double t = now() - t0;
+        if ((i == 0) || (t < best)) best = t;
+    }
+    return best;
+}
+
+// rewrite map for object <op>, 0 on error
+static
+map_t rewrite(Rewriter* r, const Op* op)
+{
+    dbrew_set_function(r, (uint64_t) map);
+    dbrew_config_parcount(r, 4);
+    dbrew_config_staticpar_shallow(r, 0);
+    dbrew_config_cxx_vtables(r, true);
+    // do not unroll the loop of the kernel
+    dbrew_config_force_unknown(r, 0);
+
+    map_t ff = (map_t) dbrew_rewrite(r, op, 0, 0, 0);
+    if (ff == map) return 0;
+    return ff;
+}
+
+int main(int argc, char* argv[])
+{
+    long n = 10000;
+    int reps = 100;
+    int arg = 1;
+
+    while(arg < argc) {
+        if ((strcmp(argv[arg], "-n") == 0) && (arg+1 < argc))
+            n = atol(argv[++arg]);
+        if ((strcmp(argv[arg], "-r") == 0) && (arg+1 < argc))
+            reps = atoi(argv[++arg]);
+        arg++;
+    }
+    if (n < 1) n = 1;
+    if (reps < 1) reps = 1;
+
+    double* x = (double*) malloc(n * sizeof(double));
+    double* y1 = (double*) malloc(n * sizeof(double));
+    double* y2 = (double*) malloc(n * sizeof(double));
+    for(long i = 0; i < n; i++)
+        x[i] = (double) (i % 100);
+
+    Scale* scale = new Scale(2.0);
+    Offset* offset = new Offset(1.0);
+    const Op* ops[2] = { scale, offset };
+    const char* names[2] = { "Scale", "Offset" };
+
+    printf("Virtual calls in kernel (array size %ld, best of %d runs)\n",
+           n, reps);
+    printf("  %-8s %12s %12s\n", "object", "orig", "rewritten");
+    for(int i = 0; i < 2; i++) {
+        Rewriter* r = dbrew_new();
+        map_t ff = rewrite(r, ops[i]);
+        if (!ff) {
+            printf("  %-8s rewriting failed\n", names[i]);
+            return 1;
+        }
+
+        double t1 = runTime(map, ops[i], x, y1, n, reps);
+        double t2 = runTime(ff, ops[i], x, y2, n, reps);
+        if (memcmp(y1, y2, n * sizeof(double)) != 0) {
+            printf("  %-8s wrong result\n", names[i]);
+            return 1;
+        }
+        printf("  %-8s %9.3f us %9.3f us\n", names[i], 1e6 * t1, 1e6 * t2);
+        dbrew_free(r);
+    }
+
+    // data members of objects are not assumed to be constant
+    Rewriter* r = dbrew_new();
+    map_t ff = rewrite(r, scale);
+    scale->f = 3.0;
+    if (ff) {
+        map(scale, x, y1, n);
+        ff(scale, x, y2, n);
+    }
+    if (!ff || (memcmp(y1, y2, n * sizeof(double)) != 0)) {
+        printf("  changed data member not respected\n");
+        return 1;
+    }
+    dbrew_free(r);
+
+    delete scale;
+    delete offset;
+    free(x);
+    free(y1);
+    free(y2);
+    return 0;
+}
@@ -164,21 +164,126 @@ int dbrew_generated_size(Rewriter* r);
 // configure rewriter
 void dbrew_config_reset(Rewriter* r);
 void dbrew_config_staticpar(Rewriter* r, int staticParPos);
+// parameter known, but not memory reachable via it (unless constant)
+void dbrew_config_staticpar_shallow(Rewriter* r, int staticParPos);
 void dbrew_config_returnfp(Rewriter* r);
 void dbrew_config_parcount(Rewriter* r, int parCount);
+// type of a parameter, determines how it is passed (default: integer)
+typedef enum _DBrewParType {
+    DBREW_PAR_INT = 0, // integer or pointer
+    DBREW_PAR_DOUBLE,
+    DBREW_PAR_FLOAT
+} DBrewParType;
+void dbrew_config_partype(Rewriter* r, int par, DBrewParType type);
 // assume all calculated results to be unknown at call depth lower <depth>
 void dbrew_config_force_unknown(Rewriter* r, int depth);
 // assume all branches to be fixed according to rewriter input parameters
 void dbrew_config_branches_known(Rewriter* r, bool);
+// emulated writes to non-stack memory go to shadow memory (default: false)
+void dbrew_config_shadow_memory(Rewriter* r, bool b);
+// capture instructions with only unknown inputs without emulating them.
+// Unknown register values are not updated then (default: false)
+void dbrew_config_capture_only(Rewriter* r, bool b);
+// maximal number of unrolled instances of a recursive function; deeper
+// recursion is done by real calls (default: 16)
+void dbrew_config_recursion_depth(Rewriter* r, int depth);
+// level of analysis done on emulated values (default: DBREW_ANALYSIS_DEPS)
+typedef enum _DBrewAnalysis {
+    DBREW_ANALYSIS_NONE = 0, // no analysis
+    DBREW_ANALYSIS_DEPS,     // which values are input parameters
+    DBREW_ANALYSIS_AFFINE    // also affine expressions of input parameters
+} DBrewAnalysis;
+void dbrew_config_analysis(Rewriter* r, DBrewAnalysis level);
+// budgets limiting effort of a rewrite (limit 0: unlimited, default).
+// If exceeded, rewriting stops and the original function is returned
+typedef enum _DBrewBudget {
+    DBREW_BUDGET_NONE = 0,
+    DBREW_BUDGET_EMU_INSTRS, // emulated instructions
+    DBREW_BUDGET_STATES,     // saved emulator states
+    DBREW_BUDGET_CAP_INSTRS, // captured instructions
+    DBREW_BUDGET_CODE_BYTES, // size of generated code
+    DBREW_BUDGET_TIME_US,    // elapsed time in microseconds
+    DBREW_BUDGET_MAX
+} DBrewBudget;
+void dbrew_config_budget(Rewriter* r, DBrewBudget b, long limit);
+// on exceeded budget, rewrite again with all results unknown (no
+// unrolling, no budgets) instead of returning the original function
+void dbrew_config_budget_degrade(Rewriter* r, bool b);
+// inlining of calls to a function. With automatic decision, a call is
+// inlined if the function is small enough (see dbrew_config_inline_limit)
+typedef enum _DBrewInline {
+    DBREW_INLINE_AUTO = 0,
+    DBREW_INLINE_ALWAYS,
+    DBREW_INLINE_NEVER
+} DBrewInline;
+void dbrew_config_function_inline(Rewriter* r, uint64_t f, DBrewInline mode);
+// signature of function <f>: number of scalar integer/pointer and floating
+// point parameters. Calls not inlined (and indirect calls at sites with <f>
+// as expected target) are only done as real calls if this is known and no
+// argument is passed on the stack; otherwise, they get inlined
+void dbrew_config_function_parcount(Rewriter* r, uint64_t f,
+                                    int intPars, int fpPars);
+// maximal code size of a function to be inlined if its size is known.
+// The limit grows with each known parameter and shrinks with each copy
+// already inlined. Calls not inlined go to a clone specialized for the
+// known parameters or to the original function (default 0: always inline)
+void dbrew_config_inline_limit(Rewriter* r, int size);
+// re-roll loops with known trip count after <iterations> unrolled
+// iterations (at least 4) if the captured code of the last iterations is
+// the same, and known values only differ in registers or stack words
+// changing by a constant stride. These become unknown, resulting in a
+// real loop with other known values still specialized
+// (default 0: unroll completely)
+void dbrew_config_loop_reroll(Rewriter* r, int iterations);
+// partially unroll the loop with <header> as target of its backward jump
+// (0: all loops, otherwise same as DBREW_DIRECTIVE_UNROLL for the header)
+// by <factor> when re-rolling it: the real loop runs over
+// <factor> copies of the body, with the exit test kept in each copy as
+// not-taken branch. For a known trip count, remaining iterations not
+// filling the unrolled body are peeled off in front of the loop and stay
+// specialized. A factor > 0 enables re-rolling for the loop after at least
+// <factor> iterations if dbrew_config_loop_reroll is not set (default 0)
+void dbrew_config_loop_unroll(Rewriter* r, uint64_t header, int factor);
 // provide a name for a function (for debug)
 void dbrew_config_function_setname(Rewriter* r, uint64_t f, const char* name);
 // provide a code length in bytes for a function (for debugging)
 void dbrew_config_function_setsize(Rewriter* r, uint64_t f, int len);
+// set names/sizes of functions from ELF symbols of program and loaded libs
+int dbrew_config_function_load_symbols(Rewriter* r);
 // provide a name for a parameter of the function to rewrite (for debug)
 void dbrew_config_par_setname(Rewriter* c, int par, char* name);
-// register a valid memory range with permission and name (for debug)
-void dbrew_config_set_memrange(Rewriter* r, char* name, bool isWritable,
+// register a valid memory range with permission and name. Ranges may
+// nest; returns false if range partially overlaps a registered range
+bool dbrew_config_set_memrange(Rewriter* r, char* name, bool isWritable,
                                uint64_t start, int size);
+// treat read-only mappings of the process as constant data
+void dbrew_config_readonly_constant(Rewriter* r, bool b);
+// expected target of an indirect call at address <site> (0: any call
+// with unknown target). Up to 4 expected targets get inlined, selected
+// by comparing the actual target; others are called as before
+void dbrew_config_call_target(Rewriter* r, uint64_t site, uint64_t target);
+// C++: vtable pointers in objects at known addresses and vtables are
+// constant, allowing virtual calls to be inlined (objects must not
+// change their dynamic type while rewritten code is used)
+void dbrew_config_cxx_vtables(Rewriter* r, bool b);
+// directives for code in an address range, overriding the global
+// configuration there. Innermost ranges take precedence (of partially
+// overlapping ranges, the one starting last)
+typedef enum _DBrewDirective {
+    DBREW_DIRECTIVE_NONE = 0,
+    DBREW_DIRECTIVE_DYNAMIC, // results of instructions unknown (<arg> 1)
+                             // or known (0), see dbrew_config_force_unknown
+    DBREW_DIRECTIVE_UNROLL,  // loops with header in range: unroll factor
+                             // <arg>, see dbrew_config_loop_unroll
+    DBREW_DIRECTIVE_INLINE,  // calls to functions in range: DBrewInline
+                             // mode <arg>, see dbrew_config_function_inline
+    DBREW_DIRECTIVE_BRANCH,  // conditional jumps with unknown condition
+                             // assumed taken (<arg> 1) or not (0). The
+                             // rewritten code is wrong if this does not hold
+    DBREW_DIRECTIVE_MAX
+} DBrewDirective;
+void dbrew_config_directive(Rewriter* r, uint64_t start, int size,
+                            DBrewDirective d, int arg);
 
 // convenience functions, using default rewriter
 void dbrew_def_verbose(bool decode, bool emuState, bool emuSteps);
@@ -189,9 +294,26 @@ uint64_t dbrew_emulate(Rewriter* r, ...);
 // rewrite configured function, return pointer to rewritten code
 uint64_t dbrew_rewrite(Rewriter* r, ...);
 
+// typed parameter value for dbrew_rewrite_args
+typedef struct _DBrewArg {
+    DBrewParType type;
+    union {
+        uint64_t i;
+        double d;
+        float f;
+    } v;
+} DBrewArg;
+
+// rewrite with <count> typed parameters instead of variable arguments.
+// This sets parameter count and types in the configuration
+uint64_t dbrew_rewrite_args(Rewriter* r, int count, DBrewArg* args);
+
 // rewrite <f> using default config, return pointer to rewritten code
 uint64_t dbrew_rewrite_func(uint64_t f, ...);
 
+// budget exceeded in last rewrite, DBREW_BUDGET_NONE if none
+DBrewBudget dbrew_budget_exceeded(Rewriter* r);
+
 
 
 // Vector API:
@@ -33,6 +33,9 @@ struct _CodeStorage {
 typedef struct _CodeStorage CodeStorage;
 
 CodeStorage* initCodeStorage(int size);
+// storage for data addressable with absolute 32-bit addresses
+#define CONSTSTORAGE_ADDR 0x40000000
+CodeStorage* initConstStorage(int size);
 void freeCodeStorage(CodeStorage* cs);
 
 /* this checks whether enough storage is available, but does
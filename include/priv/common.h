@@ -32,6 +32,7 @@
 
 typedef struct _MemRangeConfig MemRangeConfig;
 typedef struct _FunctionConfig FunctionConfig;
+typedef struct _DirectiveConfig DirectiveConfig;
 typedef struct _CaptureConfig CaptureConfig;
 
 // a decoded basic block
@@ -77,8 +78,9 @@ char* cbb_prettyName(CBB* bb);
 
 
 
-#define CC_MAXPARAM     6
+#define CC_MAXPARAM     16
 #define CC_MAXCALLDEPTH 5
+#define CC_MAXCALLTARGETS 4
 
 // emulator capture states
 typedef enum _CaptureState {
@@ -90,12 +92,12 @@ typedef enum _CaptureState {
     CS_Max
 } CaptureState;
 
-// includes capture state and analysis information for values stored
-// in registers or on (private) stack
+// includes capture state and constraints for values stored
+// in registers or on (private) stack. Analysis information is kept
+// separately (see EmuValue), as it only exists with analysis enabled
 typedef struct _MetaState {
     CaptureState cState;
-    ExprNode* range;  // constrains for dynamic value
-    ExprNode* parDep; // analysis: dependency from input parameters
+    uint32_t bound; // constraint for dynamic value: < bound, 0 if none
 } MetaState;
 
 void initMetaState(MetaState* ms, CaptureState cs);
@@ -111,13 +113,13 @@ typedef enum _MemRangeType {
     MR_ConstantData,   // accessable, initialized with constant data
     MR_MutableData,    // accessable, writable
     MR_Function,       // accessable, compiled code
+    MR_Directive,      // directive for code in range
 } MemRangeType;
 
 struct _MemRangeConfig
 {
     MemRangeType type;
     char* name;
-    MemRangeConfig* next; // chain to next config
     CaptureConfig* cc; // capture config this belongs to
     uint64_t start;
     int size;
@@ -126,21 +128,50 @@ struct _MemRangeConfig
 // extension of MemRangeConfig
 struct _FunctionConfig
 {
-    // 1st 6 entries have to be same as MemRangeConfig
+    // 1st 5 entries have to be same as MemRangeConfig
     MemRangeType type;
     char* name;
-    MemRangeConfig* next; // chain to next config
     CaptureConfig* cc; // capture config this belongs to
     uint64_t start;
     int size;
 
-    // TODO: extended config for functions
+    // inlining of calls to this function
+    DBrewInline inlining;
+    // signature: number of integer and FP parameters, -1 if unknown
+    int intPars, fpPars;
+    // number of calls inlined in current rewrite
+    int inlineCount;
 };
 
+// extension of MemRangeConfig
+struct _DirectiveConfig
+{
+    // 1st 5 entries have to be same as MemRangeConfig
+    MemRangeType type;
+    char* name;
+    CaptureConfig* cc; // capture config this belongs to
+    uint64_t start;
+    int size;
+
+    DBrewDirective directive;
+    int arg;
+};
+
+// memory range configurations sorted by start address (sorted on demand)
+typedef struct _RangeIndex
+{
+    MemRangeConfig** mrc;
+    uint64_t* maxend; // maximum end address of ranges up to index
+    int count, capacity;
+    bool sorted;
+} RangeIndex;
+
 struct _CaptureConfig
 {
     // specialise for some parameters to be constant?
     MetaState par_state[CC_MAXPARAM];
+    // types of parameters, determining how they are passed
+    DBrewParType par_type[CC_MAXPARAM];
     // for debug: allow parameters to be named
     char* par_name[CC_MAXPARAM];
 
@@ -152,10 +183,42 @@ struct _CaptureConfig
     bool force_unknown[CC_MAXCALLDEPTH];
     // all branches forced known
     bool branches_known;
-
-    // linked list of memory range and function configurations
-    MemRangeConfig* range_configs;
-
+    // emulated writes to non-stack memory go to shadow memory
+    bool shadow_memory;
+    // capture instructions with only dynamic inputs without emulation
+    bool capture_only;
+    // maximal number of inlined instances of a recursive function
+    int max_recursion;
+    // maximal size of function inlined with unknown parameters, 0: any
+    int inline_limit;
+    // unrolled iterations before re-rolling a loop, 0: never re-roll
+    int loop_reroll;
+    // unroll factor of re-rolled loops, 0/1: no partial unrolling
+    int loop_unroll;
+    // analysis information kept in MetaState of values
+    DBrewAnalysis analysis;
+    // limits for rewriting effort, 0 for unlimited
+    long budget[DBREW_BUDGET_MAX];
+    // on exceeded budget, rewrite again with all results unknown
+    bool budget_degrade;
+
+    // memory range configurations (may nest)
+    RangeIndex functions;
+    RangeIndex data;
+    // directives for code ranges, may nest and overlap
+    RangeIndex directives;
+
+    // treat read-only mappings of the process as constant data?
+    bool readonly_constant;
+    // sorted, non-adjacent read-only address ranges [ro_start;ro_end[
+    uint64_t *ro_start, *ro_end;
+    int ro_count, ro_capacity;
+    // C++: vtable pointers of objects at known addresses are constant
+    bool cxx_vtables;
+
+    // expected targets of indirect calls at call sites (site 0: any)
+    uint64_t *ct_site, *ct_target;
+    int ct_count, ct_capacity;
 };
 
 
@@ -174,6 +237,19 @@ typedef enum _VectorizeReq {
 
 bool config_is_constant(Rewriter* r, uint64_t addr, size_t size);
 FunctionConfig* config_find_function(Rewriter* r, uint64_t f);
+MemRangeConfig* config_find_named(CaptureConfig* cc, uint64_t addr);
+int config_call_targets(Rewriter* r, uint64_t site, uint64_t* targets, int max);
+int config_loop_unroll(Rewriter* r, uint64_t header);
+int config_directive(Rewriter* r, uint64_t addr, DBrewDirective d, int def);
+bool config_is_cxx_constant(Rewriter* r, uint64_t addr, uint64_t val);
+void config_reset_inline_counts(Rewriter* r);
+FunctionConfig* config_add_function(Rewriter* r, uint64_t f, int size,
+                                    const char* name);
+void config_copy(Rewriter* dst, Rewriter* src);
+void config_free(Rewriter* r);
+
+// from symbols.c
+uint64_t resolvePLT(uint64_t addr);
 
 
 
@@ -205,16 +281,47 @@ typedef struct _EmuValue {
     uint64_t val;
     ValType type;
     MetaState state;
+    ExprNode* parDep; // analysis: dependency from input parameters
 } EmuValue;
 
-
-#define MAX_CALLDEPTH 5
+// frame of a call inlined by the emulator
+typedef struct _CallFrame {
+    uint64_t ret;  // return address
+    uint64_t func; // called function
+    // known parameter values at call (mask of parameters known)
+    uint64_t par[6];
+    uint64_t parStatic;
+} CallFrame;
 
 // emulator state. for memory, use the real memory apart from stack
 
 struct _EmuState;
 typedef struct _EmuState EmuState;
 
+// emulated write to memory outside of the stack, kept in shadow memory
+#define SHADOWSLOT_SIZE 8
+typedef struct _ShadowSlot {
+    uint64_t addr; // aligned to SHADOWSLOT_SIZE
+    uint8_t data[SHADOWSLOT_SIZE];
+    uint8_t state[SHADOWSLOT_SIZE]; // CaptureState per byte, DEAD: not written
+} ShadowSlot;
+
+// analysis information for a value stored in an aligned stack slot
+#define STACKSLOT_SIZE 8
+typedef struct _StackSlot {
+    uint32_t bound;
+    ExprNode* parDep;
+} StackSlot;
+
+// copy-on-write page of emulated stack, shared among saved EmuStates
+#define STACKPAGE_SIZE 8
+typedef struct _StackPage {
+    int refCount;
+    uint8_t data[STACKPAGE_SIZE];
+    uint8_t state[STACKPAGE_SIZE]; // CaptureState per byte
+    StackSlot slot[STACKPAGE_SIZE / STACKSLOT_SIZE];
+} StackPage;
+
 struct _EmuState {
 
     // when saving an EmuState, remember root
@@ -223,6 +330,8 @@ struct _EmuState {
     // general purpose registers: RAX - R15
     uint64_t reg[RI_GPMax];
     MetaState reg_state[RI_GPMax];
+    // analysis: parDep of registers, 0 if analysis is disabled
+    ExprNode** regDep;
 
     // instruction pointer
     uint64_t regIP;
@@ -232,21 +341,89 @@ struct _EmuState {
     // TODO: auxiliary carry
     bool flag[FT_Max];
     MetaState flag_state[FT_Max];
+    // lazy flags: values of flags in flagsPending are not computed yet,
+    // but given by the last flag-setting operation (see getFlag)
+    int flagsPending; // FlagSet
+    InstrType flagsOp;
+    ValType flagsOpType;
+    uint64_t flagsOpD, flagsOpS; // operands
 
     // stack
     int stackSize;
     uint8_t* stack; // real memory backing
     uint64_t stackStart, stackAccessed, stackTop; // virtual stack boundaries
-    // capture state of stack
-    MetaState *stackState;
-
-    // own return stack
-    uint64_t ret_stack[MAX_CALLDEPTH];
+    // capture state of stack: CaptureState per byte, analysis information
+    // per slot (only kept for values written to a slot as a whole)
+    uint8_t* stackState;
+    StackSlot* stackSlot;
+    // XOR of hashes of static stack bytes (offset from top and value),
+    // updated on each stack write
+    uint64_t stackHash;
+    // stack split into pages (0: all DEAD). Saved EmuStates only have pages
+    // from the first accessed one to the top, no stack/stackState.
+    // For the current EmuState, pages of the saved state last saved or
+    // restored, with <stackDirty> set if modified since then
+    int stackPageCount;
+    StackPage** stackPage;
+    bool* stackDirty;
+
+    // vector registers xmm0 - xmm15 as 32-bit lanes, CaptureState per lane.
+    // A register never has both static and dynamic lanes (static lanes are
+    // loaded from the constant pool before the register is used in captured
+    // code). Upper halves of ymm registers are not tracked
+#define VREG_LANES 4
+    uint32_t vreg[RI_XMMMax][VREG_LANES];
+    uint8_t vreg_state[RI_XMMMax][VREG_LANES];
+
+    // shadow memory: writes to non-stack memory, slots sorted by address.
+    // If <shadowMemory> is false, writes go to real memory
+    bool shadowMemory;
+    int shadowCount, shadowCapacity;
+    ShadowSlot* shadow;
+
+    // own call stack, growing on demand
+    CallFrame* callStack;
+    int callCapacity;
     int depth;
 
+    // partially unrolled loops: backward jump, unroll factor and copy of
+    // the loop body currently emulated
+#define UNROLL_MAX 4
+    int unrollCount;
+    uint64_t unrollJump[UNROLL_MAX];
+    int unrollFactor[UNROLL_MAX];
+    int unrollPhase[UNROLL_MAX];
 };
 
 
+// loop re-rolling: state at a taken backward jump with known condition
+#define LOOPSNAPSHOT_STACK 256
+typedef struct _LoopSnapshot {
+    uint64_t reg[RI_GPMax];
+    CaptureState cs[RI_GPMax];
+    // accessed part of stack, if not larger than LOOPSNAPSHOT_STACK
+    // (otherwise, <stackLen> is -1 and the stack is covered by <fp>)
+    int stackLen;
+    uint8_t stack[LOOPSNAPSHOT_STACK];
+    uint8_t stackState[LOOPSNAPSHOT_STACK];
+    uint64_t fp; // fingerprint of other static state besides flags
+    int capCount; // number of instructions captured up to here
+    // operation flags are derived from (IT_None: unknown)
+    InstrType flagsOp;
+    ValType flagsOpType;
+    uint64_t flagsOpD, flagsOpS;
+} LoopSnapshot;
+
+// last iterations seen of a loop being unrolled
+#define LOOPTRACK_MAX 4
+#define LOOPTRACK_SNAPSHOTS 4
+#define LOOPTRACK_STACKSLOTS 8 // max. number of stack induction variables
+typedef struct _LoopTrack {
+    uint64_t addr; // address of backward jump, 0 if unused
+    int iterations;
+    LoopSnapshot snap[LOOPTRACK_SNAPSHOTS]; // ring buffer
+} LoopTrack;
+
 struct _Rewriter {
 
     // decoded instructions
@@ -256,6 +433,8 @@ struct _Rewriter {
     // decoded basic blocks
     int decBBCount, decBBCapacity;
     DBB* decBB;
+    // if set, BBs end before instructions which may cross this address
+    uint64_t decEnd;
 
     // captured instructions
     int capInstrCount, capInstrCapacity;
@@ -278,6 +457,11 @@ struct _Rewriter {
     uint64_t generatedCodeAddr;
     int generatedCodeSize;
 
+    // constants loaded by generated code (static vector register values),
+    // allocated on demand
+#define CONSTPOOL_SIZE 4096
+    CodeStorage* constPool;
+
     // vectorization config
     VectorizeReq vreq;
     int vectorsize;
@@ -286,20 +470,34 @@ struct _Rewriter {
     CaptureConfig* cc;
     EmuState* es;
     // saved emulator states
-#define SAVEDSTATE_MAX 100
+#define SAVEDSTATE_MAX 1000
     int savedStateCount;
     EmuState* savedState[SAVEDSTATE_MAX];
+    // hash table to find saved states by fingerprint of static state
+#define SAVEDSTATE_HASHSIZE 1024
+    uint64_t savedStateFP[SAVEDSTATE_MAX];
+    int savedStateNext[SAVEDSTATE_MAX]; // next esID in same bucket, or -1
+    int savedStateBucket[SAVEDSTATE_HASHSIZE]; // first esID, or -1
 
     // stack of unfinished BBs to capture
-#define CAPTURESTACK_LEN 100
+#define CAPTURESTACK_LEN 1000
     int capStackTop;
     CBB* capStack[CAPTURESTACK_LEN];
 
+    // loops with known trip count currently unrolled (see rerollLoop)
+    LoopTrack loopTrack[LOOPTRACK_MAX];
+    int loopTrackNext; // tracker to use for next new loop
+
     // capture order
-#define GENORDER_MAX 100
+#define GENORDER_MAX 1000
     int genOrderCount;
     CBB* genOrder[GENORDER_MAX];
 
+    // statistics of last emulation run
+    long emuInstrCount; // number of instructions emulated
+    uint64_t startTime; // in microseconds, for DBREW_BUDGET_TIME_US
+    DBrewBudget budgetExceeded;
+
     // for optimization passes
     bool addInliningHints;
     bool doCopyPass; // test pass
@@ -312,6 +510,10 @@ struct _Rewriter {
 
     // list of related rewriters
     Rewriter* next;
+    // for clones of called functions specialized for known parameters
+    // (see keepCall): mask of known parameter registers, -1 if no clone
+    int cloneParStatic;
+    uint64_t clonePar[6];
 };
 
 
@@ -42,23 +42,28 @@
  * saving emulator state. After emulating one path, we roll back and
  * go the other path. As this may happen recursively, we do a kind of
  * back-tracking, with emulator states stored as stacks.
- * To allow for fast saving/restoring of emulator states, each part of
- * the emulation state (registers, bytes on stack) is given by a
- * EmuStateEntry (linked) list with the current value/state in front.
- * Saving copies the complete EmuState, inheriting the individual states.
+ * To allow for fast saving/restoring of emulator states, the stack of
+ * saved states is split into copy-on-write pages (StackPage), shared
+ * among saved states. Saving only copies stack pages modified since the
+ * last save/restore, and restoring only copies pages which differ.
  */
 
 // exported functions
 
 // get a new emulator state with stack size <size>
 EmuState* allocEmuState(int size);
+// free current and saved emulator states
 void freeEmuState(Rewriter* r);
+void freeSavedEmuStates(Rewriter* r);
 void resetEmuState(EmuState* es);
+// keep analysis information for registers of <es>?
+void setEmuAnalysis(EmuState* es, bool enable);
 // save current emulator state for later rollback, return ID
 int saveEmuState(RContext *c);
 // set current emulator state to previously saved state <esID>
 void restoreEmuState(Rewriter* r, int esID);
 void printEmuState(EmuState* es);
+void setStackArg(EmuState* es, int off, EmuValue* v);
 void printStaticEmuState(EmuState* es, int esID);
 
 void resetCapturing(Rewriter* r);
@@ -72,6 +77,9 @@ void captureRet(RContext* c, Instr* orig, EmuState* es);
 // clone a decoded BB as a CBB
 CBB* createCBBfromDBB(Rewriter* r, DBB* src);
 
+// resolve handler and operand accessors for emulation of an instruction
+void prepareEmulation(Instr* instr);
+
 // emulate a given instruction in a given emulation state (in RContext).
 // Capture it if not static. Set exit variable in RContext on jump.
 // Returns 0 if no error, otherwise pointer to Error struct
@@ -33,13 +33,21 @@ struct _RContext
     Rewriter* r;
     uint64_t exit;
     Error* e;
+    // decoded BB with instructions processed, for patterns over
+    // multiple instructions (0 if not known)
+    DBB* dbb;
 };
 
 Rewriter* allocRewriter(void);
 void initRewriter(Rewriter* r);
 void freeRewriter(Rewriter* r);
 
+// set error in <c> if <used> exceeds configured budget <b>
+bool checkBudget(RContext* c, DBrewBudget b, long used);
+
 // Rewrite engine
+Error* vGetParameters(Rewriter* r, va_list args, uint64_t* par);
+Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par);
 Error* vEmulateAndCapture(Rewriter* r, va_list args);
 void runOptsOnCaptured(RContext *c);
 void generateBinaryFromCaptured(RContext* c);
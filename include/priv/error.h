@@ -44,7 +44,7 @@ typedef enum _ErrorModule {
 typedef enum _ErrorType {
     ET_NoError,
     ET_Unknown,
-    ET_InvalidRequest, // Rewriter
+    ET_InvalidRequest, ET_BudgetExceeded, // Rewriter
     ET_BufferOverflow, // Decoder, Generator, Rewriter
     ET_UnsupportedInstr, ET_UnsupportedOperands, // Generator, Emulator
     // Decoder
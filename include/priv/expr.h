@@ -34,15 +34,22 @@ struct _ExprNode {
     char name[EN_NAMELEN]; // Par: parameter name, Ref: array name
 };
 
+// nodes are hash-consed: identical expressions share one node.
+// Functions creating nodes return 0 if the pool is full (or for
+// operands being 0), meaning "unknown expression"
+#define EXPR_HASHSIZE 1024
 struct _ExprPool {
     int size;
     int used;
+    int hashHead[EXPR_HASHSIZE]; // first node index in bucket, or -1
+    int* hashNext; // next node index in same bucket, or -1
     ExprNode n[1];
 };
 
 ExprPool* expr_allocPool(int s);
 void expr_freePool(ExprPool* p);
-ExprNode* expr_newNode(ExprPool* p, NodeType t);
+// remove all nodes
+void expr_resetPool(ExprPool* p);
 int expr_nodeIndex(ExprPool* p, ExprNode* n);
 
 ExprNode* expr_newConst(ExprPool* p, int val);
@@ -260,6 +260,13 @@ typedef enum _StateChange {
     SC_dstDyn // operand dst is valid, should change to dynamic
 } StateChange;
 
+struct _RContext;
+struct _EmuValue;
+// handler to emulate and capture an instruction
+typedef void (*EmuHandler)(struct _RContext*, Instr*);
+// accessor to get the emulated value of an operand
+typedef void (*OpGetter)(struct _RContext*, struct _EmuValue*, Operand*);
+
 struct _Instr {
     InstrType type;
 
@@ -280,6 +287,10 @@ struct _Instr {
     OperandEncoding ptEnc;
     StateChange ptSChange;
 
+    // emulation handler and value accessors for operands dst/src/src2,
+    // set at decode time or on first emulation (see prepareEmulation)
+    EmuHandler handler;
+    OpGetter getDst, getSrc, getSrc2;
 
     ExprNode* info_memAddr; // annotate memory reference of instr
 };
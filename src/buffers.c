@@ -59,6 +59,38 @@ CodeStorage* initCodeStorage(int size)
     return cs;
 }
 
+/* Storage for constants referenced by generated code. As the generator
+ * only supports absolute 32-bit addresses, it is mapped into the low 2GB
+ * of the address space (first trying a fixed address to get reproducible
+ * code). Returns 0 if not possible.
+ */
+CodeStorage* initConstStorage(int size)
+{
+    int fullsize;
+    uint8_t* buf;
+    CodeStorage* cs;
+
+    fullsize = (size + 4095) & ~4095;
+
+    buf = (uint8_t*) mmap((void*) CONSTSTORAGE_ADDR, fullsize,
+                          PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE | MAP_32BIT, -1, 0);
+    if (buf == (uint8_t*)-1)
+        return 0;
+    if ((uint64_t) buf + fullsize > (1ull << 31)) {
+        munmap(buf, fullsize);
+        return 0;
+    }
+
+    cs = (CodeStorage*) malloc(sizeof(CodeStorage));
+    cs->size = size;
+    cs->fullsize = fullsize;
+    cs->buf = buf;
+    cs->used = 0;
+
+    return cs;
+}
+
 void freeCodeStorage(CodeStorage* cs)
 {
     if (cs)
@@ -17,12 +17,164 @@
  * along with DBrew.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+
 #include "common.h"
 
 #include <assert.h>
+#include <link.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+//
+// Index of memory range configurations: ranges are found via binary
+// search. Sorting is delayed until the next lookup after adding ranges or
+// changing sizes. As ranges may nest, maxend[i] keeps the maximum end
+// address of entries 0..i to know when to stop searching.
+//
+
+static
+void ri_init(RangeIndex* ri)
+{
+    ri->mrc = 0;
+    ri->maxend = 0;
+    ri->count = 0;
+    ri->capacity = 0;
+    ri->sorted = true;
+}
+
+static
+void ri_free(RangeIndex* ri)
+{
+    for(int i = 0; i < ri->count; i++) {
+        free(ri->mrc[i]->name);
+        free(ri->mrc[i]);
+    }
+    free(ri->mrc);
+    free(ri->maxend);
+}
+
+// end address used for index: ranges with unknown size cover 1 byte
+static
+uint64_t mrc_end(MemRangeConfig* mrc)
+{
+    return mrc->start + ((mrc->size > 0) ? (uint64_t) mrc->size : 1);
+}
+
+// order by start address. With same start, larger ranges come first:
+// searching backwards, inner ranges are found before enclosing ones
+static
+int mrc_cmp(const void* a, const void* b)
+{
+    MemRangeConfig* ma = *(MemRangeConfig**) a;
+    MemRangeConfig* mb = *(MemRangeConfig**) b;
+
+    if (ma->start < mb->start) return -1;
+    if (ma->start > mb->start) return 1;
+    if (mrc_end(ma) > mrc_end(mb)) return -1;
+    if (mrc_end(ma) < mrc_end(mb)) return 1;
+    return 0;
+}
+
+static
+void ri_sort(RangeIndex* ri)
+{
+    uint64_t maxend = 0;
+
+    if (ri->sorted) return;
+
+    qsort(ri->mrc, ri->count, sizeof(MemRangeConfig*), mrc_cmp);
+    for(int i = 0; i < ri->count; i++) {
+        uint64_t end = mrc_end(ri->mrc[i]);
+        if (end > maxend) maxend = end;
+        ri->maxend[i] = maxend;
+    }
+    ri->sorted = true;
+}
+
+static
+void ri_add(RangeIndex* ri, MemRangeConfig* mrc)
+{
+    int n = ri->count;
+
+    if (n == ri->capacity) {
+        ri->capacity = (n == 0) ? 64 : 2 * n;
+        ri->mrc = (MemRangeConfig**)
+            realloc(ri->mrc, ri->capacity * sizeof(MemRangeConfig*));
+        ri->maxend = (uint64_t*)
+            realloc(ri->maxend, ri->capacity * sizeof(uint64_t));
+    }
+    ri->mrc[n] = mrc;
+    ri->count++;
+
+    if (!ri->sorted) return;
+    // appending in address order keeps index sorted
+    if ((n > 0) && (mrc_cmp(ri->mrc + n - 1, &mrc) > 0)) {
+        ri->sorted = false;
+        return;
+    }
+    ri->maxend[n] = mrc_end(mrc);
+    if ((n > 0) && (ri->maxend[n-1] > ri->maxend[n]))
+        ri->maxend[n] = ri->maxend[n-1];
+}
+
+// index of last entry with start address < <addr>, -1 if none
+static
+int ri_last_below(RangeIndex* ri, uint64_t addr)
+{
+    int lo = 0, hi = ri->count;
+
+    ri_sort(ri);
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ri->mrc[mid]->start < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+// find range starting at <addr> (or covering it if !exact)
+static
+MemRangeConfig* ri_find(RangeIndex* ri, uint64_t addr, bool exact)
+{
+    for(int i = ri_last_below(ri, addr + 1); i >= 0; i--) {
+        MemRangeConfig* mrc = ri->mrc[i];
+        // on exact match, size does not matter
+        if (mrc->start == addr) return mrc;
+        if (exact) break;
+        // check if we fall into address range
+        if (addr < mrc->start + mrc->size) return mrc;
+        // no entry further down can cover addr
+        if (ri->maxend[i] <= addr) break;
+    }
+    return 0;
+}
+
+// is [start;end[ within range <mrc>?
+static
+bool mrc_contains(MemRangeConfig* mrc, uint64_t start, uint64_t end)
+{
+    return (mrc->start <= start) && (end <= mrc_end(mrc));
+}
+
+// index of next range overlapping with [start;end[ below index <i>,
+// -1 if none. Start search with <i> = ri->count
+static
+int ri_next_overlap(RangeIndex* ri, int i, uint64_t start, uint64_t end)
+{
+    int last = ri_last_below(ri, end);
+
+    for(i = (i > last) ? last : i - 1; i >= 0; i--) {
+        if (mrc_end(ri->mrc[i]) > start) return i;
+        // no entry further down can overlap
+        if (ri->maxend[i] <= start) break;
+    }
+    return -1;
+}
+
 static
 void cc_init(CaptureConfig* cc)
 {
@@ -30,13 +182,39 @@ void cc_init(CaptureConfig* cc)
         initMetaState(&(cc->par_state[i]), CS_DYNAMIC);
     for(int i=0; i < CC_MAXPARAM; i++)
         cc->par_name[i] = 0;
+    for(int i=0; i < CC_MAXPARAM; i++)
+        cc->par_type[i] = DBREW_PAR_INT;
     for(int i=0; i < CC_MAXCALLDEPTH; i++)
         cc->force_unknown[i] = false;
     cc->hasReturnFP = false;
     cc->parCount = -1; // unknown
     cc->branches_known = false;
-    cc->range_configs = 0;
-
+    cc->shadow_memory = false;
+    cc->capture_only = false;
+    cc->max_recursion = 16;
+    cc->inline_limit = 0;
+    cc->loop_reroll = 0;
+    cc->loop_unroll = 0;
+    cc->analysis = DBREW_ANALYSIS_DEPS;
+    for(int i=0; i < DBREW_BUDGET_MAX; i++)
+        cc->budget[i] = 0;
+    cc->budget_degrade = false;
+
+    ri_init(&(cc->functions));
+    ri_init(&(cc->data));
+    ri_init(&(cc->directives));
+
+    cc->readonly_constant = false;
+    cc->ro_start = 0;
+    cc->ro_end = 0;
+    cc->ro_count = 0;
+    cc->ro_capacity = 0;
+    cc->cxx_vtables = false;
+
+    cc->ct_site = 0;
+    cc->ct_target = 0;
+    cc->ct_count = 0;
+    cc->ct_capacity = 0;
 }
 
 static
@@ -47,12 +225,13 @@ void cc_free(CaptureConfig* cc)
     for(int i=0; i < CC_MAXPARAM; i++)
         free(cc->par_name[i]);
 
-    MemRangeConfig* fc = cc->range_configs;
-    while(fc) {
-        MemRangeConfig* next = fc->next;
-        free(fc);
-        fc = next;
-    }
+    ri_free(&(cc->functions));
+    ri_free(&(cc->data));
+    ri_free(&(cc->directives));
+    free(cc->ro_start);
+    free(cc->ro_end);
+    free(cc->ct_site);
+    free(cc->ct_target);
     free(cc);
 }
 
@@ -78,16 +257,25 @@ CaptureConfig* cc_get(Rewriter* r)
 }
 
 static
-MemRangeConfig* mrc_new(MemRangeType type, char* name,
-                       uint64_t start, int size,
-                       MemRangeConfig* next, CaptureConfig* cc)
+MemRangeConfig* mrc_new(MemRangeType type, const char* name,
+                        uint64_t start, int size, CaptureConfig* cc)
 {
     MemRangeConfig* mrc;
 
     if (type == MR_Function) {
         FunctionConfig* fc = (FunctionConfig*) malloc(sizeof(FunctionConfig));
+        fc->inlining = DBREW_INLINE_AUTO;
+        fc->intPars = -1;
+        fc->fpPars = -1;
+        fc->inlineCount = 0;
         mrc = (MemRangeConfig*) fc;
     }
+    else if (type == MR_Directive) {
+        DirectiveConfig* dc = (DirectiveConfig*) malloc(sizeof(DirectiveConfig));
+        dc->directive = DBREW_DIRECTIVE_NONE;
+        dc->arg = 0;
+        mrc = (MemRangeConfig*) dc;
+    }
     else
         mrc = (MemRangeConfig*) malloc(sizeof(MemRangeConfig));
 
@@ -95,43 +283,155 @@ MemRangeConfig* mrc_new(MemRangeType type, char* name,
     mrc->name = (name == 0) ? 0 : strdup(name);
     mrc->start = start;
     mrc->size = size;
-    mrc->next = next;
     mrc->cc = cc;
 
+    if (type == MR_Function)
+        ri_add(&(cc->functions), mrc);
+    else if (type == MR_Directive)
+        ri_add(&(cc->directives), mrc);
+    else
+        ri_add(&(cc->data), mrc);
+
     return mrc;
 }
 
 static
-MemRangeConfig* mrc_find(CaptureConfig* cc, MemRangeType type, uint64_t addr)
+FunctionConfig* fc_get(CaptureConfig* cc, uint64_t func)
 {
-    MemRangeConfig* mrc;
+    MemRangeConfig* fc;
 
-    mrc = cc->range_configs;
-    while(mrc) {
-        if ((type == MR_Unknown) || (mrc->type == type)) {
-            // on exact match, size does not matter
-            if (addr == mrc->start) return mrc;
-            // check if we fall into address range
-            if ((addr > mrc->start) && (addr < mrc->start+mrc->size))
-                return mrc;
-        }
-        mrc = mrc->next;
+    // functions may nest: only use config of function starting at <func>
+    fc = ri_find(&(cc->functions), func, true);
+    if (!fc)
+        fc = mrc_new(MR_Function, 0, func, 0, cc);
+    assert(fc->type == MR_Function);
+    return (FunctionConfig*) fc;
+}
+
+//
+// Read-only mappings of the process, used as constant data if enabled.
+// Ranges are taken from /proc/self/maps. If not available, we fall back
+// to PT_LOAD segments without write permission of loaded ELF objects.
+//
+
+static
+void ro_add(CaptureConfig* cc, uint64_t start, uint64_t end)
+{
+    int n = cc->ro_count;
+
+    // merge with adjacent previous range
+    if ((n > 0) && (cc->ro_end[n-1] == start)) {
+        cc->ro_end[n-1] = end;
+        return;
+    }
+    if (n == cc->ro_capacity) {
+        cc->ro_capacity = (n == 0) ? 64 : 2 * n;
+        cc->ro_start = (uint64_t*)
+            realloc(cc->ro_start, cc->ro_capacity * sizeof(uint64_t));
+        cc->ro_end = (uint64_t*)
+            realloc(cc->ro_end, cc->ro_capacity * sizeof(uint64_t));
+    }
+    cc->ro_start[n] = start;
+    cc->ro_end[n] = end;
+    cc->ro_count++;
+}
+
+static
+bool ro_scan_maps(CaptureConfig* cc)
+{
+    FILE* f;
+    char* line = 0;
+    size_t len = 0;
+
+    f = fopen("/proc/self/maps", "r");
+    if (!f) return false;
+
+    // format: <start>-<end> <perms> <offset> <dev> <inode> [<name>]
+    while(getline(&line, &len, f) > 0) {
+        uint64_t start, end;
+        char perms[5];
+        int nameOff = 0;
+
+        if (sscanf(line, "%lx-%lx %4s %*x %*x:%*x %*u %n",
+                   &start, &end, perms, &nameOff) < 3)
+            continue;
+        // only private, non-writable mappings
+        if ((perms[0] != 'r') || (perms[1] != '-') || (perms[3] != 'p'))
+            continue;
+        // kernel provided mappings such as [vvar] may change
+        if ((nameOff > 0) && (line[nameOff] == '['))
+            continue;
+        ro_add(cc, start, end);
+    }
+    free(line);
+    fclose(f);
+
+    return true;
+}
+
+static
+int ro_add_segments(struct dl_phdr_info* info, size_t size, void* data)
+{
+    CaptureConfig* cc = (CaptureConfig*) data;
+    (void) size;
+
+    for(int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* ph = info->dlpi_phdr + i;
+        uint64_t start = info->dlpi_addr + ph->p_vaddr;
+
+        if ((ph->p_type != PT_LOAD) || (ph->p_flags & PF_W)) continue;
+        if (!(ph->p_flags & PF_R)) continue;
+        ro_add(cc, start, start + ph->p_memsz);
     }
     return 0;
 }
 
 static
-FunctionConfig* fc_get(CaptureConfig* cc, uint64_t func)
+int ro_cmp(const void* a, const void* b)
 {
-    MemRangeConfig* fc;
+    uint64_t va = *(uint64_t*) a;
+    uint64_t vb = *(uint64_t*) b;
 
-    fc = mrc_find(cc, MR_Function, func);
-    if (!fc) {
-        fc = mrc_new(MR_Function, 0, func, 0, cc->range_configs, cc);
-        cc->range_configs = fc;
+    return (va < vb) ? -1 : (va > vb) ? 1 : 0;
+}
+
+static
+void ro_scan(CaptureConfig* cc)
+{
+    cc->ro_count = 0;
+    if (ro_scan_maps(cc)) return;
+
+    dl_iterate_phdr(ro_add_segments, cc);
+    // objects are not necessarily in address order: sort start/end pairs
+    uint64_t* pairs = (uint64_t*) malloc(2 * cc->ro_count * sizeof(uint64_t));
+    for(int i = 0; i < cc->ro_count; i++) {
+        pairs[2*i] = cc->ro_start[i];
+        pairs[2*i+1] = cc->ro_end[i];
     }
-    assert(fc->type == MR_Function);
-    return (FunctionConfig*) fc;
+    qsort(pairs, cc->ro_count, 2 * sizeof(uint64_t), ro_cmp);
+    int count = cc->ro_count;
+    cc->ro_count = 0;
+    for(int i = 0; i < count; i++)
+        ro_add(cc, pairs[2*i], pairs[2*i+1]);
+    free(pairs);
+}
+
+// is [addr;addr+size[ within a read-only mapping?
+static
+bool ro_contains(CaptureConfig* cc, uint64_t addr, size_t size)
+{
+    int lo = 0, hi = cc->ro_count;
+
+    // find last range with start <= addr
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cc->ro_start[mid] <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0) return false;
+    return (addr + size <= cc->ro_end[lo - 1]);
 }
 
 // DBrew internal, called by other modules
@@ -139,26 +439,247 @@ FunctionConfig* fc_get(CaptureConfig* cc, uint64_t func)
 bool config_is_constant(Rewriter* r, uint64_t addr, size_t size)
 {
     CaptureConfig* cc = cc_get(r);
-    MemRangeConfig* mrc = mrc_find(cc, MR_ConstantData, addr);
-    if (mrc) {
-        assert(mrc->type == MR_ConstantData);
-        if (mrc->start + mrc->size >= addr + size)
-            return true;
+    RangeIndex* ri = &(cc->data);
+    MemRangeConfig* mrc = ri_find(ri, addr, false);
+    bool covered;
+
+    // innermost range at addr is constant and covers the access?
+    covered = mrc && (mrc->type == MR_ConstantData) &&
+              (mrc->start + mrc->size >= addr + size);
+    if (!covered && !cc->readonly_constant) return false;
+
+    // writable ranges opt out, unless enclosing the constant range
+    for(int i = ri_next_overlap(ri, ri->count, addr, addr + size); i >= 0;
+        i = ri_next_overlap(ri, i, addr, addr + size)) {
+        MemRangeConfig* m = ri->mrc[i];
+        if (m->type == MR_ConstantData) continue;
+        if (covered && mrc_contains(m, mrc->start, mrc_end(mrc))) continue;
+        return false;
     }
-    return false;
+    if (covered) return true;
+
+    return ro_contains(cc, addr, size);
 }
 
 FunctionConfig* config_find_function(Rewriter* r, uint64_t f)
 {
     CaptureConfig* cc = cc_get(r);
-    MemRangeConfig* mrc = mrc_find(cc, MR_Function, f);
-    if (mrc) {
-        assert(mrc->type == MR_Function);
-        return (FunctionConfig*) mrc;
+    return (FunctionConfig*) ri_find(&(cc->functions), f, false);
+}
+
+// find named range covering <addr> (used for pretty printing addresses)
+// innermost named range covering <addr>: ranges without name (e.g. only
+// configuring inlining of a function) are skipped
+static
+MemRangeConfig* ri_find_named(RangeIndex* ri, uint64_t addr)
+{
+    for(int i = ri_last_below(ri, addr + 1); i >= 0; i--) {
+        MemRangeConfig* mrc = ri->mrc[i];
+        if (mrc->name &&
+            ((mrc->start == addr) || (addr < mrc->start + mrc->size)))
+            return mrc;
+        // no entry further down can cover addr
+        if (ri->maxend[i] <= addr) break;
     }
     return 0;
 }
 
+MemRangeConfig* config_find_named(CaptureConfig* cc, uint64_t addr)
+{
+    MemRangeConfig* mrc;
+
+    mrc = ri_find_named(&(cc->functions), addr);
+    if (mrc) return mrc;
+
+    return ri_find_named(&(cc->data), addr);
+}
+
+// C++ (Itanium ABI): does <vptr> point to the address point of a vtable
+// in read-only memory? It is preceded by offset-to-top and RTTI pointer
+static
+bool is_vtable(CaptureConfig* cc, uint64_t vptr)
+{
+    int64_t top;
+    uint64_t rtti;
+
+    if ((vptr & 7) || (vptr < 16)) return false;
+    if (!ro_contains(cc, vptr - 16, 24)) return false;
+
+    top = *(int64_t*) (vptr - 16);
+    rtti = *(uint64_t*) (vptr - 8);
+    if ((top > 0) || (top & 7) || (top < -(1 << 20))) return false;
+    if ((rtti != 0) && !ro_contains(cc, rtti, 8)) return false;
+    // first virtual function
+    return ro_contains(cc, *(uint64_t*) vptr, 1);
+}
+
+// with C++ vtables enabled, is 64-bit value <val> loaded from known
+// address <addr> constant? This is true for vtable pointers in objects
+// (objects are assumed not to change their type) and for pointers into
+// read-only memory stored in read-only memory (such as vtable entries)
+bool config_is_cxx_constant(Rewriter* r, uint64_t addr, uint64_t val)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    if (!cc->cxx_vtables) return false;
+    if (is_vtable(cc, val)) return true;
+    return ro_contains(cc, addr, 8) && ro_contains(cc, val, 1);
+}
+
+// start of a rewrite: no calls inlined yet
+void config_reset_inline_counts(Rewriter* r)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    for(int i = 0; i < cc->functions.count; i++)
+        ((FunctionConfig*) cc->functions.mrc[i])->inlineCount = 0;
+}
+
+// get up to <max> expected targets of an indirect call at <site> into
+// <targets>, returns number of targets
+int config_call_targets(Rewriter* r, uint64_t site, uint64_t* targets, int max)
+{
+    CaptureConfig* cc = cc_get(r);
+    int count = 0;
+
+    for(int i = 0; (i < cc->ct_count) && (count < max); i++) {
+        if ((cc->ct_site[i] != 0) && (cc->ct_site[i] != site)) continue;
+        targets[count++] = cc->ct_target[i];
+    }
+    return count;
+}
+
+// argument of directive <d> for code at <addr>, <def> if not set.
+// For nested ranges, the innermost one wins (for partially overlapping
+// ranges, the one starting last)
+int config_directive(Rewriter* r, uint64_t addr, DBrewDirective d, int def)
+{
+    CaptureConfig* cc = cc_get(r);
+    RangeIndex* ri = &(cc->directives);
+
+    if (ri->count == 0) return def;
+    for(int i = ri_last_below(ri, addr + 1); i >= 0; i--) {
+        DirectiveConfig* dc = (DirectiveConfig*) ri->mrc[i];
+        if ((dc->directive == d) && (addr < dc->start + dc->size))
+            return dc->arg;
+        // no entry further down can cover addr
+        if (ri->maxend[i] <= addr) break;
+    }
+    return def;
+}
+
+// unroll factor for loop with <header> as target of its backward jump
+int config_loop_unroll(Rewriter* r, uint64_t header)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    return config_directive(r, header, DBREW_DIRECTIVE_UNROLL,
+                            cc->loop_unroll);
+}
+
+// add function with given name and size if no function starts at <f>.
+// Otherwise, only set name and size of existing function if not yet known
+FunctionConfig* config_add_function(Rewriter* r, uint64_t f, int size,
+                                    const char* name)
+{
+    CaptureConfig* cc = cc_get(r);
+    MemRangeConfig* fc = ri_find(&(cc->functions), f, true);
+
+    if (!fc)
+        return (FunctionConfig*) mrc_new(MR_Function, name, f, size, cc);
+
+    if ((fc->name == 0) && name)
+        fc->name = strdup(name);
+    if (fc->size == 0) {
+        fc->size = size;
+        cc->functions.sorted = false; // update maxend
+    }
+    return (FunctionConfig*) fc;
+}
+
+// copy memory range configurations of index <src> into config <cc>
+static
+void ri_copy(CaptureConfig* cc, RangeIndex* src)
+{
+    for(int i = 0; i < src->count; i++) {
+        MemRangeConfig* s = src->mrc[i];
+        MemRangeConfig* d = mrc_new(s->type, s->name, s->start, s->size, cc);
+
+        if (s->type == MR_Function) {
+            FunctionConfig* sfc = (FunctionConfig*) s;
+            FunctionConfig* dfc = (FunctionConfig*) d;
+            dfc->inlining = sfc->inlining;
+            dfc->intPars = sfc->intPars;
+            dfc->fpPars = sfc->fpPars;
+        }
+        else if (s->type == MR_Directive) {
+            ((DirectiveConfig*) d)->directive = ((DirectiveConfig*) s)->directive;
+            ((DirectiveConfig*) d)->arg = ((DirectiveConfig*) s)->arg;
+        }
+    }
+}
+
+// copy array <src> of <count> addresses into newly allocated memory
+static
+uint64_t* addr_copy(uint64_t* src, int count)
+{
+    uint64_t* dst;
+
+    if (count == 0) return 0;
+    dst = (uint64_t*) malloc(count * sizeof(uint64_t));
+    memcpy(dst, src, count * sizeof(uint64_t));
+    return dst;
+}
+
+// replace the configuration of <dst> by a copy of the one of <src>,
+// without the parameters of the function to rewrite. Used for rewriters
+// of clones, which have to apply the same configuration
+void config_copy(Rewriter* dst, Rewriter* src)
+{
+    CaptureConfig* s = src->cc;
+    CaptureConfig* cc;
+
+    dbrew_config_reset(dst);
+    if (!s) return;
+    cc = dst->cc;
+
+    for(int i=0; i < CC_MAXCALLDEPTH; i++)
+        cc->force_unknown[i] = s->force_unknown[i];
+    cc->branches_known = s->branches_known;
+    cc->shadow_memory = s->shadow_memory;
+    cc->capture_only = s->capture_only;
+    cc->max_recursion = s->max_recursion;
+    cc->inline_limit = s->inline_limit;
+    cc->loop_reroll = s->loop_reroll;
+    cc->loop_unroll = s->loop_unroll;
+    cc->analysis = s->analysis;
+    for(int i=0; i < DBREW_BUDGET_MAX; i++)
+        cc->budget[i] = s->budget[i];
+    cc->budget_degrade = s->budget_degrade;
+
+    ri_copy(cc, &(s->functions));
+    ri_copy(cc, &(s->data));
+    ri_copy(cc, &(s->directives));
+
+    cc->readonly_constant = s->readonly_constant;
+    cc->ro_start = addr_copy(s->ro_start, s->ro_count);
+    cc->ro_end = addr_copy(s->ro_end, s->ro_count);
+    cc->ro_count = s->ro_count;
+    cc->ro_capacity = s->ro_count;
+    cc->cxx_vtables = s->cxx_vtables;
+
+    cc->ct_site = addr_copy(s->ct_site, s->ct_count);
+    cc->ct_target = addr_copy(s->ct_target, s->ct_count);
+    cc->ct_count = s->ct_count;
+    cc->ct_capacity = s->ct_count;
+}
+
+void config_free(Rewriter* r)
+{
+    cc_free(r->cc);
+    r->cc = 0;
+}
+
 
 //---------------------------------------------------------------------
 // DBrew API functions for configuration
@@ -179,6 +700,28 @@ void dbrew_config_staticpar(Rewriter* r, int staticParPos)
     initMetaState(&(cc->par_state[staticParPos]), CS_STATIC2);
 }
 
+void dbrew_config_staticpar_shallow(Rewriter* r, int staticParPos)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert((staticParPos >= 0) && (staticParPos < CC_MAXPARAM));
+    initMetaState(&(cc->par_state[staticParPos]), CS_STATIC);
+}
+
+/**
+ * Set type of parameter <par>. This determines where the parameter is
+ * passed according to the x86-64 calling convention: integers and
+ * pointers in general purpose registers, floating point values in xmm
+ * registers, and further parameters on the stack. Default is integer.
+ */
+void dbrew_config_partype(Rewriter* r, int par, DBrewParType type)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert((par >= 0) && (par < CC_MAXPARAM));
+    cc->par_type[par] = type;
+}
+
 void dbrew_config_par_setname(Rewriter* c, int par, char* name)
 {
     CaptureConfig* cc = cc_get(c);
@@ -212,6 +755,8 @@ void dbrew_config_returnfp(Rewriter* r)
 void dbrew_config_parcount(Rewriter* r, int parCount)
 {
     CaptureConfig* cc = cc_get(r);
+
+    assert((parCount >= 0) && (parCount <= CC_MAXPARAM));
     cc->parCount = parCount;
 }
 
@@ -221,29 +766,226 @@ void dbrew_config_branches_known(Rewriter* r, bool b)
     cc->branches_known = b;
 }
 
+/**
+ * With <b> true, emulated writes to memory outside of the stack go to a
+ * shadow memory: rewriting has no side effects, and known values written
+ * to known addresses stay known when loaded again. Writes to unknown
+ * addresses are only captured then. By default, writes during emulation
+ * are done on real memory.
+ */
+void dbrew_config_shadow_memory(Rewriter* r, bool b)
+{
+    CaptureConfig* cc = cc_get(r);
+    cc->shadow_memory = b;
+}
+
+void dbrew_config_capture_only(Rewriter* r, bool b)
+{
+    CaptureConfig* cc = cc_get(r);
+    cc->capture_only = b;
+}
+
+/**
+ * Recursive calls get inlined as long as they are done with known
+ * parameters, up to <depth> instances of the same function. Beyond,
+ * or for recursive calls with unknown parameters only, a real call is
+ * generated, to the rewritten function itself if the known parameters
+ * match. If this is not possible, rewriting fails.
+ */
+void dbrew_config_recursion_depth(Rewriter* r, int depth)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert(depth > 0);
+    cc->max_recursion = depth;
+}
+
+void dbrew_config_inline_limit(Rewriter* r, int size)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert(size >= 0);
+    cc->inline_limit = size;
+}
+
+void dbrew_config_loop_reroll(Rewriter* r, int iterations)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert(iterations >= 0);
+    cc->loop_reroll = iterations;
+}
+
+void dbrew_config_loop_unroll(Rewriter* r, uint64_t header, int factor)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert(factor >= 0);
+    if (header == 0)
+        cc->loop_unroll = factor;
+    else
+        dbrew_config_directive(r, header, 1, DBREW_DIRECTIVE_UNROLL, factor);
+}
+
+void dbrew_config_analysis(Rewriter* r, DBrewAnalysis level)
+{
+    CaptureConfig* cc = cc_get(r);
+    cc->analysis = level;
+}
+
+void dbrew_config_budget(Rewriter* r, DBrewBudget b, long limit)
+{
+    CaptureConfig* cc = cc_get(r);
+
+    assert((b > DBREW_BUDGET_NONE) && (b < DBREW_BUDGET_MAX));
+    cc->budget[b] = (limit > 0) ? limit : 0;
+}
+
+void dbrew_config_budget_degrade(Rewriter* r, bool b)
+{
+    CaptureConfig* cc = cc_get(r);
+    cc->budget_degrade = b;
+}
+
 void dbrew_config_function_setname(Rewriter* r, uint64_t f, const char* name)
 {
     CaptureConfig* cc = cc_get(r);
     FunctionConfig* fc = fc_get(cc, f);
+    free(fc->name);
     fc->name = strdup(name);
 }
 
+void dbrew_config_function_inline(Rewriter* r, uint64_t f, DBrewInline mode)
+{
+    CaptureConfig* cc = cc_get(r);
+    FunctionConfig* fc = fc_get(cc, f);
+    fc->inlining = mode;
+}
+
+/**
+ * Calls to <f> not inlined are done as real calls only if all arguments
+ * are known to be passed in registers. This requires the signature of
+ * <f>: <intPars> integer/pointer and <fpPars> floating point parameters,
+ * none of them being a struct or union passed by value.
+ */
+void dbrew_config_function_parcount(Rewriter* r, uint64_t f,
+                                    int intPars, int fpPars)
+{
+    CaptureConfig* cc = cc_get(r);
+    FunctionConfig* fc = fc_get(cc, f);
+    fc->intPars = intPars;
+    fc->fpPars = fpPars;
+}
+
 void dbrew_config_function_setsize(Rewriter* r, uint64_t f, int size)
 {
     CaptureConfig* cc = cc_get(r);
     FunctionConfig* fc = fc_get(cc, f);
     fc->size = size;
+    cc->functions.sorted = false; // update maxend
 }
 
-void dbrew_config_set_memrange(Rewriter* r, char* name, bool isWritable,
-                               uint64_t start, int size)
+/**
+ * Treat memory of read-only mappings in the process (e.g. .rodata, code)
+ * as constant data: loads from known addresses then result in known
+ * values. Mappings are scanned on each call with <b> true. Ranges
+ * registered as writable with dbrew_config_set_memrange are excluded.
+ */
+void dbrew_config_call_target(Rewriter* r, uint64_t site, uint64_t target)
+{
+    CaptureConfig* cc = cc_get(r);
+    int n = cc->ct_count;
+
+    for(int i = 0; i < n; i++)
+        if ((cc->ct_site[i] == site) && (cc->ct_target[i] == target))
+            return;
+
+    if (n == cc->ct_capacity) {
+        cc->ct_capacity = (n == 0) ? 8 : 2 * n;
+        cc->ct_site = (uint64_t*)
+            realloc(cc->ct_site, cc->ct_capacity * sizeof(uint64_t));
+        cc->ct_target = (uint64_t*)
+            realloc(cc->ct_target, cc->ct_capacity * sizeof(uint64_t));
+    }
+    cc->ct_site[n] = site;
+    cc->ct_target[n] = target;
+    cc->ct_count++;
+}
+
+/**
+ * Attach directive <d> with argument <arg> to code in address range
+ * [start;start+size[. Setting the same directive for the same range
+ * again updates its argument.
+ */
+void dbrew_config_directive(Rewriter* r, uint64_t start, int size,
+                            DBrewDirective d, int arg)
+{
+    CaptureConfig* cc = cc_get(r);
+    RangeIndex* ri = &(cc->directives);
+    DirectiveConfig* dc;
+
+    assert((d > DBREW_DIRECTIVE_NONE) && (d < DBREW_DIRECTIVE_MAX));
+    assert(size > 0);
+    for(int i = 0; i < ri->count; i++) {
+        dc = (DirectiveConfig*) ri->mrc[i];
+        if ((dc->start == start) && (dc->size == size) &&
+            (dc->directive == d)) {
+            dc->arg = arg;
+            return;
+        }
+    }
+
+    dc = (DirectiveConfig*) mrc_new(MR_Directive, 0, start, size, cc);
+    dc->directive = d;
+    dc->arg = arg;
+}
+
+void dbrew_config_cxx_vtables(Rewriter* r, bool b)
 {
-    MemRangeConfig* mrc;
     CaptureConfig* cc = cc_get(r);
+    cc->cxx_vtables = b;
+    if (b && (cc->ro_count == 0))
+        ro_scan(cc);
+}
+
+void dbrew_config_readonly_constant(Rewriter* r, bool b)
+{
+    CaptureConfig* cc = cc_get(r);
+    cc->readonly_constant = b;
+    if (b)
+        ro_scan(cc);
+}
 
-    // TODO: check that we do not specify overlapping ranges
+/**
+ * Register a memory range as constant or writable data.
+ * Registering the same range again updates name and permission.
+ * Ranges may be nested: the innermost range registered for an address
+ * is used. Returns false (and ignores the request) if the range
+ * partially overlaps with an already registered range.
+ */
+bool dbrew_config_set_memrange(Rewriter* r, char* name, bool isWritable,
+                               uint64_t start, int size)
+{
+    CaptureConfig* cc = cc_get(r);
+    RangeIndex* ri = &(cc->data);
+    MemRangeType type = isWritable ? MR_MutableData : MR_ConstantData;
+    uint64_t end = start + ((size > 0) ? size : 1);
+
+    for(int i = ri_next_overlap(ri, ri->count, start, end); i >= 0;
+        i = ri_next_overlap(ri, i, start, end)) {
+        MemRangeConfig* mrc = ri->mrc[i];
+
+        if ((mrc->start == start) && (mrc->size == size)) {
+            mrc->type = type;
+            free(mrc->name);
+            mrc->name = (name == 0) ? 0 : strdup(name);
+            return true;
+        }
+        if (!mrc_contains(mrc, start, end) &&
+            ((mrc->start < start) || (mrc_end(mrc) > end)))
+            return false;
+    }
 
-    mrc = mrc_new(isWritable ? MR_MutableData : MR_ConstantData,
-                  name, start, size, cc->range_configs, cc);
-    cc->range_configs = mrc;
+    mrc_new(type, name, start, size, cc);
+    return true;
 }
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "buffers.h"
 #include "common.h"
@@ -129,6 +130,11 @@ void dbrew_printer_showbytes(Rewriter* r, bool v)
     r->printBytes = v;
 }
 
+DBrewBudget dbrew_budget_exceeded(Rewriter* r)
+{
+    return r->budgetExceeded;
+}
+
 uint64_t dbrew_generated_code(Rewriter* r)
 {
     return r->generatedCodeAddr;
@@ -182,19 +188,19 @@ uint64_t dbrew_emulate(Rewriter* r, ...)
     return r->es->reg[RI_A];
 }
 
-uint64_t dbrew_rewrite(Rewriter* r, ...)
+// emulate/capture and generate code for parameter values <par>,
+// returns error if any
+static
+Error* rewritePars(Rewriter* r, uint64_t* par)
 {
-    va_list argptr;
     Error* e;
 
-    va_start(argptr, r);
-    e = vEmulateAndCapture(r, argptr);
-    va_end(argptr);
-
+    e = emulateAndCapture(r, r->cc->parCount, par);
     if (!e) {
         RContext c;
         c.r = r;
         c.e = 0;
+        c.dbb = 0;
 
         if (r->vreq != VR_None)
             runVectorization(&c);
@@ -202,8 +208,51 @@ uint64_t dbrew_rewrite(Rewriter* r, ...)
             runOptsOnCaptured(&c);
         if (!c.e)
             generateBinaryFromCaptured(&c);
+        if (!c.e)
+            checkBudget(&c, DBREW_BUDGET_CODE_BYTES, r->generatedCodeSize);
         e = c.e;
     }
+    return e;
+}
+
+// degraded specialization after exceeded budget: all results unknown,
+// so no unrolling happens, and no budgets
+static
+Error* rewriteParsDegraded(Rewriter* r, uint64_t* par)
+{
+    CaptureConfig* cc = r->cc;
+    bool force_unknown[CC_MAXCALLDEPTH];
+    long budget[DBREW_BUDGET_MAX];
+    DBrewBudget b = r->budgetExceeded;
+    Error* e;
+
+    memcpy(force_unknown, cc->force_unknown, sizeof(force_unknown));
+    memcpy(budget, cc->budget, sizeof(budget));
+    for(int i = 0; i < CC_MAXCALLDEPTH; i++)
+        cc->force_unknown[i] = true;
+    for(int i = 0; i < DBREW_BUDGET_MAX; i++)
+        cc->budget[i] = 0;
+
+    e = rewritePars(r, par);
+
+    memcpy(cc->force_unknown, force_unknown, sizeof(force_unknown));
+    memcpy(cc->budget, budget, sizeof(budget));
+    r->budgetExceeded = b;
+    return e;
+}
+
+// rewrite with fallbacks: degraded on exceeded budget, original on error
+static
+uint64_t rewrite(Rewriter* r, uint64_t* par)
+{
+    Error* e;
+
+    e = rewritePars(r, par);
+    if (e && (r->budgetExceeded != DBREW_BUDGET_NONE) &&
+        r->cc->budget_degrade) {
+        logError(e, (char*) "Rewriting again with all results unknown");
+        e = rewriteParsDegraded(r, par);
+    }
 
     if (e) {
         // on error, return original function
@@ -214,8 +263,45 @@ uint64_t dbrew_rewrite(Rewriter* r, ...)
     return r->generatedCodeAddr;
 }
 
+uint64_t dbrew_rewrite(Rewriter* r, ...)
+{
+    uint64_t par[CC_MAXPARAM];
+    va_list argptr;
+    Error* e;
+
+    va_start(argptr, r);
+    e = vGetParameters(r, argptr, par);
+    va_end(argptr);
+
+    if (e) {
+        logError(e, (char*) "Stopped rewriting; return original");
+        r->generatedCodeAddr = r->func;
+        return r->func;
+    }
+    return rewrite(r, par);
+}
+
+uint64_t dbrew_rewrite_args(Rewriter* r, int count, DBrewArg* args)
+{
+    uint64_t par[CC_MAXPARAM];
+
+    dbrew_config_parcount(r, count);
+    for(int i = 0; i < count; i++) {
+        dbrew_config_partype(r, i, args[i].type);
+        par[i] = 0;
+        switch(args[i].type) {
+        case DBREW_PAR_INT:    par[i] = args[i].v.i; break;
+        case DBREW_PAR_DOUBLE: memcpy(par + i, &(args[i].v.d), 8); break;
+        case DBREW_PAR_FLOAT:  memcpy(par + i, &(args[i].v.f), 4); break;
+        default: assert(0);
+        }
+    }
+    return rewrite(r, par);
+}
+
 uint64_t dbrew_rewrite_func(uint64_t f, ...)
 {
+    uint64_t par[CC_MAXPARAM];
     Rewriter* r;
     va_list argptr;
     Error* e;
@@ -224,19 +310,10 @@ uint64_t dbrew_rewrite_func(uint64_t f, ...)
     dbrew_set_function(r, f);
 
     va_start(argptr, f);
-    e = vEmulateAndCapture(r, argptr);
+    e = vGetParameters(r, argptr, par);
     va_end(argptr);
-
-    if (!e) {
-        RContext c;
-        c.r = r;
-        c.e = 0;
-
-        runOptsOnCaptured(&c);
-        if (!c.e)
-            generateBinaryFromCaptured(&c);
-        e = c.e;
-    }
+    if (!e)
+        e = rewritePars(r, par);
 
     if (e) {
         // on error, return original function
@@ -38,6 +38,7 @@
 #include "common.h"
 #include "printer.h"
 #include "engine.h"
+#include "emulate.h"
 #include "error.h"
 
 // decode context
@@ -88,6 +89,7 @@ Instr* nextInstr(Rewriter* r, uint64_t a, int len)
     i->len = len;
 
     i->ptLen = 0;
+    i->handler = 0;
     i->vtype = VT_None;
     i->form = OF_None;
     i->dst.type = OT_None;
@@ -418,6 +420,8 @@ void initDContext(DContext* cxt, Rewriter* r, DBB* dbb)
     setErrorNone((Error*) &(cxt->error));
 }
 
+static void markDecodeError(DContext* c, bool showDigit, ErrorType et);
+
 static
 void decodeVex2(DContext* c, uint8_t b)
 {
@@ -449,9 +453,12 @@ void decodeVex3(DContext* c, uint8_t b1, uint8_t b2)
     if ((b1 &  64) == 0) c->rex |= REX_MASK_X;
     if ((b1 &  32) == 0) c->rex |= REX_MASK_B;
     if ((b2 & 128) == 0) c->rex |= REX_MASK_W;
-    assert((b1 & 31) == 1); // 0x0F leading opcode
     c->hasRex = true;
     c->opc1 = 0x0F;
+    if ((b1 & 31) != 1) {
+        // only 0x0F leading opcode map supported (not 0x0F38/0x0F3A)
+        markDecodeError(c, false, ET_BadOpcode);
+    }
 }
 
 
@@ -766,7 +773,10 @@ void processOpc(OpcInfo* oi, DContext* c)
         case PS_66: off = 1; break;
         case PS_F3: off = 2; break;
         case PS_F2: off = 3; break;
-        default: assert(0); // should never happen
+        default:
+            // combination of prefixes not supported
+            markDecodeError(c, false, ET_BadPrefix);
+            return;
         }
         e = &(opcEntry[oi->eStart+off]);
         if (e->h1 == 0) {
@@ -885,8 +895,14 @@ static void parseI3(DContext* c)
 static void parseI3_8se(DContext* c)
 {
     parseImm(c, VT_8, &c->o3, false);
-    // sign-extend op3 to required type: 8->64 works for all
-    c->o3.val = (int64_t)(int8_t)c->o3.val;
+    // sign-extend op3 to required type
+    if (c->vt == VT_64)
+        c->o3.val = (int64_t)(int8_t)c->o3.val;
+    else if (c->vt == VT_32)
+        c->o3.val = (uint32_t)(int32_t)(int8_t)c->o3.val;
+    else if (c->vt == VT_16)
+        c->o3.val = (uint16_t)(int16_t)(int8_t)c->o3.val;
+    else assert(0);
     c->o3.type = getImmOpType(c->vt);
 }
 
@@ -1123,8 +1139,11 @@ void decode0F_29(DContext* c)
 static
 void decode0F_2E(DContext* c)
 {
-    assert(c->ps & PS_66);
     // ucomisd xmm1,xmm2/m64 (RM)
+    if (c->ps != PS_66) {
+        markDecodeError(c, false, ET_BadPrefix);
+        return;
+    }
     parseModRM(c, VT_64, RTS_VX_VX, &c->o2, &c->o1, 0);
     c->ii = addBinaryOp(c->r, c, IT_UCOMISD, VT_Implicit, &c->o1, &c->o2);
     attachPassthrough(c->ii, VEX_No, PS_66, OE_RM, SC_None, 0x0F, 0x2E, -1);
@@ -1345,7 +1364,10 @@ static
 void decode0F_D6(DContext* c)
 {
     // movq xmm2/m64,xmm1 (MR)
-    assert(c->ps == PS_66);
+    if (c->ps != PS_66) {
+        markDecodeError(c, false, ET_BadPrefix);
+        return;
+    }
     parseModRM(c, VT_64, RTS_VX_VX, &c->o1, &c->o2, 0);
     c->ii = addBinaryOp(c->r, c, IT_MOVQ, VT_Implicit, &c->o1, &c->o2);
     attachPassthrough(c->ii, VEX_No, c->ps, OE_MR, SC_None, 0x0F, 0xD6, -1);
@@ -1356,8 +1378,14 @@ void decode0F_D7(DContext* c)
 {
     // pmovmskb r,mm 64/128 (RM): minimum of packed bytes
     c->vt = (c->ps & PS_66) ? VT_128 : VT_64;
-    parseModRM(c, c->vt, RTS_VX_G, &c->o2, &c->o1, 0);
-    opOverwriteType(&c->o1, VT_32); // result always 32bit
+    // parse with GP result type (always 32bit), fix vector operand type
+    parseModRM(c, VT_32, RTS_VX_G, &c->o2, &c->o1, 0);
+    if (!opIsReg(&c->o2)) {
+        // only register source allowed
+        markDecodeError(c, false, ET_BadOperands);
+        return;
+    }
+    c->o2.type = (c->vt == VT_128) ? OT_Reg128 : OT_Reg64;
     c->ii = addBinaryOp(c->r, c, IT_PMOVMSKB, VT_32, &c->o1, &c->o2);
     attachPassthrough(c->ii, VEX_No, (PrefixSet)(c->ps & PS_66), OE_RM, SC_dstDyn,
                       0x0F, 0xD7, -1);
@@ -1422,7 +1450,10 @@ static
 void decode_63(DContext* c)
 {
     // movsx r64,r/m32 (RM) mov with sign extension
-    assert(c->rex & REX_MASK_W);
+    if (!(c->rex & REX_MASK_W)) {
+        markDecodeError(c, false, ET_BadOperands);
+        return;
+    }
     parseModRM(c, VT_None, RTS_G_G, &c->o2, &c->o1, 0);
     // src is 32 bit
     opOverwriteType(&c->o2, VT_32);
@@ -1525,7 +1556,10 @@ void decode_8D(DContext* c)
 {
     // lea r16/32/64,m (RM)
     parseModRM(c, c->vt, RTS_G_G, &c->o2, &c->o1, 0);
-    assert(opIsInd(&c->o2)); // TODO: bad code error
+    if (!opIsInd(&c->o2)) {
+        markDecodeError(c, false, ET_BadOperands);
+        return;
+    }
     addBinaryOp(c->r, c, IT_LEA, c->vt, &c->o1, &c->o2);
 }
 
@@ -2507,7 +2541,16 @@ DBB* dbrew_decode(Rewriter* r, uint64_t f)
     initDContext(&cxt, r, dbb);
 
     while(!cxt.exit) {
+        // maximal instruction length is 15 bytes
+        if ((r->decEnd != 0) && (f + cxt.off + 15 > r->decEnd) &&
+            (cxt.off > 0))
+            break;
+
         decodePrefixes(&cxt);
+        if (isErrorSet(&(cxt.error.e))) {
+            logError(&(cxt.error.e), (char*) "Stopped decoding");
+            break;
+        }
 
         // parse opcode by running handlers defined in opcode tables
 
@@ -2543,6 +2586,10 @@ DBB* dbrew_decode(Rewriter* r, uint64_t f)
     dbb->count = r->decInstrCount - old_icount;
     dbb->size = cxt.off;
 
+    // emulation directly dispatches to handlers for decoded instructions
+    for(int j = 0; j < dbb->count; j++)
+        prepareEmulation(dbb->instr + j);
+
     if (r->showDecoding)
         dbrew_print_decoded(dbb, r->printBytes);
 
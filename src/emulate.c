@@ -60,8 +60,35 @@
 void initMetaState(MetaState* ms, CaptureState cs)
 {
     ms->cState = cs;
-    ms->range = 0;
-    ms->parDep = 0;
+    ms->bound = 0;
+}
+
+static
+void initValueState(EmuValue* v, CaptureState cs)
+{
+    initMetaState(&(v->state), cs);
+    v->parDep = 0;
+}
+
+// analysis dependency of register <ri>, 0 if analysis is disabled
+static
+ExprNode* getRegDep(EmuState* es, RegIndex ri)
+{
+    return es->regDep ? es->regDep[ri] : 0;
+}
+
+static
+void setRegDep(EmuState* es, RegIndex ri, ExprNode* e)
+{
+    if (es->regDep)
+        es->regDep[ri] = e;
+}
+
+static
+void initRegState(EmuState* es, RegIndex ri, CaptureState cs)
+{
+    initMetaState(&(es->reg_state[ri]), cs);
+    setRegDep(es, ri, 0);
 }
 
 
@@ -101,6 +128,7 @@ EmuValue emuValue(uint64_t v, ValType t, MetaState s)
     ev.val = v;
     ev.type = t;
     ev.state = s;
+    ev.parDep = 0;
 
     return ev;
 }
@@ -111,14 +139,60 @@ EmuValue staticEmuValue(uint64_t v, ValType t)
     EmuValue ev;
     ev.val = v;
     ev.type = t;
-    initMetaState(&(ev.state), CS_STATIC);
+    initValueState(&ev, CS_STATIC);
 
     return ev;
 }
 
+static
+void releaseStackPage(StackPage* p)
+{
+    if (!p) return;
+    assert(p->refCount > 0);
+    p->refCount--;
+    if (p->refCount == 0)
+        free(p);
+}
+
+// let page <pi> of current state <es> refer to saved page <p>
+static
+void setLivePage(EmuState* es, int pi, StackPage* p)
+{
+    if (p) p->refCount++;
+    releaseStackPage(es->stackPage[pi]);
+    es->stackPage[pi] = p;
+    es->stackDirty[pi] = false;
+}
+
+// index of first stack page accessed in <es>. Pages before are all DEAD
+static
+int firstStackPage(EmuState* es)
+{
+    return (es->stackAccessed - es->stackStart) / STACKPAGE_SIZE;
+}
+
+// page <pi> of saved state <es>, which only stores accessed pages
+static
+StackPage* savedStackPage(EmuState* es, int pi)
+{
+    int first = es->stackSize / STACKPAGE_SIZE - es->stackPageCount;
+
+    return (pi < first) ? 0 : es->stackPage[pi - first];
+}
+
+// mark stack pages covering <count> bytes at offset <off> as modified
+static
+void markStackDirty(EmuState* es, int off, int count)
+{
+    int pi;
+
+    for(pi = off / STACKPAGE_SIZE; pi <= (off + count - 1) / STACKPAGE_SIZE; pi++)
+        es->stackDirty[pi] = true;
+}
+
 void resetEmuState(EmuState* es)
 {
-    int i;
+    int i, off;
     static RegIndex calleeSave[] = {
         RI_BP, RI_B, RI_12, RI_13, RI_14, RI_15, RI_None
     };
@@ -127,56 +201,289 @@ void resetEmuState(EmuState* es)
 
     for(i=0; i < RI_GPMax; i++) {
         es->reg[i] = 0;
-        initMetaState(&(es->reg_state[i]), CS_DEAD);
+        initRegState(es, i, CS_DEAD);
     }
 
     for(i=0; i<FT_Max; i++) {
         es->flag[i] = false;
         initMetaState(&(es->flag_state[i]), CS_DEAD);
     }
+    es->flagsPending = FS_None;
+
+    // vector registers may be parameters
+    memset(es->vreg, 0, sizeof(es->vreg));
+    memset(es->vreg_state, CS_DYNAMIC, sizeof(es->vreg_state));
+
+    // stack below stackAccessed is still all DEAD: only clear the part
+    // accessed since last reset (restored states keep this invariant)
+    off = es->stackAccessed - es->stackStart;
+    memset(es->stack + off, 0, es->stackSize - off);
+    memset(es->stackState + off, CS_DEAD, es->stackSize - off);
+    memset(es->stackSlot + off / STACKSLOT_SIZE, 0,
+           (es->stackSize / STACKSLOT_SIZE - off / STACKSLOT_SIZE) * sizeof(StackSlot));
+    es->stackHash = 0;
+    // all-DEAD stack corresponds to no pages
+    for(i = firstStackPage(es); i < es->stackPageCount; i++)
+        setLivePage(es, i, 0);
 
-    for(i=0; i< es->stackSize; i++)
-        es->stack[i] = 0;
-    for(i=0; i< es->stackSize; i++)
-        initMetaState(&(es->stackState[i]), CS_DEAD);
-
-    // use real addresses for now
-    es->stackStart = (uint64_t) es->stack;
-    es->stackTop = es->stackStart + es->stackSize;
     es->stackAccessed = es->stackTop;
 
+    es->shadowCount = 0;
+
     // calling convention:
     //  rbp, rbx, r12-r15 have to be preserved by callee
     for(i=0; calleeSave[i] != RI_None; i++)
-        initMetaState(&(es->reg_state[calleeSave[i]]), CS_DYNAMIC);
+        initRegState(es, calleeSave[i], CS_DYNAMIC);
     // RIP always known
     initMetaState(&(es->regIP_state), CS_STATIC);
 
     es->depth = 0;
+    es->unrollCount = 0;
 }
 
 EmuState* allocEmuState(int size)
 {
     EmuState* es;
 
+    assert((size % STACKPAGE_SIZE) == 0);
+
     es = (EmuState*) malloc(sizeof(EmuState));
     es->stackSize = size;
-    es->stack = (uint8_t*) malloc(size);
-    es->stackState = (MetaState*) malloc(sizeof(MetaState) * size);
+    // all DEAD, see resetEmuState
+    assert(CS_DEAD == 0);
+    es->stack = (uint8_t*) calloc(size, 1);
+    es->stackState = (uint8_t*) calloc(size, 1);
+    es->stackSlot = (StackSlot*) calloc(size / STACKSLOT_SIZE, sizeof(StackSlot));
+    es->stackPageCount = size / STACKPAGE_SIZE;
+    es->stackPage = (StackPage**) calloc(es->stackPageCount, sizeof(StackPage*));
+    es->stackDirty = (bool*) calloc(es->stackPageCount, sizeof(bool));
+
+    // use real addresses for now
+    es->stackStart = (uint64_t) es->stack;
+    es->stackTop = es->stackStart + es->stackSize;
+    es->stackAccessed = es->stackTop;
+
+    es->shadowMemory = false;
+    es->shadowCount = 0;
+    es->shadowCapacity = 0;
+    es->shadow = 0;
+
+    es->callStack = 0;
+    es->callCapacity = 0;
+
+    // only allocated with analysis enabled, see setEmuAnalysis
+    es->regDep = 0;
 
     return es;
 }
 
+// enable/disable keeping analysis information for registers
+void setEmuAnalysis(EmuState* es, bool enable)
+{
+    if (enable && !es->regDep)
+        es->regDep = (ExprNode**) calloc(RI_GPMax, sizeof(ExprNode*));
+    else if (!enable) {
+        free(es->regDep);
+        es->regDep = 0;
+    }
+}
+
+static
+void freeSavedEmuState(EmuState* es)
+{
+    for(int i = 0; i < es->stackPageCount; i++)
+        releaseStackPage(es->stackPage[i]);
+    free(es->stackPage);
+    free(es->shadow);
+    free(es->callStack);
+    free(es->regDep);
+    free(es);
+}
+
+void freeSavedEmuStates(Rewriter* r)
+{
+    for(int i = 0; i < r->savedStateCount; i++) {
+        // only buckets of saved states are in use
+        r->savedStateBucket[r->savedStateFP[i] & (SAVEDSTATE_HASHSIZE - 1)] = -1;
+        freeSavedEmuState(r->savedState[i]);
+        r->savedState[i] = 0;
+    }
+    r->savedStateCount = 0;
+}
+
 void freeEmuState(Rewriter* r)
 {
+    freeSavedEmuStates(r);
     if (!r->es) return;
 
+    for(int i = 0; i < r->es->stackPageCount; i++)
+        releaseStackPage(r->es->stackPage[i]);
+    free(r->es->stackPage);
+    free(r->es->stackDirty);
     free(r->es->stack);
     free(r->es->stackState);
+    free(r->es->stackSlot);
+    free(r->es->shadow);
+    free(r->es->callStack);
+    free(r->es->regDep);
     free(r->es);
     r->es = 0;
 }
 
+// mix bits of a 64bit value (finalizer of MurmurHash3)
+static
+uint64_t hashMix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+// hash contribution of stack byte at index <i> to EmuState.stackHash.
+// Only static bytes contribute: all other states may compare equal to
+// different states (see esIsEqual)
+static
+uint64_t stackByteHash(EmuState* es, int i)
+{
+    if (!csIsStatic(es->stackState[i])) return 0;
+    return hashMix(((uint64_t)(es->stackSize - i) << 8) | es->stack[i]);
+}
+
+/* Setting some flags can get complicated.
+ * From libx86emu/prim_ops.c (github.com/wfeldt/libx86emu)
+ */
+static
+uint32_t parity_tab[8] =
+{
+    0x96696996, 0x69969669, 0x69969669, 0x96696996,
+    0x69969669, 0x96696996, 0x96696996, 0x69969669,
+};
+
+#define PARITY(x)   (((parity_tab[(x) / 32] >> ((x) % 32)) & 1) == 0)
+#define XOR2(x)     (((x) ^ ((x)>>1)) & 0x1)
+
+// compute flags <fs> into <flag> resulting from operation <op> of type <vt>
+// on operands <d> and <s>
+static
+void computeOpFlags(bool* flag, int fs, InstrType op, ValType vt,
+                    uint64_t d, uint64_t s)
+{
+    uint64_t r, cc;
+    int bits;
+
+    switch(vt) {
+    case VT_8:  bits = 8; break;
+    case VT_32: bits = 32; break;
+    case VT_64: bits = 64; break;
+    default: assert(0);
+    }
+
+    switch(op) {
+    case IT_ADD: r = d + s; break;
+    case IT_SUB: r = d - s; break;
+    case IT_AND: r = d & s; break;
+    case IT_XOR: r = d ^ s; break;
+    case IT_OR:  r = d | s; break;
+    default: assert(0);
+    }
+    // carry chain (borrow chain for sub)
+    cc = (r & (~d | s)) | (~d & s);
+
+    if (fs & FS_Carry)
+        flag[FT_Carry] = (cc >> (bits - 1)) & 1;
+    if (fs & FS_Overflow)
+        flag[FT_Overflow] = XOR2(cc >> (bits - 2));
+    if (fs & FS_Zero) {
+        if (op == IT_SUB)
+            flag[FT_Zero] = (d == s);
+        else if (bits < 64)
+            flag[FT_Zero] = ((r & ((1ul << bits) - 1)) == 0);
+        else
+            flag[FT_Zero] = (r == 0);
+    }
+    if (fs & FS_Sign)
+        flag[FT_Sign] = (r >> (bits - 1)) & 1;
+    if (fs & FS_Parity)
+        flag[FT_Parity] = PARITY(r & 0xff);
+}
+
+// compute values of lazy flags in <flagSet> from last flag-setting operation
+static
+void computeFlags(EmuState* es, int flagSet)
+{
+    int fs = es->flagsPending & flagSet;
+    if (fs == 0) return;
+
+    computeOpFlags(es->flag, fs, es->flagsOp, es->flagsOpType,
+                   es->flagsOpD, es->flagsOpS);
+    es->flagsPending &= ~fs;
+}
+
+// value of flag <ft>, computed on demand
+static
+bool getFlag(EmuState* es, FlagType ft)
+{
+    computeFlags(es, 1 << ft);
+    return es->flag[ft];
+}
+
+// hash contribution of register/flag meta state and value
+static
+uint64_t csHash(uint64_t h, CaptureState cs, uint64_t v)
+{
+    // normalize meta states: CS_STATIC2 is equivalent to CS_STATIC
+    if (cs == CS_STATIC2) cs = CS_STATIC;
+    // values only matter for static and stack-relative states
+    if ((cs != CS_STATIC) && (cs != CS_STACKRELATIVE)) v = 0;
+
+    return hashMix(h ^ hashMix(v + cs));
+}
+
+// fingerprint of static state without GP registers, flags and stack,
+// starting from <h>
+static
+uint64_t esMemFingerprint(EmuState* es, uint64_t h)
+{
+    h ^= (uint64_t) es->depth;
+    int i;
+
+    for(i = 0; i < es->unrollCount; i++)
+        h = hashMix(h ^ es->unrollJump[i] ^ es->unrollPhase[i]);
+
+    for(i = 0; i < RI_XMMMax; i++)
+        for(int j = 0; j < VREG_LANES; j++)
+            h = csHash(h, es->vreg_state[i][j], es->vreg[i][j]);
+    for(i = 0; i < es->shadowCount; i++) {
+        ShadowSlot* s = es->shadow + i;
+        h = hashMix(h ^ s->addr);
+        for(int j = 0; j < SHADOWSLOT_SIZE; j++)
+            h = csHash(h, s->state[j], s->data[j]);
+    }
+
+    return h;
+}
+
+// fingerprint of static state: equal states (see esIsEqual) are
+// guaranteed to have the same fingerprint
+static
+uint64_t esFingerprint(EmuState* es)
+{
+    uint64_t h = esMemFingerprint(es, es->stackHash);
+    int i;
+
+    computeFlags(es, FS_CZSOP);
+
+    for(i = 0; i < RI_GPMax; i++)
+        h = csHash(h, es->reg_state[i].cState, es->reg[i]);
+    for(i = 0; i < FT_Max; i++)
+        h = csHash(h, es->flag_state[i].cState, es->flag[i]);
+
+    return h;
+}
+
 // are the capture states of a memory resource from different EmuStates equal?
 // this is required for compatibility of generated code points, and
 // compatibility is needed to be able to jump between such code points
@@ -210,57 +517,93 @@ bool csIsEqual(EmuState* es1, CaptureState s1, uint64_t v1,
     return true;
 }
 
-// states are equal if metainformation is equal and static data is the same
+// states are equal if metainformation is equal and static data is the same.
+// <es1> is the current state, <es2> a saved one
 static
 bool esIsEqual(EmuState* es1, EmuState* es2)
 {
-    int i;
+    int i, pi;
 
     // same state for registers?
     for(i = 0; i < RI_GPMax; i++) {
         if (!csIsEqual(es1, es1->reg_state[i].cState, es1->reg[i],
                        es2, es2->reg_state[i].cState, es2->reg[i]))
             return false;
+        // known bounds of unknown values allow jump table dispatch
+        if (es1->reg_state[i].bound != es2->reg_state[i].bound)
+            return false;
     }
 
     // same state for flag registers?
+    computeFlags(es1, FS_CZSOP);
+    computeFlags(es2, FS_CZSOP);
     for(i = 0; i < FT_Max; i++) {
         if (!csIsEqual(es1, es1->flag_state[i].cState, es1->flag[i],
                        es2, es2->flag_state[i].cState, es2->flag[i]))
             return false;
     }
 
-    // for equality, must be at same call depth
-    if (es1->depth != es2->depth) return false;
-
-    // Stack
-    // all known data has to be the same
-    if (es1->stackSize < es2->stackSize) {
-        int diff = es2->stackSize - es1->stackSize;
-        // stack of es2 is larger: bottom should not be static
-        for(i = 0; i < diff; i++) {
-            if (msIsStatic(es2->stackState[i]))
-                return false;
-        }
-        // check for equal state at byte granularity
-        for(i = 0; i < es1->stackSize; i++) {
-            if (!csIsEqual(es1, es1->stackState[i].cState, es1->stack[i],
-                           es2, es2->stackState[i+diff].cState, es2->stack[i+diff]))
+    // same state for vector registers?
+    for(i = 0; i < RI_XMMMax; i++) {
+        for(int j = 0; j < VREG_LANES; j++) {
+            if (!csIsEqual(es1, es1->vreg_state[i][j], es1->vreg[i][j],
+                           es2, es2->vreg_state[i][j], es2->vreg[i][j]))
                 return false;
         }
     }
-    else {
-        // es1 larger
-        int diff = es1->stackSize - es2->stackSize;
-        // bottom of es1 should not be static
-        for(i = 0; i < diff; i++) {
-            if (msIsStatic(es1->stackState[i]))
+
+    // for equality, must be at same call depth, with same call stack
+    if (es1->depth != es2->depth) return false;
+    if ((es1->depth > 0) &&
+        (memcmp(es1->callStack, es2->callStack,
+                es1->depth * sizeof(CallFrame)) != 0))
+        return false;
+
+    // must be in same copy of partially unrolled loops
+    if (es1->unrollCount != es2->unrollCount) return false;
+    for(i = 0; i < es1->unrollCount; i++) {
+        if ((es1->unrollJump[i] != es2->unrollJump[i]) ||
+            (es1->unrollPhase[i] != es2->unrollPhase[i]))
+            return false;
+    }
+
+    // shadow memory: same addresses written, with same state
+    if (es1->shadowCount != es2->shadowCount) return false;
+    for(i = 0; i < es1->shadowCount; i++) {
+        ShadowSlot* s1 = es1->shadow + i;
+        ShadowSlot* s2 = es2->shadow + i;
+
+        if (s1->addr != s2->addr) return false;
+        for(int j = 0; j < SHADOWSLOT_SIZE; j++) {
+            if (!csIsEqual(es1, s1->state[j], s1->data[j],
+                           es2, s2->state[j], s2->data[j]))
                 return false;
         }
+    }
+
+    // Stack
+    // all known data has to be the same
+    // pages before the first one accessed in both states are all DEAD
+    assert(es1->stackSize == es2->stackSize);
+    pi = firstStackPage(es1);
+    if (firstStackPage(es2) < pi) pi = firstStackPage(es2);
+    for(; pi < es1->stackPageCount; pi++) {
+        StackPage* p = savedStackPage(es2, pi);
+        int off = pi * STACKPAGE_SIZE;
+
+        // unmodified since saved/restored from same page: equal
+        if (!es1->stackDirty[pi] && (es1->stackPage[pi] == p)) continue;
+
+        // same data and capture states: equal
+        if (p && (memcmp(es1->stack + off, p->data, STACKPAGE_SIZE) == 0) &&
+            (memcmp(es1->stackState + off, p->state, STACKPAGE_SIZE) == 0))
+            continue;
+
         // check for equal state at byte granularity
-        for(i = 0; i < es2->stackSize; i++) {
-            if (!csIsEqual(es1, es1->stackState[i+diff].cState, es1->stack[i+diff],
-                           es2, es2->stackState[i].cState, es2->stack[i]))
+        for(i = 0; i < STACKPAGE_SIZE; i++) {
+            if (!csIsEqual(es1, es1->stackState[off+i], es1->stack[off+i],
+                           es2, p ? p->state[i] : CS_DEAD,
+                           p ? p->data[i] : 0))
                 return false;
         }
     }
@@ -268,10 +611,12 @@ bool esIsEqual(EmuState* es1, EmuState* es2)
     return true;
 }
 
+// restore saved state <src> into current state <dst>.
+// Only copies stack pages which differ
 static
 void copyEmuState(EmuState* dst, EmuState* src)
 {
-    int i;
+    int i, pi;
 
     dst->parent = src->parent;
 
@@ -279,60 +624,187 @@ void copyEmuState(EmuState* dst, EmuState* src)
         dst->reg[i] = src->reg[i];
         dst->reg_state[i] = src->reg_state[i];
     }
+    if (dst->regDep) {
+        if (src->regDep)
+            memcpy(dst->regDep, src->regDep, RI_GPMax * sizeof(ExprNode*));
+        else
+            memset(dst->regDep, 0, RI_GPMax * sizeof(ExprNode*));
+    }
 
     for(i = 0; i < FT_Max; i++) {
         dst->flag[i] = src->flag[i];
         dst->flag_state[i] = src->flag_state[i];
     }
-
+    dst->flagsPending = src->flagsPending;
+    dst->flagsOp = src->flagsOp;
+    dst->flagsOpType = src->flagsOpType;
+    dst->flagsOpD = src->flagsOpD;
+    dst->flagsOpS = src->flagsOpS;
+
+    memcpy(dst->vreg, src->vreg, sizeof(src->vreg));
+    memcpy(dst->vreg_state, src->vreg_state, sizeof(src->vreg_state));
+
+    // pages before the first one accessed in both states are all DEAD
+    assert(dst->stackSize == src->stackSize);
+    pi = firstStackPage(dst);
+    if (firstStackPage(src) < pi) pi = firstStackPage(src);
+    dst->stackStart = src->stackStart;
     dst->stackTop = src->stackTop;
     dst->stackAccessed = src->stackAccessed;
-    if (src->stackSize < dst->stackSize) {
-        // stack to restore is smaller than at destination:
-        // fill start of destination with DEAD entries
-        int diff = dst->stackSize - src->stackSize;
-
-        dst->stackStart = src->stackStart - diff;
-        for(i = 0; i < diff; i++) {
-            initMetaState(&(dst->stackState[i]), CS_DEAD);
-            dst->stack[i] = 0;
-        }
-        for(i = 0; i < src->stackSize; i++) {
-            dst->stack[i+diff] = src->stack[i];
-            dst->stackState[i+diff] = src->stackState[i];
+    for(; pi < dst->stackPageCount; pi++) {
+        StackPage* p = savedStackPage(src, pi);
+        int off = pi * STACKPAGE_SIZE;
+
+        if (!dst->stackDirty[pi] && (dst->stackPage[pi] == p)) continue;
+
+        if (p) {
+            memcpy(dst->stack + off, p->data, STACKPAGE_SIZE);
+            memcpy(dst->stackState + off, p->state, STACKPAGE_SIZE);
+            memcpy(dst->stackSlot + off / STACKSLOT_SIZE, p->slot,
+                   sizeof(p->slot));
         }
-    }
-    else {
-        // stack to restore is larger than at destination:
-        // make sure that start of source was never accessed
-        uint64_t diff = src->stackSize - dst->stackSize;
-        assert(src->stackAccessed - src->stackStart >= diff);
-
-        dst->stackStart = src->stackStart + diff;
-        for(i = 0; i < dst->stackSize; i++) {
-            dst->stack[i] = src->stack[i+diff];
-            dst->stackState[i] = src->stackState[i+diff];
+        else {
+            memset(dst->stack + off, 0, STACKPAGE_SIZE);
+            memset(dst->stackState + off, CS_DEAD, STACKPAGE_SIZE);
+            memset(dst->stackSlot + off / STACKSLOT_SIZE, 0, sizeof(p->slot));
         }
+        setLivePage(dst, pi, p);
     }
-    assert(dst->stackTop == dst->stackStart + dst->stackSize);
+    dst->stackHash = src->stackHash;
 
+    if (dst->shadowCapacity < src->shadowCount) {
+        dst->shadowCapacity = src->shadowCount;
+        dst->shadow = (ShadowSlot*) realloc(dst->shadow,
+                                            dst->shadowCapacity * sizeof(ShadowSlot));
+    }
+    if (src->shadowCount > 0)
+        memcpy(dst->shadow, src->shadow, src->shadowCount * sizeof(ShadowSlot));
+    dst->shadowCount = src->shadowCount;
+
+    if (dst->callCapacity < src->depth) {
+        dst->callCapacity = src->depth;
+        dst->callStack = (CallFrame*) realloc(dst->callStack,
+                                              dst->callCapacity * sizeof(CallFrame));
+    }
+    if (src->depth > 0)
+        memcpy(dst->callStack, src->callStack, src->depth * sizeof(CallFrame));
     dst->depth = src->depth;
-    for(i = 0; i < src->depth; i++)
-        dst->ret_stack[i] = src->ret_stack[i];
+
+    dst->unrollCount = src->unrollCount;
+    for(i = 0; i < src->unrollCount; i++) {
+        dst->unrollJump[i] = src->unrollJump[i];
+        dst->unrollFactor[i] = src->unrollFactor[i];
+        dst->unrollPhase[i] = src->unrollPhase[i];
+    }
+}
+
+// copy stack page <pi> of current state <es> into a new page,
+// returns 0 if it only contains DEAD zero bytes
+static
+StackPage* newStackPage(EmuState* es, int pi)
+{
+    static const StackPage deadPage;
+    int off = pi * STACKPAGE_SIZE;
+    StackSlot* slot = es->stackSlot + off / STACKSLOT_SIZE;
+    StackPage* p;
+
+    assert(CS_DEAD == 0);
+    if ((memcmp(es->stack + off, deadPage.data, STACKPAGE_SIZE) == 0) &&
+        (memcmp(es->stackState + off, deadPage.state, STACKPAGE_SIZE) == 0) &&
+        (memcmp(slot, deadPage.slot, sizeof(deadPage.slot)) == 0))
+        return 0;
+
+    p = (StackPage*) malloc(sizeof(StackPage));
+    p->refCount = 0;
+    memcpy(p->data, es->stack + off, STACKPAGE_SIZE);
+    memcpy(p->state, es->stackState + off, STACKPAGE_SIZE);
+    memcpy(p->slot, slot, sizeof(p->slot));
+
+    return p;
 }
 
+// create saved state from current state <src>: stack pages not modified
+// since last save/restore are shared with the saved state they come from
 static
 EmuState* cloneEmuState(EmuState* src)
 {
     EmuState* dst;
+    int i, pi, first;
 
-    // allocate only stack space that was accessed in source
-    dst = allocEmuState(src->stackTop - src->stackAccessed);
-    copyEmuState(dst, src);
+    dst = (EmuState*) malloc(sizeof(EmuState));
 
     // remember that we cloned dst from src
     dst->parent = src;
 
+    for(i=0; i < RI_GPMax; i++) {
+        dst->reg[i] = src->reg[i];
+        dst->reg_state[i] = src->reg_state[i];
+    }
+    dst->regDep = 0;
+    if (src->regDep) {
+        dst->regDep = (ExprNode**) malloc(RI_GPMax * sizeof(ExprNode*));
+        memcpy(dst->regDep, src->regDep, RI_GPMax * sizeof(ExprNode*));
+    }
+
+    for(i = 0; i < FT_Max; i++) {
+        dst->flag[i] = src->flag[i];
+        dst->flag_state[i] = src->flag_state[i];
+    }
+    dst->flagsPending = src->flagsPending;
+    dst->flagsOp = src->flagsOp;
+    dst->flagsOpType = src->flagsOpType;
+    dst->flagsOpD = src->flagsOpD;
+    dst->flagsOpS = src->flagsOpS;
+
+    memcpy(dst->vreg, src->vreg, sizeof(src->vreg));
+    memcpy(dst->vreg_state, src->vreg_state, sizeof(src->vreg_state));
+
+    dst->stackSize = src->stackSize;
+    dst->stack = 0;
+    dst->stackState = 0;
+    dst->stackSlot = 0;
+    dst->stackStart = src->stackStart;
+    dst->stackTop = src->stackTop;
+    dst->stackAccessed = src->stackAccessed;
+    dst->stackHash = src->stackHash;
+    dst->stackDirty = 0;
+    // only store pages accessed
+    first = firstStackPage(src);
+    dst->stackPageCount = src->stackPageCount - first;
+    dst->stackPage = (StackPage**) malloc(dst->stackPageCount * sizeof(StackPage*));
+    for(pi = first; pi < src->stackPageCount; pi++) {
+        StackPage* p;
+        if (src->stackDirty[pi])
+            setLivePage(src, pi, newStackPage(src, pi));
+        p = src->stackPage[pi];
+        if (p) p->refCount++;
+        dst->stackPage[pi - first] = p;
+    }
+
+    dst->shadowMemory = src->shadowMemory;
+    dst->shadowCount = src->shadowCount;
+    dst->shadowCapacity = src->shadowCount;
+    dst->shadow = 0;
+    if (src->shadowCount > 0) {
+        dst->shadow = (ShadowSlot*) malloc(src->shadowCount * sizeof(ShadowSlot));
+        memcpy(dst->shadow, src->shadow, src->shadowCount * sizeof(ShadowSlot));
+    }
+
+    dst->depth = src->depth;
+    dst->callCapacity = src->depth;
+    dst->callStack = 0;
+    if (src->depth > 0) {
+        dst->callStack = (CallFrame*) malloc(src->depth * sizeof(CallFrame));
+        memcpy(dst->callStack, src->callStack, src->depth * sizeof(CallFrame));
+    }
+
+    dst->unrollCount = src->unrollCount;
+    for(i = 0; i < src->unrollCount; i++) {
+        dst->unrollJump[i] = src->unrollJump[i];
+        dst->unrollFactor[i] = src->unrollFactor[i];
+        dst->unrollPhase[i] = src->unrollPhase[i];
+    }
+
     return dst;
 }
 
@@ -347,17 +819,25 @@ int saveEmuState(RContext* c)
     if (r->showEmuSteps)
         printf("Saving current emulator state: ");
     //printStaticEmuState(r->es, -1);
-    for(i = 0; i < r->savedStateCount; i++) {
+
+    // only states with same fingerprint can be equal
+    uint64_t fp = esFingerprint(r->es);
+    int bucket = fp & (SAVEDSTATE_HASHSIZE - 1);
+    for(i = r->savedStateBucket[bucket]; i >= 0; i = r->savedStateNext[i]) {
         //printf("Check ES %d\n", i);
         //printStaticEmuState(r->savedState[i], i);
+        if (r->savedStateFP[i] != fp) continue;
         if (esIsEqual(r->es, r->savedState[i])) {
             if (r->showEmuSteps)
                 printf("already existing, esID %d\n", i);
             return i;
         }
     }
+    i = r->savedStateCount;
     if (r->showEmuSteps)
         printf("new with esID %d\n", i);
+    if (!checkBudget(c, DBREW_BUDGET_STATES, i + 1))
+        return -1;
     if (i >= SAVEDSTATE_MAX) {
         setError(&e, ET_BufferOverflow, EM_Rewriter, r,
                  "Too many different emulation states");
@@ -365,6 +845,9 @@ int saveEmuState(RContext* c)
         return -1;
     }
     r->savedState[i] = cloneEmuState(r->es);
+    r->savedStateFP[i] = fp;
+    r->savedStateNext[i] = r->savedStateBucket[bucket];
+    r->savedStateBucket[bucket] = i;
     r->savedStateCount++;
 
     return i;
@@ -399,7 +882,7 @@ void printEmuState(EmuState* es)
 
     printf("  Call stack (current depth %d): ", es->depth);
     for(i=0; i<es->depth; i++)
-        printf(" %p", (void*) es->ret_stack[i]);
+        printf(" %p", (void*) es->callStack[i].ret);
     printf("%s\n", (es->depth == 0) ? " (empty)":"");
 
     printf("  Registers:\n");
@@ -408,16 +891,17 @@ void printEmuState(EmuState* es)
         printf("    %%%-3s = 0x%016lx %c",
                regNameI(RT_GP64, (RegIndex)i),
                es->reg[i], captureState2Char( ms->cState ));
-        if (ms->range)
-            printf(", range %s", expr_toString(ms->range));
-        if (ms->parDep)
-            printf(", parDep %s", expr_toString(ms->parDep));
+        if (ms->bound)
+            printf(", bound %u", ms->bound);
+        if (getRegDep(es, i))
+            printf(", parDep %s", expr_toString(getRegDep(es, i)));
         printf("\n");
     }
     printf("    %%%-3s = 0x%016lx %c\n", "rip",
            es->regIP, captureState2Char( es->regIP_state.cState ));
 
     printf("  Flags: ");
+    computeFlags(es, FS_CZSOP);
     for(i = 0; i < FT_Max; i++) {
         if (i>0) printf("  ");
         printf("%s %d %c", flagName(i), es->flag[i],
@@ -425,6 +909,20 @@ void printEmuState(EmuState* es)
     }
     printf("\n");
 
+    // only vector registers with static values
+    for(i = 0; i < RI_XMMMax; i++) {
+        int j;
+        for(j = 0; j < VREG_LANES; j++)
+            if (csIsStatic(es->vreg_state[i][j])) break;
+        if (j == VREG_LANES) continue;
+
+        printf("    %%%-5s =", regNameI(RT_XMM, (RegIndex)i));
+        for(j = 0; j < VREG_LANES; j++)
+            printf(" 0x%08x %c", es->vreg[i][j],
+                   captureState2Char(es->vreg_state[i][j]));
+        printf("\n");
+    }
+
     spOff = es->reg[RI_SP] - es->stackStart;
     spMax = spOff /8*8 + 40;
     spMin = spOff /8*8 - 32;
@@ -440,13 +938,24 @@ void printEmuState(EmuState* es)
             printf("   %016lx ", (uint64_t) (es->stackStart + o));
             for(oo = o; oo < o+8 && oo <= spMax; oo++) {
                 printf(" %s%02x %c", (oo == spOff) ? "*" : " ", es->stack[oo],
-                       captureState2Char(es->stackState[oo].cState));
+                       captureState2Char(es->stackState[oo]));
             }
             printf("\n");
         }
         printf("   %016lx  %s\n",
                (uint64_t) (es->stackStart + o), (o == spOff) ? "*" : " ");
     }
+
+    if (es->shadowCount > 0) {
+        printf("  Shadow memory:\n");
+        for(i = 0; i < es->shadowCount; i++) {
+            ShadowSlot* s = es->shadow + i;
+            printf("   %016lx ", s->addr);
+            for(o = 0; o < SHADOWSLOT_SIZE; o++)
+                printf("  %02x %c", s->data[o], captureState2Char(s->state[o]));
+            printf("\n");
+        }
+    }
 }
 
 // print only state information important to distinguish for capturing
@@ -478,12 +987,31 @@ void printStaticEmuState(EmuState* es, int esID)
         }
         c++;
     }
+    for(i = 0; i < RI_XMMMax; i++) {
+        int j;
+        for(j = 0; j < VREG_LANES; j++)
+            if (csIsStatic(es->vreg_state[i][j])) break;
+        if (j == VREG_LANES) continue;
+
+        if (c>0) printf(", ");
+        printf("%%%s (", regNameI(RT_XMM, (RegIndex)i));
+        for(j = 0; j < VREG_LANES; j++) {
+            if (j>0) printf(" ");
+            if (csIsStatic(es->vreg_state[i][j]))
+                printf("0x%x", es->vreg[i][j]);
+            else
+                printf("-");
+        }
+        printf(")");
+        c++;
+    }
     if (c>0)
         printf("\n");
     else
         printf("(none)\n");
 
     printf("  Flags: ");
+    computeFlags(es, FS_CZSOP);
     c = 0;
     for(i = 0; i < FT_Max; i++) {
         if (!msIsStatic(es->flag_state[i])) continue;
@@ -500,7 +1028,7 @@ void printStaticEmuState(EmuState* es, int esID)
     cc = 0;
     c = 0;
     for(i = 0; i < es->stackSize; i++) {
-        if (!msIsStatic(es->stackState[i])) {
+        if (!csIsStatic(es->stackState[i])) {
             c = 0;
             continue;
         }
@@ -577,9 +1105,14 @@ void resetCapturing(Rewriter* r)
     r->capBBCount = 0;
     r->capInstrCount = 0;
     r->currentCapBB = 0;
+    r->genOrderCount = 0;
 
     r->capStackTop = -1;
-    r->savedStateCount = 0;
+    freeSavedEmuStates(r);
+
+    for(int i = 0; i < LOOPTRACK_MAX; i++)
+        r->loopTrack[i].addr = 0;
+    r->loopTrackNext = 0;
 }
 
 // return 0 if not found
@@ -595,17 +1128,13 @@ CBB *findCaptureBB(Rewriter* r, uint64_t f, int esID)
     return 0;
 }
 
-// allocate a BB structure to collect instructions for capturing
-CBB* getCaptureBB(RContext* c, uint64_t f, int esID)
+// allocate a new BB structure to collect instructions for capturing
+static
+CBB* newCaptureBB(RContext* c, uint64_t f, int esID)
 {
     CBB* bb;
     Rewriter* r = c->r;
 
-    // already captured?
-    bb = findCaptureBB(r, f, esID);
-    if (bb) return bb;
-
-    // start capturing of new BB beginning at f
     if (r->capBBCount >= r->capBBCapacity) {
         static Error e;
         setError(&e, ET_BufferOverflow, EM_Rewriter, r,
@@ -638,6 +1167,19 @@ CBB* getCaptureBB(RContext* c, uint64_t f, int esID)
     return bb;
 }
 
+// get BB structure for capturing at f with emulator state esID
+CBB* getCaptureBB(RContext* c, uint64_t f, int esID)
+{
+    CBB* bb;
+
+    // already captured?
+    bb = findCaptureBB(c->r, f, esID);
+    if (bb) return bb;
+
+    // start capturing of new BB beginning at f
+    return newCaptureBB(c, f, esID);
+}
+
 char* cbb_prettyName(CBB* bb)
 {
     static char buf[100];
@@ -731,6 +1273,7 @@ CBB* createCBBfromDBB(Rewriter* r, DBB* src)
     RContext cxt;
     cxt.r = r;
     cxt.e = 0;
+    cxt.dbb = 0;
 
     // a CBB starting from an undefined emulator state (esID -1)
     CBB* cbb = getCaptureBB(&cxt, (uint64_t) src->addr, -1);
@@ -748,20 +1291,6 @@ CBB* createCBBfromDBB(Rewriter* r, DBB* src)
 
 // flag setting helpers
 
-/* Setting some flags can get complicated.
- * From libx86emu/prim_ops.c (github.com/wfeldt/libx86emu)
- */
-static
-uint32_t parity_tab[8] =
-{
-    0x96696996, 0x69969669, 0x69969669, 0x96696996,
-    0x69969669, 0x96696996, 0x96696996, 0x69969669,
-};
-
-#define PARITY(x)   (((parity_tab[(x) / 32] >> ((x) % 32)) & 1) == 0)
-#define XOR2(x)     (((x) ^ ((x)>>1)) & 0x1)
-
-
 static
 void setFlagsState(EmuState* es, int flagSet, CaptureState cs)
 {
@@ -778,43 +1307,22 @@ void setFlagsState(EmuState* es, int flagSet, CaptureState cs)
 }
 
 
-// set flags for operation "v1 - v2"
+// set flags for operation "v1 - v2": values are computed lazily
 static
 CaptureState setFlagsSub(EmuState* es, EmuValue* v1, EmuValue* v2)
 {
     CaptureState st;
-    uint64_t r, bc, d, s;
 
     st = combineState4Flags(v1->state.cState, v2->state.cState);
     setFlagsState(es, FS_CZSOP, st);
 
     assert(v1->type == v2->type);
 
-    d = v1->val;
-    s = v2->val;
-    r = d - s;
-    bc = (r & (~d | s)) | (~d & s);
-
-    es->flag[FT_Zero]   = (d == s);
-    es->flag[FT_Parity] = PARITY(r & 0xff);
-    switch(v1->type) {
-    case VT_8:
-        es->flag[FT_Sign]     = (r >> 7) & 1;
-        es->flag[FT_Carry]    = (bc >>7) & 1;
-        es->flag[FT_Overflow] = XOR2(bc >> 6);
-        break;
-    case VT_32:
-        es->flag[FT_Sign]     = (r >> 31) & 1;
-        es->flag[FT_Carry]    = (bc >>31) & 1;
-        es->flag[FT_Overflow] = XOR2(bc >> 30);
-        break;
-    case VT_64:
-        es->flag[FT_Sign]     = (r >> 63) & 1;
-        es->flag[FT_Carry]    = (bc >>63) & 1;
-        es->flag[FT_Overflow] = XOR2(bc >> 62);
-        break;
-    default: assert(0);
-    }
+    es->flagsPending = FS_CZSOP;
+    es->flagsOp = IT_SUB;
+    es->flagsOpType = v1->type;
+    es->flagsOpD = v1->val;
+    es->flagsOpS = v2->val;
 
     return st;
 }
@@ -825,41 +1333,18 @@ static
 void setFlagsAdd(EmuState* es, EmuValue* v1, EmuValue* v2)
 {
     CaptureState st;
-    uint64_t r, cc, d, s;
 
     st = combineState4Flags(v1->state.cState, v2->state.cState);
     setFlagsState(es, FS_CZSOP, st);
 
     assert(v1->type == v2->type);
 
-    d = v1->val;
-    s = v2->val;
-    r = d + s;
-    cc = (r & (~d | s)) | (~d & s);
-
-    es->flag[FT_Parity] = PARITY(r & 0xff);
-    switch(v1->type) {
-    case VT_8:
-        es->flag[FT_Carry]    = (cc >> 7) & 1;
-        es->flag[FT_Zero]     = ((r & ((1<<8)-1)) == 0);
-        es->flag[FT_Sign]     = (r >> 7) & 1;
-        es->flag[FT_Overflow] = XOR2(cc >> 6);
-        break;
-    case VT_32:
-        es->flag[FT_Carry]    = (cc >> 31) & 1;
-        es->flag[FT_Zero]     = ((r & ((1l<<32)-1)) == 0);
-        es->flag[FT_Sign]     = (r >> 31) & 1;
-        es->flag[FT_Overflow] = XOR2(cc >> 30);
-        break;
-    case VT_64:
-        es->flag[FT_Carry]    = (cc >> 63) & 1;
-        es->flag[FT_Zero]     = (r  == 0);
-        es->flag[FT_Sign]     = (r >> 63) & 1;
-        es->flag[FT_Overflow] = XOR2(cc >> 62);
-        break;
-    default: assert(0);
-    }
-}
+    es->flagsPending = FS_CZSOP;
+    es->flagsOp = IT_ADD;
+    es->flagsOpType = v1->type;
+    es->flagsOpD = v1->val;
+    es->flagsOpS = v2->val;
+}
 
 // for bitwise operations: And, Xor, Or
 static
@@ -868,7 +1353,6 @@ CaptureState setFlagsBit(EmuState* es, InstrType it,
 {
 
     CaptureState s;
-    uint64_t res;
 
     assert(v1->type == v2->type);
 
@@ -886,29 +1370,11 @@ CaptureState setFlagsBit(EmuState* es, InstrType it,
 
     setFlagsState(es, FS_ZSP, s);
 
-    switch(it) {
-    case IT_AND: res = v1->val & v2->val; break;
-    case IT_XOR: res = v1->val ^ v2->val; break;
-    case IT_OR:  res = v1->val | v2->val; break;
-    default: assert(0);
-    }
-
-    es->flag[FT_Parity] = PARITY(res & 0xff);
-    switch(v1->type) {
-    case VT_8:
-        es->flag[FT_Zero] = ((res & ((1<<8)-1)) == 0);
-        es->flag[FT_Sign] = ((res & (1l<<7)) != 0);
-        break;
-    case VT_32:
-        es->flag[FT_Zero] = ((res & ((1l<<32)-1)) == 0);
-        es->flag[FT_Sign] = ((res & (1l<<31)) != 0);
-        break;
-    case VT_64:
-        es->flag[FT_Zero] = (res == 0);
-        es->flag[FT_Sign] = ((res & (1l<<63)) != 0);
-        break;
-    default: assert(0);
-    }
+    es->flagsPending = FS_ZSP;
+    es->flagsOp = it;
+    es->flagsOpType = v1->type;
+    es->flagsOpD = v1->val;
+    es->flagsOpS = v2->val;
 
     return s;
 }
@@ -928,7 +1394,7 @@ bool getStackOffset(EmuState* es, EmuValue* addr, EmuValue* off)
         off->type = VT_32;
         off->val = addr->val - es->stackStart;
         s = (addr->state.cState == CS_STACKRELATIVE) ? CS_STATIC : CS_DYNAMIC;
-        initMetaState(&(off->state), s);
+        initValueState(off, s);
         return true;
     }
     return false;
@@ -944,7 +1410,7 @@ CaptureState getStackState(EmuState* es, EmuValue* off)
         if (off->val >= (uint64_t) es->stackSize) cs = CS_DEAD;
         if (off->val < es->stackAccessed - es->stackStart) cs = CS_DEAD;
         else
-            return es->stackState[off->val].cState;
+            return es->stackState[off->val];
     }
     return cs;
 }
@@ -979,16 +1445,25 @@ void getStackValue(EmuState* es, EmuValue* v, EmuValue* off)
     if (off->state.cState == CS_STATIC) {
         state = getStackState(es, off);
         for(i=1; i<count; i++)
-            state = combineState(state, es->stackState[off->val + i].cState, 1);
+            state = combineState(state, es->stackState[off->val + i], 1);
     }
     else
         state = CS_DYNAMIC;
 
-    initMetaState(&(v->state), state);
+    initValueState(v, state);
+
+    // analysis information is kept for values covering a whole slot
+    if ((off->state.cState == CS_STATIC) && (count == STACKSLOT_SIZE) &&
+        ((off->val % STACKSLOT_SIZE) == 0)) {
+        StackSlot* slot = es->stackSlot + off->val / STACKSLOT_SIZE;
+        v->state.bound = slot->bound;
+        v->parDep = slot->parDep;
+    }
 }
 
 static
-void setStackState(EmuState* es, EmuValue* off, ValType vt, MetaState ms)
+void setStackState(EmuState* es, EmuValue* off, ValType vt, MetaState ms,
+                   ExprNode* dep)
 {
     int i, count;
 
@@ -1002,8 +1477,22 @@ void setStackState(EmuState* es, EmuValue* off, ValType vt, MetaState ms)
     default: assert(0);
     }
 
-    for(i=0; i<count; i++)
-        es->stackState[off->val + i] = ms;
+    for(i=0; i<count; i++) {
+        es->stackHash ^= stackByteHash(es, off->val + i);
+        es->stackState[off->val + i] = ms.cState;
+        es->stackHash ^= stackByteHash(es, off->val + i);
+    }
+    // analysis information only kept for values covering a whole slot
+    for(i = off->val / STACKSLOT_SIZE;
+        i <= (int) (off->val + count - 1) / STACKSLOT_SIZE; i++) {
+        es->stackSlot[i].bound = 0;
+        es->stackSlot[i].parDep = 0;
+    }
+    if ((count == STACKSLOT_SIZE) && ((off->val % STACKSLOT_SIZE) == 0)) {
+        es->stackSlot[off->val / STACKSLOT_SIZE].bound = ms.bound;
+        es->stackSlot[off->val / STACKSLOT_SIZE].parDep = dep;
+    }
+    markStackDirty(es, off->val, count);
 
     if (es->stackStart + off->val < es->stackAccessed)
         es->stackAccessed = es->stackStart + off->val;
@@ -1016,6 +1505,18 @@ void setStackValue(EmuState* es, EmuValue* v, EmuValue* off)
     uint16_t* a16;
     uint32_t* a32;
     uint64_t* a64;
+    int i, count;
+
+    switch(v->type) {
+    case VT_16: count = 2; break;
+    case VT_32: count = 4; break;
+    case VT_64: count = 8; break;
+    default: assert(0);
+    }
+
+    // remove hash contribution of old values, add for new ones below
+    for(i = 0; i < count; i++)
+        es->stackHash ^= stackByteHash(es, off->val + i);
 
     switch(v->type) {
     case VT_16:
@@ -1036,10 +1537,26 @@ void setStackValue(EmuState* es, EmuValue* v, EmuValue* off)
     default: assert(0);
     }
 
+    for(i = 0; i < count; i++)
+        es->stackHash ^= stackByteHash(es, off->val + i);
+    markStackDirty(es, off->val, count);
+
     if (es->stackStart + off->val < es->stackAccessed)
         es->stackAccessed = es->stackStart + off->val;
 }
 
+// set 64-bit value <v> into stack at offset <off> from stack top,
+// e.g. for parameters passed on the stack
+void setStackArg(EmuState* es, int off, EmuValue* v)
+{
+    EmuValue o;
+
+    assert(v->type == VT_64);
+    o = staticEmuValue(es->stackSize - off, VT_32);
+    setStackValue(es, v, &o);
+    setStackState(es, &o, VT_64, v->state, v->parDep);
+}
+
 static
 void getRegValue(EmuValue* v, EmuState* es, Reg r, ValType t)
 {
@@ -1048,6 +1565,102 @@ void getRegValue(EmuValue* v, EmuState* es, Reg r, ValType t)
     v->type = t;
     v->val = es->reg[r.ri];
     v->state = es->reg_state[r.ri];
+    v->parDep = getRegDep(es, r.ri);
+}
+
+// shadow slot for address <a>, creating it if not existing and <create> set
+static
+ShadowSlot* getShadowSlot(EmuState* es, uint64_t a, bool create)
+{
+    int lo = 0, hi = es->shadowCount;
+    ShadowSlot* s;
+
+    a = a & ~((uint64_t) SHADOWSLOT_SIZE - 1);
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (es->shadow[mid].addr < a) lo = mid + 1;
+        else hi = mid;
+    }
+    if ((lo < es->shadowCount) && (es->shadow[lo].addr == a))
+        return es->shadow + lo;
+    if (!create) return 0;
+
+    if (es->shadowCount == es->shadowCapacity) {
+        es->shadowCapacity = (es->shadowCapacity == 0) ? 16 : 2 * es->shadowCapacity;
+        es->shadow = (ShadowSlot*) realloc(es->shadow,
+                                           es->shadowCapacity * sizeof(ShadowSlot));
+    }
+    memmove(es->shadow + lo + 1, es->shadow + lo,
+            (es->shadowCount - lo) * sizeof(ShadowSlot));
+    es->shadowCount++;
+
+    s = es->shadow + lo;
+    s->addr = a;
+    memset(s->data, 0, SHADOWSLOT_SIZE);
+    memset(s->state, CS_DEAD, SHADOWSLOT_SIZE);
+    return s;
+}
+
+// overlay bytes written to shadow memory on value <v> loaded from static
+// address <a>. Capture state is combined from states of all bytes
+static
+void getShadowValue(EmuState* es, EmuValue* v, uint64_t a, int count)
+{
+    CaptureState cs = v->state.cState;
+    bool shadowed = false;
+
+    for(int i = 0; i < count; i++) {
+        ShadowSlot* s = getShadowSlot(es, a + i, false);
+        int o = (a + i) % SHADOWSLOT_SIZE;
+        CaptureState bcs = v->state.cState;
+
+        if (s && (s->state[o] != CS_DEAD)) {
+            v->val &= ~(0xffUL << (8 * i));
+            v->val |= (uint64_t) s->data[o] << (8 * i);
+            bcs = s->state[o];
+            shadowed = true;
+        }
+        cs = (i == 0) ? bcs : combineState(cs, bcs, 1);
+    }
+    if (shadowed)
+        initValueState(v, cs);
+}
+
+static
+void setShadowValue(EmuState* es, uint64_t a, int count, uint64_t val)
+{
+    for(int i = 0; i < count; i++) {
+        ShadowSlot* s = getShadowSlot(es, a + i, true);
+        int o = (a + i) % SHADOWSLOT_SIZE;
+
+        s->data[o] = (uint8_t) (val >> (8 * i));
+        // state set by setShadowState, default to unknown
+        if (s->state[o] == CS_DEAD) s->state[o] = CS_DYNAMIC;
+    }
+}
+
+static
+void setShadowState(EmuState* es, uint64_t a, int count, CaptureState cs)
+{
+    // DEAD marks bytes not written
+    if (cs == CS_DEAD) cs = CS_DYNAMIC;
+
+    for(int i = 0; i < count; i++) {
+        ShadowSlot* s = getShadowSlot(es, a + i, true);
+        s->state[(a + i) % SHADOWSLOT_SIZE] = cs;
+    }
+}
+
+// a write to an unknown address may change any byte in shadow memory
+static
+void invalidateShadow(EmuState* es)
+{
+    for(int i = 0; i < es->shadowCount; i++) {
+        for(int j = 0; j < SHADOWSLOT_SIZE; j++) {
+            if (es->shadow[i].state[j] != CS_DEAD)
+                es->shadow[i].state[j] = CS_DYNAMIC;
+        }
+    }
 }
 
 static
@@ -1066,7 +1679,7 @@ void getMemValue(RContext* c, EmuValue* v, EmuValue* addr, ValType t,
     }
 
     assert(!shouldBeStack);
-    initMetaState(&(v->state), CS_DYNAMIC);
+    initValueState(v, CS_DYNAMIC);
     v->type = t;
 
     if (!csIsStatic(addr->state.cState))
@@ -1085,6 +1698,14 @@ void getMemValue(RContext* c, EmuValue* v, EmuValue* addr, ValType t,
     case VT_64: v->val = *(uint64_t*) addr->val; break;
     default: assert(0);
     }
+
+    // C++: vtable pointer of object at known address or vtable entry
+    if ((t == VT_64) && (v->state.cState == CS_DYNAMIC) &&
+            config_is_cxx_constant(c->r, addr->val, v->val))
+        v->state.cState = CS_STATIC;
+
+    if (es->shadowCount > 0)
+        getShadowValue(es, v, addr->val, opTypeWidth(getImmOp(t, 0))/8);
 }
 
 // reading memory using segment override (fs/gs)
@@ -1096,7 +1717,7 @@ void getSegMemValue(EmuValue* v, EmuValue* addr, ValType t, OpSegOverride s)
     uint8_t v8;
 
     // memory accessed via fs/gs always is dynamic
-    initMetaState(&(v->state), CS_DYNAMIC);
+    initValueState(v, CS_DYNAMIC);
     v->type = t;
     switch(t) {
     case VT_8:
@@ -1151,6 +1772,14 @@ void setMemValue(EmuValue* v, EmuValue* addr, EmuState* es, ValType t,
 
     assert(!shouldBeStack);
 
+    if (es->shadowMemory) {
+        // values written to unknown addresses never are loaded again,
+        // see setMemState
+        if (csIsStatic(addr->state.cState))
+            setShadowValue(es, addr->val, opTypeWidth(getImmOp(t, 0))/8, v->val);
+        return;
+    }
+
     switch(t) {
     case VT_16:
         a16 = (uint16_t*) addr->val;
@@ -1173,19 +1802,25 @@ void setMemValue(EmuValue* v, EmuValue* addr, EmuState* es, ValType t,
 
 static
 void setMemState(EmuState* es, EmuValue* addr, ValType t, MetaState ms,
-                 int shouldBeStack)
+                 ExprNode* dep, int shouldBeStack)
 {
     EmuValue off;
     bool isOnStack;
 
     isOnStack = getStackOffset(es, addr, &off);
     if (isOnStack) {
-        setStackState(es, &off, t, ms);
+        setStackState(es, &off, t, ms, dep);
         return;
     }
     assert(!shouldBeStack);
 
-    // nothing to do: we do not keep track of state in memory
+    // without shadow memory, we do not keep track of state in memory
+    if (!es->shadowMemory) return;
+
+    if (csIsStatic(addr->state.cState))
+        setShadowState(es, addr->val, opTypeWidth(getImmOp(t, 0))/8, ms.cState);
+    else
+        invalidateShadow(es);
 }
 
 // helper for getOpAddr()
@@ -1220,7 +1855,7 @@ void getOpAddr(EmuValue* v, EmuState* es, Operand* o)
 
     v->type = VT_64;
     v->val = o->val;
-    initMetaState(&(v->state), CS_STATIC);
+    initValueState(v, CS_STATIC);
 
     if (o->reg.rt != RT_None)
         addRegToValue(v, es, o->reg, 1);
@@ -1229,74 +1864,132 @@ void getOpAddr(EmuValue* v, EmuState* es, Operand* o)
         addRegToValue(v, es, o->ireg, o->scale);
 }
 
-// returned value v should be casted to expected type (8/16/32 bit)
+//
+// Accessors for values of operands, selected per operand type when
+// preparing an instruction for emulation (see getOpGetter)
+//
+
+static
+void getImmOpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    (void) c;
+    *v = staticEmuValue(o->val, opValType(o));
+}
+
 static
-void getOpValue(RContext* c, EmuValue* v, Operand* o)
+void getReg8OpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    EmuState* es = c->r->es;
+
+    assert(regValType(o->reg) == VT_8);
+    v->type = VT_8;
+    v->val = (uint8_t) es->reg[o->reg.ri];
+    v->state = es->reg_state[o->reg.ri];
+    v->parDep = getRegDep(es, o->reg.ri);
+}
+
+static
+void getReg16OpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    EmuState* es = c->r->es;
+
+    assert(regValType(o->reg) == VT_16);
+    v->type = VT_16;
+    v->val = (uint16_t) es->reg[o->reg.ri];
+    v->state = es->reg_state[o->reg.ri];
+    v->parDep = getRegDep(es, o->reg.ri);
+}
+
+static
+void getReg32OpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    EmuState* es = c->r->es;
+
+    assert(regValType(o->reg) == VT_32);
+    v->type = VT_32;
+    v->val = (uint32_t) es->reg[o->reg.ri];
+    v->state = es->reg_state[o->reg.ri];
+    v->parDep = getRegDep(es, o->reg.ri);
+}
+
+static
+void getReg64OpValue(RContext* c, EmuValue* v, Operand* o)
 {
     EmuState* es = c->r->es;
+
+    assert(regValType(o->reg) == VT_64);
+    v->type = VT_64;
+    v->val = es->reg[o->reg.ri];
+    v->state = es->reg_state[o->reg.ri];
+    v->parDep = getRegDep(es, o->reg.ri);
+}
+
+static
+void getIndOpValue(RContext* c, EmuValue* v, Operand* o)
+{
     EmuValue addr;
 
-    switch(o->type) {
-    case OT_Imm8:
-    case OT_Imm16:
-    case OT_Imm32:
-    case OT_Imm64:
-        *v = staticEmuValue(o->val, opValType(o));
-        return;
+    getOpAddr(&addr, c->r->es, o);
+    getMemValue(c, v, &addr, opValType(o), 0);
+}
 
-    case OT_Reg8:
-        v->type = VT_8;
-        assert(regValType(o->reg) == VT_8);
-        v->val = (uint8_t) es->reg[o->reg.ri];
-        v->state = es->reg_state[o->reg.ri];
-        return;
+// access memory with segment override (fs:/gs:)
+static
+void getSegIndOpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    EmuValue addr;
+    Operand noSegOp;
 
-    case OT_Reg16:
-        v->type = VT_16;
-        assert(regValType(o->reg) == VT_16);
-        v->val = (uint16_t) es->reg[o->reg.ri];
-        v->state = es->reg_state[o->reg.ri];
-        return;
+    // get offset within the segment
+    copyOperand(&noSegOp, o);
+    noSegOp.seg = OSO_None;
+    getOpAddr(&addr, c->r->es, &noSegOp);
 
-    case OT_Reg32:
-        v->type = VT_32;
-        assert(regValType(o->reg) == VT_32);
-        v->val = (uint32_t) es->reg[o->reg.ri];
-        v->state = es->reg_state[o->reg.ri];
-        return;
+    getSegMemValue(v, &addr, opValType(o), o->seg);
+}
 
-    case OT_Reg64:
-        v->type = VT_64;
-        assert(regValType(o->reg) == VT_64);
-        v->val = (uint64_t) es->reg[o->reg.ri];
-        v->state = es->reg_state[o->reg.ri];
-        return;
+// operand without value accessible by getOpValue (e.g. vector register)
+static
+void getInvalidOpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    (void) c;
+    (void) v;
+    (void) o;
+    assert(0);
+}
 
+static
+OpGetter getOpGetter(Operand* o)
+{
+    switch(o->type) {
+    case OT_Imm8:
+    case OT_Imm16:
+    case OT_Imm32:
+    case OT_Imm64:
+        return getImmOpValue;
+    case OT_Reg8:  return getReg8OpValue;
+    case OT_Reg16: return getReg16OpValue;
+    case OT_Reg32: return getReg32OpValue;
+    case OT_Reg64: return getReg64OpValue;
     case OT_Ind8:
     case OT_Ind32:
     case OT_Ind64:
-        if (o->seg != OSO_None) {
-            // access memory with segment override (fs:/gs:)
-            // get offset within the segment
-            Operand noSegOp;
-            copyOperand(&noSegOp, o);
-            noSegOp.seg = OSO_None;
-            getOpAddr(&addr, es, &noSegOp);
-
-            getSegMemValue(v, &addr, opValType(o), o->seg);
-        }
-        else {
-            getOpAddr(&addr, es, o);
-            getMemValue(c, v, &addr, opValType(o), 0);
-        }
-        return;
-
-    default: assert(0);
+        return (o->seg != OSO_None) ? getSegIndOpValue : getIndOpValue;
+    default: break;
     }
+    return getInvalidOpValue;
+}
+
+// returned value v should be casted to expected type (8/16/32 bit).
+// Handlers use the accessors of the emulated instruction instead
+static
+void getOpValue(RContext* c, EmuValue* v, Operand* o)
+{
+    (*getOpGetter(o))(c, v, o);
 }
 
 static
-void setOpState(MetaState ms, EmuState* es, Operand* o)
+void setOpState(EmuValue* v, EmuState* es, Operand* o)
 {
     EmuValue addr;
 
@@ -1307,13 +2000,14 @@ void setOpState(MetaState ms, EmuState* es, Operand* o)
     case OT_Reg16:
     case OT_Reg32:
     case OT_Reg64:
-        es->reg_state[o->reg.ri] = ms;
+        es->reg_state[o->reg.ri] = v->state;
+        setRegDep(es, o->reg.ri, v->parDep);
         return;
 
     case OT_Ind32:
     case OT_Ind64:
         getOpAddr(&addr, es, o);
-        setMemState(es, &addr, opValType(o), ms, 0);
+        setMemState(es, &addr, opValType(o), v->state, v->parDep, 0);
         return;
 
     default: assert(0);
@@ -1382,6 +2076,64 @@ bool opStateIsTracked(EmuState* es, Operand* o)
     return msIsStatic(off.state);
 }
 
+// is operand a vector register with state tracked (xmm/ymm, lower 128 bit)?
+static
+bool opIsTrackedVReg(Operand* o)
+{
+    if (!opIsReg(o)) return false;
+    return (o->reg.rt == RT_XMM) || (o->reg.rt == RT_YMM);
+}
+
+static
+void setVRegState(EmuState* es, RegIndex ri, CaptureState cs)
+{
+    assert(ri < RI_XMMMax);
+    for(int j = 0; j < VREG_LANES; j++)
+        es->vreg_state[ri][j] = cs;
+}
+
+// does vector register <ri> have a static lane (see EmuState)?
+// If yes and <img> is given, it gets static lanes (others zero)
+static
+bool vregHasStatic(EmuState* es, RegIndex ri, uint32_t* img)
+{
+    bool res = false;
+
+    for(int j = 0; j < VREG_LANES; j++) {
+        bool isStatic = csIsStatic(es->vreg_state[ri][j]);
+        if (img) img[j] = isStatic ? es->vreg[ri][j] : 0;
+        if (isStatic) res = true;
+    }
+    return res;
+}
+
+// set state of memory operand <o> of any size, in 32-bit steps
+static
+void setMemOpState(EmuState* es, Operand* o, CaptureState cs)
+{
+    EmuValue addr, a;
+    MetaState ms;
+    int size = opTypeWidth(o) / 8;
+
+    assert(opIsInd(o));
+    if (o->seg != OSO_None) return; // fs/gs: not tracked
+
+    getOpAddr(&addr, es, o);
+    // stack location not known: not tracked (FIXME: invalidate stack)
+    if (getStackOffset(es, &addr, &a) && !msIsStatic(a.state)) return;
+
+    initMetaState(&ms, cs);
+    if (size < 4) {
+        setMemState(es, &addr, opValType(o), ms, 0, 0);
+        return;
+    }
+    for(int off = 0; off < size; off += 4) {
+        a = addr;
+        a.val += off;
+        setMemState(es, &a, VT_32, ms, 0, 0);
+    }
+}
+
 // apply known state to memory operand (this modifies the operand in-place)
 static
 void applyStaticToInd(Operand* o, EmuState* es)
@@ -1420,6 +2172,108 @@ void applyStaticToInd(Operand* o, EmuState* es)
 
 // capture processing for instruction types
 
+// address of a copy of 16 bytes <data> in the constant pool, 0 on error.
+// Entries are 16-byte aligned, as required for SSE memory operands
+static
+uint64_t getConstAddr(RContext* c, uint32_t* data)
+{
+    static Error e;
+    CodeStorage* cp = c->r->constPool;
+    int off;
+
+    assert(cp != 0);
+    for(off = 0; off < cp->used; off += 16) {
+        if (memcmp(cp->buf + off, data, 16) == 0)
+            return (uint64_t) (cp->buf + off);
+    }
+    if (cp->fullsize - cp->used < 16) {
+        setError(&e, ET_BufferOverflow, EM_Capture, c->r,
+                 "Constant pool full");
+        c->e = &e;
+        return 0;
+    }
+    memcpy(cp->buf + cp->used, data, 16);
+    return (uint64_t) useCodeStorage(cp, 16);
+}
+
+// load static lanes of vector register <ri> from the constant pool in
+// rewritten code. Afterwards, these lanes are dynamic
+static
+void loadStaticVReg(RContext* c, RegIndex ri)
+{
+    EmuState* es = c->r->es;
+    uint32_t img[VREG_LANES];
+    Operand mem;
+    uint64_t a;
+    Instr i;
+
+    if (!vregHasStatic(es, ri, img)) return;
+    a = getConstAddr(c, img);
+    if (a == 0) return;
+
+    // movups xmm,m128
+    mem.type = OT_Ind128;
+    mem.reg.rt = RT_None;
+    mem.scale = 0;
+    mem.val = a;
+    mem.seg = OSO_None;
+    initBinaryInstr(&i, IT_MOVUPS, VT_None,
+                    getRegOp(getReg(RT_XMM, ri)), &mem);
+    i.vtype = VT_Implicit;
+    attachPassthrough(&i, VEX_No, PS_No, OE_RM, SC_None, 0x0F, 0x10, -1);
+    capture(c, &i);
+
+    for(int j = 0; j < VREG_LANES; j++)
+        if (csIsStatic(es->vreg_state[ri][j]))
+            es->vreg_state[ri][j] = CS_DYNAMIC;
+}
+
+// before capturing <orig>: vector registers read need to contain static
+// values. If <dstRead> is false, the destination is overwritten completely
+static
+void loadStaticVRegs(RContext* c, Instr* orig, bool dstRead)
+{
+    if (dstRead && opIsTrackedVReg(&(orig->dst)))
+        loadStaticVReg(c, orig->dst.reg.ri);
+    if (opIsTrackedVReg(&(orig->src)))
+        loadStaticVReg(c, orig->src.reg.ri);
+    if (opIsTrackedVReg(&(orig->src2)))
+        loadStaticVReg(c, orig->src2.reg.ri);
+}
+
+// replace static vector register source operand <o> (register/memory
+// operand of an SSE instruction) by its copy in the constant pool.
+// This keeps the register static, similar to using immediates
+static
+void staticVRegToMem(RContext* c, Operand* o)
+{
+    EmuState* es = c->r->es;
+    uint32_t img[VREG_LANES];
+    uint64_t a;
+    int lanes;
+
+    if (!opIsTrackedVReg(o)) return;
+    lanes = opTypeWidth(o) / 32;
+    if (lanes > VREG_LANES) return;
+    vregHasStatic(es, o->reg.ri, img);
+    for(int j = 0; j < lanes; j++)
+        if (!csIsStatic(es->vreg_state[o->reg.ri][j])) return;
+
+    a = getConstAddr(c, img);
+    if (a == 0) return;
+
+    switch(o->type) {
+    case OT_Reg32:  o->type = OT_Ind32; break;
+    case OT_Reg64:  o->type = OT_Ind64; break;
+    case OT_Reg128: o->type = OT_Ind128; break;
+    default: assert(0);
+    }
+    o->reg.rt = RT_None;
+    o->scale = 0;
+    o->val = a;
+    o->seg = OSO_None;
+}
+
 // both MOV and MOVSX (sign extend 32->64)
 static
 void captureMov(RContext* c, Instr* orig, EmuState* es, EmuValue* res)
@@ -1449,6 +2303,7 @@ static
 void captureCMov(RContext* c, Instr* orig, EmuState* es,
                  EmuValue* res, MetaState cState, bool cond)
 {
+    EmuValue opval;
     Instr i;
 
     // data movement from orig->src to orig->dst, value is res
@@ -1470,6 +2325,14 @@ void captureCMov(RContext* c, Instr* orig, EmuState* es,
 
     if (res->state.cState == CS_DEAD) return;
 
+    // destination keeps its value if condition is false: needs to be set
+    getOpValue(c, &opval, &(orig->dst));
+    if (msIsStatic(opval.state)) {
+        initBinaryInstr(&i, IT_MOV, opval.type,
+                        &(orig->dst), getImmOp(opval.type, opval.val));
+        capture(c, &i);
+    }
+
     if (msIsStatic(res->state)) {
         // we need to be prepared that there may be a move happening
         // need to update source with known value as it may be moved
@@ -1479,7 +2342,7 @@ void captureCMov(RContext* c, Instr* orig, EmuState* es,
         capture(c, &i);
 
         // resulting value becomes unknown, even if source was static
-        initMetaState(&(res->state), CS_DYNAMIC);
+        initValueState(res, CS_DYNAMIC);
     }
     initBinaryInstr(&i, orig->type, orig->vtype, &(orig->dst), &(orig->src));
     applyStaticToInd(&(i.src), es);
@@ -1526,6 +2389,20 @@ void captureIDiv(RContext* c, Instr* orig, CaptureState resCState, EmuState* es)
     capture(c, &i);
 }
 
+// force results of instruction at <addr> to unknown? A directive for the
+// address overrides the configuration of the current call depth.
+// Configuration for call depths deeper than CC_MAXCALLDEPTH is the one of
+// the deepest
+static
+bool forceUnknown(Rewriter* r, EmuState* es, uint64_t addr)
+{
+    int depth = es->depth;
+
+    if (depth >= CC_MAXCALLDEPTH) depth = CC_MAXCALLDEPTH - 1;
+    return config_directive(r, addr, DBREW_DIRECTIVE_DYNAMIC,
+                            r->cc->force_unknown[depth]) != 0;
+}
+
 // dst = dst op src
 static
 void captureBinaryOp(RContext* c, Instr* orig, EmuState* es, EmuValue* res)
@@ -1538,8 +2415,8 @@ void captureBinaryOp(RContext* c, Instr* orig, EmuState* es, EmuValue* res)
 
     if (msIsStatic(res->state)) {
         // force results to become unknown?
-        if (c->r->cc->force_unknown[es->depth]) {
-            initMetaState(&(res->state), CS_DYNAMIC);
+        if (forceUnknown(c->r, es, orig->addr)) {
+            initValueState(res, CS_DYNAMIC);
         }
         else {
             // no need to update data if capture state is maintained
@@ -1606,8 +2483,8 @@ void captureUnaryOp(RContext* c, Instr* orig, EmuState* es, EmuValue* res)
     Instr i;
 
     if (msIsStatic(res->state)) {
-        if (c->r->cc->force_unknown[es->depth]) {
-            initMetaState(&(res->state), CS_DYNAMIC);
+        if (forceUnknown(c->r, es, orig->addr)) {
+            initValueState(res, CS_DYNAMIC);
             initBinaryInstr(&i, IT_MOV, res->type,
                             &(orig->dst), getImmOp(res->type, res->val));
             capture(c, &i);
@@ -1627,10 +2504,10 @@ void captureLea(RContext* c, Instr* orig, EmuState* es, EmuValue* res)
 
     assert(opIsReg(&(orig->dst)));
     if (msIsStatic(res->state)) {
-        if (c->r->cc->force_unknown[es->depth]) {
+        if (forceUnknown(c->r, es, orig->addr)) {
             // force results to become unknown => load value into dest
 
-            initMetaState(&(res->state), CS_DYNAMIC);
+            initValueState(res, CS_DYNAMIC);
             initBinaryInstr(&i, IT_MOV, res->type,
                             &(orig->dst), getImmOp(res->type, res->val));
             capture(c, &i);
@@ -1688,6 +2565,9 @@ void captureRet(RContext* c, Instr* orig, EmuState* es)
     EmuValue v;
     Instr i;
 
+    // floating point return value: load if static
+    loadStaticVReg(c, RI_XMM0);
+
     // when returning an integer: if AX state is static, load constant
     if (!c->r->cc->hasReturnFP) {
         Reg reg = getReg(getGPRegType(VT_64), RI_A);
@@ -1707,13 +2587,20 @@ static
 void processPassThrough(Instr* i, EmuState* es)
 {
     assert(i->ptLen >0);
+
+    // vector register or memory written: unknown value
+    if (opIsTrackedVReg(&(i->dst)))
+        setVRegState(es, i->dst.reg.ri, CS_DYNAMIC);
+    else if (opIsInd(&(i->dst)) && (i->ptEnc == OE_MR))
+        setMemOpState(es, &(i->dst), CS_DYNAMIC);
+
     if (i->ptSChange == SC_None) return;
 
     switch(i->dst.type) {
     case OT_Reg32:
     case OT_Reg64:
         if (opIsGPReg(&(i->dst)))
-            initMetaState(&(es->reg_state[i->dst.reg.ri]), CS_DYNAMIC);
+            initRegState(es, i->dst.reg.ri, CS_DYNAMIC);
         break;
 
         // memory locations not handled yet
@@ -1723,61 +2610,14 @@ void processPassThrough(Instr* i, EmuState* es)
 }
 
 static
-void captureVec(RContext* c, Instr* orig, EmuState* es)
+void capturePassThrough(RContext* c, Instr* orig, EmuState* es)
 {
     Instr i;
-    OperandEncoding oe = OE_None;
-
-    switch(orig->type) {
-    case IT_ADDSS:
-    case IT_ADDSD:
-    case IT_ADDPS:
-    case IT_ADDPD:
-        oe = OE_RM;
-        break;
-    default: assert(0);
-    }
 
-    // we need to apply static information to memory addressing
+    // pass-through: may have influence to emu state
+    processPassThrough(orig, es);
 
-    initSimpleInstr(&i, orig->type);
-    i.vtype  = orig->vtype;
-    i.form   = orig->form;
-
-    switch(oe) {
-    case OE_MR:
-        assert(opIsReg(&(orig->dst)) || opIsInd(&(orig->dst)));
-        assert(opIsReg(&(orig->src)));
-
-        copyOperand( &(i.dst), &(orig->dst));
-        copyOperand( &(i.src), &(orig->src));
-        applyStaticToInd(&(i.dst), es);
-        break;
-
-    case OE_RM:
-        assert(opIsReg(&(orig->src)) || opIsInd(&(orig->src)));
-        assert(opIsReg(&(orig->dst)));
-
-        copyOperand( &(i.dst), &(orig->dst));
-        copyOperand( &(i.src), &(orig->src));
-        applyStaticToInd(&(i.src), es);
-        break;
-
-    default: assert(0);
-    }
-    capture(c, &i);
-}
-
-
-static
-void capturePassThrough(RContext* c, Instr* orig, EmuState* es)
-{
-    Instr i;
-
-    // pass-through: may have influence to emu state
-    processPassThrough(orig, es);
-
-    assert(orig->ptLen >0);
+    assert(orig->ptLen >0);
     initSimpleInstr(&i, orig->type);
     i.vtype  = orig->vtype;
 
@@ -1830,13 +2670,79 @@ void capturePassThrough(RContext* c, Instr* orig, EmuState* es)
     capture(c, &i);
 }
 
-// this ends a captured BB, queuing new paths to be traced
+// capture SSE instruction not folded. Static vector registers read
+// have to be loaded before (see loadStaticVRegs)
+static
+void captureVec(RContext* c, Instr* orig, EmuState* es)
+{
+    Instr i;
+    OperandEncoding oe = OE_None;
+
+    if (orig->ptLen > 0) {
+        capturePassThrough(c, orig, es);
+        return;
+    }
+
+    switch(orig->type) {
+    case IT_ADDSS:
+    case IT_ADDSD:
+    case IT_ADDPS:
+    case IT_ADDPD:
+        oe = OE_RM;
+        break;
+    default: assert(0);
+    }
+
+    // we need to apply static information to memory addressing
+
+    initSimpleInstr(&i, orig->type);
+    i.vtype  = orig->vtype;
+    i.form   = orig->form;
+
+    switch(oe) {
+    case OE_MR:
+        assert(opIsReg(&(orig->dst)) || opIsInd(&(orig->dst)));
+        assert(opIsReg(&(orig->src)));
+
+        copyOperand( &(i.dst), &(orig->dst));
+        copyOperand( &(i.src), &(orig->src));
+        applyStaticToInd(&(i.dst), es);
+        break;
+
+    case OE_RM:
+        assert(opIsReg(&(orig->src)) || opIsInd(&(orig->src)));
+        assert(opIsReg(&(orig->dst)));
+
+        copyOperand( &(i.dst), &(orig->dst));
+        copyOperand( &(i.src), &(orig->src));
+        applyStaticToInd(&(i.src), es);
+        break;
+
+    default: assert(0);
+    }
+    capture(c, &i);
+
+    if (opIsTrackedVReg(&(orig->dst)))
+        setVRegState(es, orig->dst.reg.ri, CS_DYNAMIC);
+}
+
+// unknown value in register <ri> known to be unsigned <= <max> on one
+// path of a conditional jump
+typedef struct _Bound {
+    RegIndex ri;
+    uint64_t max;
+    bool onBranch;
+} Bound;
+
+// this ends a captured BB, queuing new paths to be traced.
+// With bound <b>, the register gets the bound on one path
 static
 void captureJcc(RContext* c, InstrType it,
-                uint64_t branchTarget, uint64_t fallthroughTarget)
+                uint64_t branchTarget, uint64_t fallthroughTarget,
+                Bound* b)
 {
     CBB *cbb, *cbbBR, *cbbFT;
-    int esID;
+    int esID, esIDBounded;
     Rewriter* r = c->r;
 
     // do not end BB and assume jump fixed?
@@ -1850,8 +2756,19 @@ void captureJcc(RContext* c, InstrType it,
     cbb->preferBranch = (branchTarget < fallthroughTarget);
 
     esID = saveEmuState(c);
-    cbbFT = getCaptureBB(c, fallthroughTarget, esID);
-    cbbBR = getCaptureBB(c, branchTarget, esID);
+    if (c->e) return;
+    esIDBounded = esID;
+    if (b) {
+        // path with unknown value in register known to be bounded
+        MetaState* ms = &(r->es->reg_state[b->ri]);
+        ms->bound = (uint32_t) b->max + 1;
+        esIDBounded = saveEmuState(c);
+        if (c->e) return;
+    }
+    cbbFT = getCaptureBB(c, fallthroughTarget,
+                         (b && !b->onBranch) ? esIDBounded : esID);
+    cbbBR = getCaptureBB(c, branchTarget,
+                         (b && b->onBranch) ? esIDBounded : esID);
     if (c->e) return;
 
     cbb->nextFallThrough = cbbFT;
@@ -1873,6 +2790,67 @@ void captureJcc(RContext* c, InstrType it,
     assert(r->currentCapBB == 0);
 }
 
+// inverse of conditional jump type <it>: types come in pairs
+static
+InstrType invertJcc(InstrType it)
+{
+    assert((it >= IT_JO) && (it <= IT_JG));
+    return (InstrType) (IT_JO + ((it - IT_JO) ^ 1));
+}
+
+// this ends a captured BB with the backward jump of copy of loop body in
+// partially unrolled loop <u>. Copies before the last one continue with
+// the next copy placed directly behind, exiting via the inverted jump.
+// The last copy jumps back to the first
+static
+void captureUnrolledJcc(RContext* c, InstrType it,
+                        uint64_t loopTarget, uint64_t exitTarget, int u)
+{
+    CBB *cbb, *cbbLoop, *cbbExit;
+    int esLoop, esExit;
+    Rewriter* r = c->r;
+    EmuState* es = r->es;
+    bool last = (es->unrollPhase[u] == es->unrollFactor[u] - 1);
+
+    cbb = popCaptureBB(r);
+
+    es->unrollPhase[u] = last ? 0 : es->unrollPhase[u] + 1;
+    esLoop = saveEmuState(c);
+    if (c->e) return;
+    // on exit, loop is not unrolled any more
+    es->unrollCount--;
+    for(int j = u; j < es->unrollCount; j++) {
+        es->unrollJump[j] = es->unrollJump[j + 1];
+        es->unrollFactor[j] = es->unrollFactor[j + 1];
+        es->unrollPhase[j] = es->unrollPhase[j + 1];
+    }
+    esExit = saveEmuState(c);
+    if (c->e) return;
+    cbbLoop = getCaptureBB(c, loopTarget, esLoop);
+    cbbExit = getCaptureBB(c, exitTarget, esExit);
+    if (c->e) return;
+
+    if (last) {
+        cbb->endType = it;
+        cbb->nextBranch = cbbLoop;
+        cbb->nextFallThrough = cbbExit;
+        cbb->preferBranch = true;
+    }
+    else {
+        cbb->endType = invertJcc(it);
+        cbb->nextBranch = cbbExit;
+        cbb->nextFallThrough = cbbLoop;
+        cbb->preferBranch = false;
+    }
+
+    // entry pushed last will be processed first
+    pushCaptureBB(c, cbbExit);
+    pushCaptureBB(c, cbbLoop);
+    if (c->e) return;
+
+    assert(r->currentCapBB == 0);
+}
+
 
 //----------------------------------------------------------
 // Emulator for instruction types
@@ -1906,11 +2884,12 @@ void emulateRet(RContext* c, Instr* instr)
     EmuState* es = c->r->es;
 
     // all caller-save / parameter registers become dead, but not return
-    // TODO: includes vector registers xmm1-15
     static RegIndex ri[8] =
     { RI_DI, RI_SI, RI_D, RI_C, RI_8, RI_9, RI_10, RI_11 };
     for(int i=0; i<8; i++)
-        initMetaState(&(es->reg_state[ri[i]]), CS_DEAD);
+        initRegState(es, ri[i], CS_DEAD);
+    for(int i = RI_XMM1; i < RI_XMMMax; i++)
+        setVRegState(es, (RegIndex) i, CS_DEAD);
 
     if (r->addInliningHints) {
         Instr i;
@@ -1927,909 +2906,2791 @@ void emulateRet(RContext* c, Instr* instr)
         getMemValue(c, &v, &addr, VT_64, 1);
         es->reg[RI_SP] += 8;
 
-        if (v.val != es->ret_stack[es->depth]) {
+        if (v.val != es->callStack[es->depth].ret) {
             setEmulatorError(c, instr,
                              ET_BadOperands, "Return address modified");
             return;
         }
         // return to address
-        c->exit = es->ret_stack[es->depth];
+        c->exit = es->callStack[es->depth].ret;
     }
 }
 
-// process an instruction
-// if this changes control flow, c.exit is set accordingly
-void processInstr(RContext* c, Instr* instr)
+//----------------------------------------------------------
+// Emulation of SSE instructions on vector registers.
+// Results are static if all inputs are static. Static values are
+// loaded from a constant pool when used in captured instructions
+
+// FP operations on SSE vector lanes
+typedef enum _VecOp {
+    VO_None = 0,
+    VO_Add, VO_Sub, VO_Mul, VO_Div, VO_Min, VO_Max, VO_Sqrt,
+    VO_And, VO_AndN, VO_Or, VO_Xor
+} VecOp;
+
+// capture state of a vector lane: only static, dynamic or dead
+static
+CaptureState vecLaneState(CaptureState cs)
 {
-    EmuValue vres, v1, v2, addr;
-    CaptureState cs;
-    ValType vt;
+    if (csIsStatic(cs)) return CS_STATIC;
+    if (cs == CS_DEAD) return CS_DEAD;
+    return CS_DYNAMIC;
+}
 
-    Rewriter* r = c->r;
+// get <n> 32-bit lanes of operand <o> (vector register, GP register or
+// memory) into <val>, with capture state per lane in <st>
+static
+void getVecOpValue(RContext* c, Operand* o, int n, uint32_t* val, uint8_t* st)
+{
     EmuState* es = c->r->es;
+    EmuValue v, addr, a;
+    int j;
 
-    if (instr->ptLen > 0) {
-        // memory addressing in captured instructions depends on emu state
-        capturePassThrough(c, instr, es);
+    if (opIsTrackedVReg(o)) {
+        for(j = 0; j < n; j++) {
+            val[j] = es->vreg[o->reg.ri][j];
+            st[j] = es->vreg_state[o->reg.ri][j];
+        }
         return;
     }
 
-    switch(instr->type) {
-
-    case IT_ADD:
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
-
-        vt = opValType(&(instr->dst));
-        // sign-extend src/v2 if needed
-        if (instr->src.type == OT_Imm8) {
-            // sign-extend to 64bit (may be cutoff later)
-            v2.val = (int64_t) (int8_t) v2.val;
-            v2.type = vt;
+    if (opIsGPReg(o)) {
+        getOpValue(c, &v, o);
+        for(j = 0; j < n; j++) {
+            val[j] = (uint32_t) (v.val >> (32 * j));
+            st[j] = vecLaneState(v.state.cState);
         }
+        return;
+    }
 
-        setFlagsAdd(es, &v1, &v2);
-        assert(v1.type == v2.type); // should not happen, internal error
-
-        switch(vt) {
-        case VT_32:
-            vres.val = ((uint32_t) v1.val + (uint32_t) v2.val);
-            break;
-
-        case VT_64:
-            vres.val = v1.val + v2.val;
-            break;
+    for(j = 0; j < n; j++) {
+        val[j] = 0;
+        st[j] = CS_DYNAMIC;
+    }
+    // memory accessed via fs/gs always is dynamic
+    if (!opIsInd(o) || (o->seg != OSO_None)) return;
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
-        vres.type = vt;
-        cs = combineState(v1.state.cState, v2.state.cState, 0);
-        initMetaState(&(vres.state), cs);
+    getOpAddr(&addr, es, o);
+    for(j = 0; j < n; j++) {
+        a = addr;
+        a.val += 4 * j;
+        v.val = 0;
+        getMemValue(c, &v, &a, VT_32, 0);
+        val[j] = (uint32_t) v.val;
+        st[j] = vecLaneState(v.state.cState);
+    }
+}
 
-        // for capture we need state of dst, do before setting dst
-        captureBinaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
+// write static lanes <val> to memory operand <o>, if location is known
+static
+void setVecMemValue(RContext* c, Operand* o, int n, uint32_t* val)
+{
+    EmuState* es = c->r->es;
+    EmuValue v, addr, a;
 
-    case IT_CALL: {
-        // TODO: keep call. For now, we always inline
-        getOpValue(c, &v1, &(instr->dst));
-        if (es->depth >= MAX_CALLDEPTH) {
-            setEmulatorError(c, instr, ET_BufferOverflow,
-                             "Call depth too deep");
-            return;
-        }
-        if (!msIsStatic(v1.state)) {
-            // call target must be known
-            setEmulatorError(c, instr, ET_UnsupportedOperands,
-                             "Call to unknown target not supported");
-            return;
-        }
+    if (o->seg != OSO_None) return;
+    getOpAddr(&addr, es, o);
+    if (!csIsStatic(addr.state.cState) && !opStateIsTracked(es, o)) return;
+
+    for(int j = 0; j < n; j++) {
+        a = addr;
+        a.val += 4 * j;
+        v = staticEmuValue(val[j], VT_32);
+        setMemValue(&v, &a, es, VT_32, 0);
+        setMemState(es, &a, VT_32, v.state, 0, 0);
+    }
+}
 
-        Instr i;
-        Operand o;
+static
+float foldFloat(VecOp op, float a, float b)
+{
+    switch(op) {
+    case VO_Add: return a + b;
+    case VO_Sub: return a - b;
+    case VO_Mul: return a * b;
+    case VO_Div: return a / b;
+    // as SSE: 2nd operand if unordered or both zero
+    case VO_Min: return (a < b) ? a : b;
+    case VO_Max: return (a > b) ? a : b;
+    case VO_Sqrt:
+        __asm__ ("sqrtss %1,%0" : "=x" (a) : "x" (b));
+        return a;
+    default: assert(0);
+    }
+    return 0;
+}
 
-        // push address of instruction after CALL onto stack
-        copyOperand(&o, getImmOp(VT_64, instr->addr + instr->len));
-        initUnaryInstr(&i, IT_PUSH, &o);
-        processInstr(c, &i);
-        if (c->e) return; // error
+static
+double foldDouble(VecOp op, double a, double b)
+{
+    switch(op) {
+    case VO_Add: return a + b;
+    case VO_Sub: return a - b;
+    case VO_Mul: return a * b;
+    case VO_Div: return a / b;
+    case VO_Min: return (a < b) ? a : b;
+    case VO_Max: return (a > b) ? a : b;
+    case VO_Sqrt:
+        __asm__ ("sqrtsd %1,%0" : "=x" (a) : "x" (b));
+        return a;
+    default: assert(0);
+    }
+    return 0;
+}
 
-        es->ret_stack[es->depth++] = o.val;
+// fold <op> on <lanes> lanes: d = d op s, with elements of given size
+static
+void foldVecLanes(VecOp op, int size, int lanes, uint32_t* d, uint32_t* s)
+{
+    int j;
+
+    switch(op) {
+    case VO_And:  for(j = 0; j < lanes; j++) d[j] = d[j] & s[j]; return;
+    case VO_AndN: for(j = 0; j < lanes; j++) d[j] = ~d[j] & s[j]; return;
+    case VO_Or:   for(j = 0; j < lanes; j++) d[j] = d[j] | s[j]; return;
+    case VO_Xor:  for(j = 0; j < lanes; j++) d[j] = d[j] ^ s[j]; return;
+    default: break;
+    }
 
-        if (r->addInliningHints) {
-            initSimpleInstr(&i, IT_HINT_CALL);
-            capture(c, &i);
+    if (size == 4) {
+        float fd, fs;
+        for(j = 0; j < lanes; j++) {
+            memcpy(&fd, d + j, 4);
+            memcpy(&fs, s + j, 4);
+            fd = foldFloat(op, fd, fs);
+            memcpy(d + j, &fd, 4);
         }
-
-        // address to jump to
-        c->exit = v1.val;
-        break;
+        return;
     }
+    assert(size == 8);
+    for(j = 0; j < lanes; j += 2) {
+        double dd, ds;
+        memcpy(&dd, d + j, 8);
+        memcpy(&ds, s + j, 8);
+        dd = foldDouble(op, dd, ds);
+        memcpy(d + j, &dd, 8);
+    }
+}
 
-    case IT_CLTQ:
-        // cltq: sign-extend eax to rax
-        es->reg[RI_A] = (int64_t) (int32_t) es->reg[RI_A];
-        if (!msIsStatic(es->reg_state[RI_A]))
-            capture(c, instr);
-        break;
-
-    case IT_CWTL:
-        // cwtl: sign-extend ax to eax
-        es->reg[RI_A] = (int32_t) (int16_t) es->reg[RI_A];
-        if (!msIsStatic(es->reg_state[RI_A]))
-            capture(c, instr);
-        break;
-
-    case IT_CQTO:
-        switch(instr->vtype) {
-        case VT_64:
-            // sign-extend eax to edx:eax
-            es->reg[RI_D] = (es->reg[RI_A] & (1<<30)) ? ((uint32_t)-1) : 0;
-            break;
-        case VT_128:
-            // sign-extend rax to rdx:rax
-            es->reg[RI_D] = (es->reg[RI_A] & (1ul<<62)) ? ((uint64_t)-1) : 0;
-            break;
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+// data movement of <lanes> 32-bit lanes between vector registers, memory,
+// and GP registers (movd/movq)
+static
+void emulateVecMov(RContext* c, Instr* instr, int lanes)
+{
+    EmuState* es = c->r->es;
+    Operand* dst = &(instr->dst);
+    Operand* src = &(instr->src);
+    uint32_t v[VREG_LANES];
+    uint8_t st[VREG_LANES];
+    bool isStatic = true;
+    int j;
+
+    getVecOpValue(c, src, lanes, v, st);
+    for(j = 0; j < lanes; j++)
+        if (!csIsStatic(st[j])) isStatic = false;
+
+    if (opIsTrackedVReg(dst)) {
+        RegIndex ri = dst->reg.ri;
+        // loads from memory or GP register and movq/movd zero upper lanes
+        bool zeroUpper = !opIsTrackedVReg(src) ||
+                         (instr->type == IT_MOVQ) || (instr->type == IT_MOVD);
+
+        // lanes not written must not become mixed static/dynamic
+        for(j = lanes; j < VREG_LANES; j++)
+            if (!zeroUpper && (es->vreg_state[ri][j] == CS_DYNAMIC))
+                isStatic = false;
+
+        if (!isStatic) {
+            loadStaticVRegs(c, instr, !zeroUpper && (lanes < VREG_LANES));
+            captureVec(c, instr, es);
             return;
         }
-        es->reg_state[RI_D] = es->reg_state[RI_A];
-        if (!msIsStatic(es->reg_state[RI_A]))
-            capture(c, instr);
-        break;
-
-    case IT_CMOVZ: case IT_CMOVNZ:
-    case IT_CMOVC: case IT_CMOVNC:
-    case IT_CMOVO: case IT_CMOVNO:
-    case IT_CMOVS: case IT_CMOVNS:
-    {
-        FlagType ft;
-        bool cond;
-        switch(instr->type) {
-        case IT_CMOVZ:  ft = FT_Zero;     cond =  es->flag[ft]; break;
-        case IT_CMOVNZ: ft = FT_Zero;     cond = !es->flag[ft]; break;
-        case IT_CMOVC:  ft = FT_Carry;    cond =  es->flag[ft]; break;
-        case IT_CMOVNC: ft = FT_Carry;    cond = !es->flag[ft]; break;
-        case IT_CMOVO:  ft = FT_Overflow; cond =  es->flag[ft]; break;
-        case IT_CMOVNO: ft = FT_Overflow; cond = !es->flag[ft]; break;
-        case IT_CMOVS:  ft = FT_Sign;     cond =  es->flag[ft]; break;
-        case IT_CMOVNS: ft = FT_Sign;     cond = !es->flag[ft]; break;
-        default: assert(0);
+        for(j = 0; j < VREG_LANES; j++) {
+            if (j < lanes) {
+                es->vreg[ri][j] = v[j];
+                es->vreg_state[ri][j] = CS_STATIC;
+            }
+            else if (zeroUpper) {
+                es->vreg[ri][j] = 0;
+                es->vreg_state[ri][j] = CS_STATIC;
+            }
         }
-        assert(opValType(&(instr->src)) == opValType(&(instr->dst)));
-        getOpValue(c, &vres, &(instr->src));
-        captureCMov(c, instr, es, &vres, es->flag_state[ft], cond);
-        // FIXME? if cond state unknown, set destination state always to unknown
-        if (cond == true) {
-            setOpValue(&vres, es, &(instr->dst));
-            setOpState(vres.state, es, &(instr->dst));
+        return;
+    }
+
+    if (opIsInd(dst)) {
+        // no need to update memory if capture state is maintained
+        if (isStatic && (dst->seg == OSO_None) && opStateIsTracked(es, dst)) {
+            setVecMemValue(c, dst, lanes, v);
+            return;
         }
-        break;
+        loadStaticVRegs(c, instr, false);
+        captureVec(c, instr, es);
+        // memory gets the static value in rewritten code, too
+        if (isStatic)
+            setVecMemValue(c, dst, lanes, v);
+        return;
     }
 
-    case IT_CMP:
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
+    // movd/movq to GP register
+    assert(opIsGPReg(dst));
+    if (isStatic) {
+        EmuValue vres;
+        uint64_t val = v[0];
 
-        vt = opValType(&(instr->dst));
-        // sign-extend src/v2 if needed
-        if (instr->src.type == OT_Imm8) {
-            // sign-extend to 64bit (may be cutoff later)
-            v2.val = (int64_t) (int8_t) v2.val;
-            v2.type = vt;
-        }
-        cs = setFlagsSub(es, &v1, &v2);
-        captureCmp(c, instr, es, cs);
-        break;
+        if (lanes == 2) val |= (uint64_t) v[1] << 32;
+        vres = staticEmuValue(val, opValType(dst));
+        setOpValue(&vres, es, dst);
+        setOpState(&vres, es, dst);
+        return;
+    }
+    loadStaticVRegs(c, instr, false);
+    captureVec(c, instr, es);
+    initRegState(es, dst->reg.ri, CS_DYNAMIC);
+}
 
-    case IT_DEC:
-        getOpValue(c, &v1, &(instr->dst));
-
-        vres.type = v1.type;
-        initMetaState(&(vres.state), v1.state.cState);
-        switch(instr->dst.type) {
-        case OT_Reg32:
-        case OT_Ind32:
-            vres.val = (uint32_t)(((int32_t) v1.val) - 1);
-            break;
+// arithmetic/logical operation <op> with element size <size> on <lanes>
+// 32-bit lanes of the destination vector register
+static
+void emulateVecOp(RContext* c, Instr* instr, VecOp op, int size, int lanes)
+{
+    EmuState* es = c->r->es;
+    uint32_t d[VREG_LANES], s[VREG_LANES];
+    uint8_t ds[VREG_LANES], ss[VREG_LANES];
+    bool isStatic = true;
+    RegIndex ri;
+    Instr i;
+    int j;
 
-        case OT_Reg64:
-        case OT_Ind64:
-            vres.val = (uint64_t)(((int64_t) v1.val) - 1);
-            break;
+    // legacy SSE: destination always is a vector register
+    assert(opIsTrackedVReg(&(instr->dst)));
+    ri = instr->dst.reg.ri;
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
+    // xor with itself: zero, independent of input
+    if ((op == VO_Xor) && opIsEqual(&(instr->dst), &(instr->src))) {
+        for(j = 0; j < VREG_LANES; j++) {
+            es->vreg[ri][j] = 0;
+            es->vreg_state[ri][j] = CS_STATIC;
         }
-        captureUnaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
+        return;
+    }
 
-    case IT_IMUL:
-        if (instr->form == OF_2) {
-            getOpValue(c, &v1, &(instr->dst));
-            getOpValue(c, &v2, &(instr->src));
-            assert(opIsGPReg(&(instr->dst)));
-        } else if (instr->form == OF_3) {
-            getOpValue(c, &v1, &(instr->src));
-            getOpValue(c, &v2, &(instr->src2));
-            assert(opIsGPReg(&(instr->dst)));
-        } else {
-            assert(false && "IMUL_1 emulation not implemented");
-            break;
+    getVecOpValue(c, &(instr->dst), VREG_LANES, d, ds);
+    getVecOpValue(c, &(instr->src), lanes, s, ss);
+    for(j = 0; j < VREG_LANES; j++) {
+        if (j < lanes) {
+            if (!csIsStatic(ss[j])) isStatic = false;
+            if ((op != VO_Sqrt) && !csIsStatic(ds[j])) isStatic = false;
         }
+        else if (ds[j] == CS_DYNAMIC)
+            isStatic = false;
+    }
 
-        assert(v1.type == v2.type);
-        switch(instr->src.type) {
-        case OT_Reg32:
-        case OT_Ind32:
-            vres.type = VT_32;
-            vres.val = (uint64_t) ((int32_t) v1.val * (int32_t) v2.val);
-            break;
-
-        case OT_Reg64:
-        case OT_Ind64:
-            vres.type = VT_64;
-            vres.val = (uint64_t) ((int64_t) v1.val * (int64_t) v2.val);
-            break;
-
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
+    if (isStatic) {
+        foldVecLanes(op, size, lanes, d, s);
+        for(j = 0; j < lanes; j++) {
+            es->vreg[ri][j] = d[j];
+            es->vreg_state[ri][j] = CS_STATIC;
         }
+        return;
+    }
 
-        // optimization: multiply with static 0 results in static 0
-        if ((msIsStatic(v1.state) && (v1.val == 0)) ||
-            (msIsStatic(v2.state) && (v2.val == 0)))
-            cs = CS_STATIC;
-        else
-            cs = combineState(v1.state.cState, v2.state.cState, 0);
-        initMetaState(&(vres.state), cs);
+    // static source can stay in constant pool
+    copyInstr(&i, instr);
+    staticVRegToMem(c, &(i.src));
+    loadStaticVRegs(c, &i, (op != VO_Sqrt) || (lanes < VREG_LANES));
+    captureVec(c, &i, es);
+}
 
-        // for capture we need state of dst, do before setting dst
-        captureBinaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
-
-    case IT_IDIV1: {
-        uint64_t v, quRes, modRes;
-
-        // FIXME: Set flags!
-        getOpValue(c, &v1, &(instr->dst));
-        // TODO: raise "division by 0" exception
-        assert(v1.val != 0);
-        cs = combineState(es->reg_state[RI_D].cState,
-                          es->reg_state[RI_A].cState, 1);
-        cs = combineState(cs, v1.state.cState, 0);
-
-        switch(instr->dst.type) {
-        case OT_Reg32:
-        case OT_Ind32:
-            v = (es->reg[RI_D] << 32) + (es->reg[RI_A] & ((1ul<<32)-1) );
-            v1.val = (int32_t) v1.val;
-            quRes = v / v1.val;
-            assert(quRes < (1u<<31)); // fits into 32 bit (TODO: raise exc)
-            modRes = v % v1.val;
-            break;
+// (u)comiss/(u)comisd: set ZF, PF, CF from comparing scalar elements
+static
+void emulateVecCmp(RContext* c, Instr* instr, int size)
+{
+    EmuState* es = c->r->es;
+    uint32_t d[2], s[2];
+    uint8_t ds[2], ss[2];
+    int j, lanes = size / 4;
+    bool isStatic = true;
+    bool less, equal, unordered;
+    Instr i;
 
-        case OT_Reg64:
-        case OT_Ind64:
-            // FIXME: should use rdx
-            quRes = es->reg[RI_A] / v1.val;
-            modRes = es->reg[RI_A] % v1.val;
-            break;
+    getVecOpValue(c, &(instr->dst), lanes, d, ds);
+    getVecOpValue(c, &(instr->src), lanes, s, ss);
+    for(j = 0; j < lanes; j++)
+        if (!csIsStatic(ds[j]) || !csIsStatic(ss[j])) isStatic = false;
+
+    if (!isStatic) {
+        copyInstr(&i, instr);
+        staticVRegToMem(c, &(i.src));
+        loadStaticVRegs(c, &i, true);
+        captureVec(c, &i, es);
+        setFlagsState(es, FS_CZSOP, CS_DYNAMIC);
+        return;
+    }
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
+    if (size == 4) {
+        float fd, fs;
+        memcpy(&fd, d, 4);
+        memcpy(&fs, s, 4);
+        unordered = (fd != fd) || (fs != fs);
+        less = fd < fs;
+        equal = fd == fs;
+    }
+    else {
+        double dd, dss;
+        memcpy(&dd, d, 8);
+        memcpy(&dss, s, 8);
+        unordered = (dd != dd) || (dss != dss);
+        less = dd < dss;
+        equal = dd == dss;
+    }
+    es->flag[FT_Zero] = unordered || equal;
+    es->flag[FT_Parity] = unordered;
+    es->flag[FT_Carry] = unordered || less;
+    es->flag[FT_Sign] = false;
+    es->flag[FT_Overflow] = false;
+    es->flagsPending = FS_None;
+    setFlagsState(es, FS_CZSOP, CS_STATIC);
+}
+
+// SSE instructions emulated with vector registers tracked
+static
+bool vecIsTracked(Instr* instr)
+{
+    // only legacy SSE instructions on xmm registers (not AVX/MMX)
+    if ((instr->ptLen > 0) && (instr->ptVexP != VEX_No)) return false;
+    if (opIsVReg(&(instr->dst)) && !opIsTrackedVReg(&(instr->dst)))
+        return false;
+    if (opIsVReg(&(instr->src)) && !opIsTrackedVReg(&(instr->src)))
+        return false;
+
+    switch(instr->type) {
+    case IT_MOVSS: case IT_MOVSD: case IT_MOVD: case IT_MOVQ:
+    case IT_MOVUPS: case IT_MOVUPD: case IT_MOVAPS: case IT_MOVAPD:
+    case IT_MOVDQU: case IT_MOVDQA:
+    case IT_ADDSS: case IT_ADDSD: case IT_ADDPS: case IT_ADDPD:
+    case IT_SUBSS: case IT_SUBSD: case IT_SUBPS: case IT_SUBPD:
+    case IT_MULSS: case IT_MULSD: case IT_MULPS: case IT_MULPD:
+    case IT_DIVSS: case IT_DIVSD: case IT_DIVPS: case IT_DIVPD:
+    case IT_MINSS: case IT_MINSD: case IT_MINPS: case IT_MINPD:
+    case IT_MAXSS: case IT_MAXSD: case IT_MAXPS: case IT_MAXPD:
+    case IT_SQRTSS: case IT_SQRTSD: case IT_SQRTPS: case IT_SQRTPD:
+    case IT_ANDPS: case IT_ANDPD: case IT_ANDNPS: case IT_ANDNPD:
+    case IT_ORPS: case IT_ORPD: case IT_XORPS: case IT_XORPD: case IT_PXOR:
+    case IT_COMISS: case IT_COMISD: case IT_UCOMISS: case IT_UCOMISD:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// emulate SSE instruction with vector registers tracked (see vecIsTracked).
+// Returns false if not handled here
+static
+bool processVec(RContext* c, Instr* instr)
+{
+    Rewriter* r = c->r;
+
+    // static values need a constant pool to be used in captured code
+    if (r->constPool == 0)
+        r->constPool = initConstStorage(CONSTPOOL_SIZE);
+    if (r->constPool == 0) return false;
+
+    switch(instr->type) {
+    case IT_MOVSS: case IT_MOVD:
+        emulateVecMov(c, instr, 1); break;
+    case IT_MOVSD: case IT_MOVQ:
+        emulateVecMov(c, instr, 2); break;
+    case IT_MOVUPS: case IT_MOVUPD: case IT_MOVAPS: case IT_MOVAPD:
+    case IT_MOVDQU: case IT_MOVDQA:
+        emulateVecMov(c, instr, 4); break;
+
+    case IT_ADDSS: emulateVecOp(c, instr, VO_Add, 4, 1); break;
+    case IT_ADDSD: emulateVecOp(c, instr, VO_Add, 8, 2); break;
+    case IT_ADDPS: emulateVecOp(c, instr, VO_Add, 4, 4); break;
+    case IT_ADDPD: emulateVecOp(c, instr, VO_Add, 8, 4); break;
+    case IT_SUBSS: emulateVecOp(c, instr, VO_Sub, 4, 1); break;
+    case IT_SUBSD: emulateVecOp(c, instr, VO_Sub, 8, 2); break;
+    case IT_SUBPS: emulateVecOp(c, instr, VO_Sub, 4, 4); break;
+    case IT_SUBPD: emulateVecOp(c, instr, VO_Sub, 8, 4); break;
+    case IT_MULSS: emulateVecOp(c, instr, VO_Mul, 4, 1); break;
+    case IT_MULSD: emulateVecOp(c, instr, VO_Mul, 8, 2); break;
+    case IT_MULPS: emulateVecOp(c, instr, VO_Mul, 4, 4); break;
+    case IT_MULPD: emulateVecOp(c, instr, VO_Mul, 8, 4); break;
+    case IT_DIVSS: emulateVecOp(c, instr, VO_Div, 4, 1); break;
+    case IT_DIVSD: emulateVecOp(c, instr, VO_Div, 8, 2); break;
+    case IT_DIVPS: emulateVecOp(c, instr, VO_Div, 4, 4); break;
+    case IT_DIVPD: emulateVecOp(c, instr, VO_Div, 8, 4); break;
+    case IT_MINSS: emulateVecOp(c, instr, VO_Min, 4, 1); break;
+    case IT_MINSD: emulateVecOp(c, instr, VO_Min, 8, 2); break;
+    case IT_MINPS: emulateVecOp(c, instr, VO_Min, 4, 4); break;
+    case IT_MINPD: emulateVecOp(c, instr, VO_Min, 8, 4); break;
+    case IT_MAXSS: emulateVecOp(c, instr, VO_Max, 4, 1); break;
+    case IT_MAXSD: emulateVecOp(c, instr, VO_Max, 8, 2); break;
+    case IT_MAXPS: emulateVecOp(c, instr, VO_Max, 4, 4); break;
+    case IT_MAXPD: emulateVecOp(c, instr, VO_Max, 8, 4); break;
+    case IT_SQRTSS: emulateVecOp(c, instr, VO_Sqrt, 4, 1); break;
+    case IT_SQRTSD: emulateVecOp(c, instr, VO_Sqrt, 8, 2); break;
+    case IT_SQRTPS: emulateVecOp(c, instr, VO_Sqrt, 4, 4); break;
+    case IT_SQRTPD: emulateVecOp(c, instr, VO_Sqrt, 8, 4); break;
+
+    case IT_ANDPS: case IT_ANDPD:
+        emulateVecOp(c, instr, VO_And, 4, 4); break;
+    case IT_ANDNPS: case IT_ANDNPD:
+        emulateVecOp(c, instr, VO_AndN, 4, 4); break;
+    case IT_ORPS: case IT_ORPD:
+        emulateVecOp(c, instr, VO_Or, 4, 4); break;
+    case IT_XORPS: case IT_XORPD: case IT_PXOR:
+        emulateVecOp(c, instr, VO_Xor, 4, 4); break;
+
+    case IT_COMISS: case IT_UCOMISS:
+        emulateVecCmp(c, instr, 4); break;
+    case IT_COMISD: case IT_UCOMISD:
+        emulateVecCmp(c, instr, 8); break;
+
+    default: assert(0);
+    }
+    return true;
+}
+
+//----------------------------------------------------------
+// Affine analysis: express dynamic 64bit values as affine
+// expressions of input parameters (stored in parDep)
+
+static
+bool affineAnalysis(Rewriter* r)
+{
+    return r->ePool && r->cc && (r->cc->analysis == DBREW_ANALYSIS_AFFINE);
+}
+
+// expression for a value, 0 if unknown
+static
+ExprNode* valueExpr(ExprPool* p, uint64_t val, MetaState* ms, ExprNode* dep)
+{
+    if (msIsStatic(*ms)) {
+        if ((int64_t) val != (int32_t) val) return 0;
+        return expr_newConst(p, (int) val);
+    }
+    return dep;
+}
+
+static
+ExprNode* scaledExpr(ExprPool* p, uint64_t factor, ExprNode* e)
+{
+    if ((int64_t) factor != (int32_t) factor) return 0;
+    if (factor == 1) return e;
+    return expr_newScaled(p, (int) factor, e);
+}
+
+// set expression for dynamic result of binary operation <it>
+static
+void setAffineDep(RContext* c, InstrType it,
+                  EmuValue* vres, EmuValue* v1, EmuValue* v2)
+{
+    ExprPool* p = c->r->ePool;
+    ExprNode *e1, *e2;
+
+    if (!affineAnalysis(c->r)) return;
+    if ((vres->type != VT_64) || msIsStatic(vres->state)) return;
+
+    switch(it) {
+    case IT_ADD:
+        e1 = valueExpr(p, v1->val, &(v1->state), v1->parDep);
+        e2 = valueExpr(p, v2->val, &(v2->state), v2->parDep);
+        vres->parDep = expr_newSum(p, e1, e2);
+        break;
+
+    case IT_SUB:
+        e1 = valueExpr(p, v1->val, &(v1->state), v1->parDep);
+        e2 = valueExpr(p, v2->val, &(v2->state), v2->parDep);
+        vres->parDep = expr_newSum(p, e1, scaledExpr(p, -1, e2));
+        break;
+
+    case IT_IMUL:
+        if (msIsStatic(v1->state))
+            vres->parDep = scaledExpr(p, v1->val, v2->parDep);
+        else if (msIsStatic(v2->state))
+            vres->parDep = scaledExpr(p, v2->val, v1->parDep);
+        break;
+
+    case IT_SHL:
+        if (msIsStatic(v2->state) && ((v2->val & 63) < 31))
+            vres->parDep = scaledExpr(p, 1ul << (v2->val & 63),
+                                      v1->parDep);
+        break;
+
+    default: break;
+    }
+}
+
+// set expression for dynamic address calculated by getOpAddr
+static
+void setAffineAddrDep(RContext* c, EmuValue* vres, Operand* o)
+{
+    EmuState* es = c->r->es;
+    ExprPool* p = c->r->ePool;
+    ExprNode* e;
+
+    if (!affineAnalysis(c->r)) return;
+    if ((vres->type != VT_64) || msIsStatic(vres->state)) return;
+    if ((o->reg.rt == RT_IP) || ((int64_t) o->val != (int32_t) o->val))
+        return;
+
+    e = expr_newConst(p, (int) o->val);
+    if (o->reg.rt != RT_None)
+        e = expr_newSum(p, valueExpr(p, es->reg[o->reg.ri],
+                                     &(es->reg_state[o->reg.ri]),
+                                     getRegDep(es, o->reg.ri)), e);
+    if (o->scale > 0)
+        e = expr_newSum(p, scaledExpr(p, o->scale,
+                                      valueExpr(p, es->reg[o->ireg.ri],
+                                                &(es->reg_state[o->ireg.ri]),
+                                                getRegDep(es, o->ireg.ri))),
+                        e);
+    vres->parDep = e;
+}
+
+//----------------------------------------------------------
+// Emulation handlers for instruction types (see getEmuHandler)
+
+
+static
+void emulateAdd(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1, v2;
+    CaptureState cs;
+    ValType vt;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
+
+    vt = opValType(&(instr->dst));
+    // sign-extend src/v2 if needed
+    if (instr->src.type == OT_Imm8) {
+        // sign-extend to 64bit (may be cutoff later)
+        v2.val = (int64_t) (int8_t) v2.val;
+        v2.type = vt;
+    }
+
+    setFlagsAdd(es, &v1, &v2);
+    assert(v1.type == v2.type); // should not happen, internal error
+
+    switch(vt) {
+    case VT_32:
+        vres.val = ((uint32_t) v1.val + (uint32_t) v2.val);
+        break;
+
+    case VT_64:
+        vres.val = v1.val + v2.val;
+        break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    vres.type = vt;
+    cs = combineState(v1.state.cState, v2.state.cState, 0);
+    initValueState(&vres, cs);
+    setAffineDep(c, IT_ADD, &vres, &v1, &v2);
+
+    // for capture we need state of dst, do before setting dst
+    captureBinaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
+
+// registers for parameters in calling convention x86-64
+static RegIndex parReg[6] = { RI_DI, RI_SI, RI_D, RI_C, RI_8, RI_9 };
+
+// set known parameter values from registers into call frame <cf>
+static
+void setFramePars(EmuState* es, CallFrame* cf)
+{
+    cf->parStatic = 0;
+    for(int i = 0; i < 6; i++) {
+        cf->par[i] = 0;
+        if (!msIsStatic(es->reg_state[parReg[i]])) continue;
+        cf->par[i] = es->reg[parReg[i]];
+        cf->parStatic |= 1 << i;
+    }
+}
+
+// number of active inlined calls to function <f>
+static
+int callCount(EmuState* es, uint64_t f)
+{
+    int count = 0;
+
+    for(int i = 0; i < es->depth; i++)
+        if (es->callStack[i].func == f) count++;
+    return count;
+}
+
+// does a call to <f> specialize for other known parameters than the
+// innermost active call to <f>? Otherwise, inlining does not progress
+static
+bool parsChanged(EmuState* es, uint64_t f)
+{
+    CallFrame cf;
+    int i;
+
+    for(i = es->depth - 1; i >= 0; i--)
+        if (es->callStack[i].func == f) break;
+    if (i < 0) return true;
+
+    setFramePars(es, &cf);
+    if (cf.parStatic != es->callStack[i].parStatic) return true;
+    return memcmp(cf.par, es->callStack[i].par, sizeof(cf.par)) != 0;
+}
+
+// are all arguments of a call to <f> passed in registers? This is only
+// known with the signature of <f>: the configuration of the function to
+// rewrite, or one given by dbrew_config_function_parcount
+static
+bool regArgsOnly(Rewriter* r, uint64_t f)
+{
+    FunctionConfig* fc;
+    int gp = 0, fp = 0;
+
+    if (f == r->func) {
+        if (r->cc->parCount < 0) return false;
+        for(int i = 0; i < r->cc->parCount; i++) {
+            if (r->cc->par_type[i] == DBREW_PAR_INT) gp++;
+            else fp++;
+        }
+    }
+    else {
+        fc = config_find_function(r, f);
+        if (!fc || (fc->start != f) || (fc->intPars < 0) || (fc->fpPars < 0))
+            return false;
+        gp = fc->intPars;
+        fp = fc->fpPars;
+    }
+    return (gp <= 6) && (fp <= 8);
+}
+
+// can we do a real call to <f>? The stack gets realigned for a real call
+// (see captureRealCall), so no arguments may be passed on the stack.
+// Parameter registers need to be loaded with static values (stack-relative
+// values and static vector registers are not supported), and calls to the
+// function rewritten go to its rewritten code, which requires the same
+// static parameters
+static
+bool canCallReal(Rewriter* r, uint64_t f)
+{
+    EmuState* es = r->es;
+    EmuState* entry = r->savedState[0];
+
+    if (!regArgsOnly(r, f)) return false;
+    for(int i = 0; i < 6; i++)
+        if (es->reg_state[parReg[i]].cState == CS_STACKRELATIVE)
+            return false;
+    for(int i = RI_XMM0; i <= RI_XMM7; i++)
+        if (vregHasStatic(es, (RegIndex) i, 0)) return false;
+
+    if (f != r->func) return true;
+
+    // only known integer parameters in registers are checked
+    int gp = 0;
+    for(int i = 0; i < r->cc->parCount; i++) {
+        bool inReg = (r->cc->par_type[i] == DBREW_PAR_INT) && (gp < 6);
+        RegIndex ri = inReg ? parReg[gp++] : RI_None;
+
+        if (!msIsStatic(r->cc->par_state[i])) continue;
+        if (!inReg) return false;
+        if (!msIsStatic(es->reg_state[ri]) || (es->reg[ri] != entry->reg[ri]))
+            return false;
+    }
+    return true;
+}
+
+// capture a real call to <target> (immediate or register other than
+// rsp/rbp) instead of inlining it.
+// As the real stack pointer differs from the emulated one (e.g. return
+// addresses of inlined calls are not pushed), the red zone is skipped
+// and the stack gets aligned, using rbp to restore
+static
+void captureRealCall(RContext* c, Operand* target)
+{
+    EmuState* es = c->r->es;
+    Operand rsp, rbp, t;
+    Instr i;
+
+    copyOperand(&t, target);
+
+    // parameters with static values need to be loaded
+    for(int j = 0; j < 6; j++) {
+        if (!msIsStatic(es->reg_state[parReg[j]])) continue;
+        initBinaryInstr(&i, IT_MOV, VT_64,
+                        getRegOp(getReg(RT_GP64, parReg[j])),
+                        getImmOp(VT_64, es->reg[parReg[j]]));
+        capture(c, &i);
+    }
+
+    copyOperand(&rsp, getRegOp(getReg(RT_GP64, RI_SP)));
+    copyOperand(&rbp, getRegOp(getReg(RT_GP64, RI_BP)));
+    initBinaryInstr(&i, IT_SUB, VT_64, &rsp, getImmOp(VT_32, 128));
+    capture(c, &i);
+    initUnaryInstr(&i, IT_PUSH, &rbp);
+    capture(c, &i);
+    initBinaryInstr(&i, IT_MOV, VT_64, &rbp, &rsp);
+    capture(c, &i);
+    initBinaryInstr(&i, IT_AND, VT_64, &rsp, getImmOp(VT_8, (uint8_t) -16));
+    capture(c, &i);
+    initUnaryInstr(&i, IT_CALL, &t);
+    capture(c, &i);
+    initBinaryInstr(&i, IT_MOV, VT_64, &rsp, &rbp);
+    capture(c, &i);
+    initUnaryInstr(&i, IT_POP, &rbp);
+    capture(c, &i);
+    initBinaryInstr(&i, IT_ADD, VT_64, &rsp, getImmOp(VT_32, 128));
+    capture(c, &i);
+
+    // calling convention: only return registers are defined, the callee
+    // may have written to memory
+    for(int j = 0; j < 6; j++)
+        initRegState(es, parReg[j], CS_DEAD);
+    initRegState(es, RI_10, CS_DEAD);
+    initRegState(es, RI_11, CS_DEAD);
+    initRegState(es, RI_A, CS_DYNAMIC);
+    initRegState(es, RI_D, CS_DYNAMIC);
+    setVRegState(es, RI_XMM0, CS_DYNAMIC);
+    setVRegState(es, RI_XMM1, CS_DYNAMIC);
+    for(int j = RI_XMM2; j < RI_XMMMax; j++)
+        setVRegState(es, (RegIndex) j, CS_DEAD);
+    setFlagsState(es, FS_CZSOP, CS_DEAD);
+    es->flagsPending = FS_None;
+    es->shadowCount = 0;
+}
+
+// functions handled specially when called (see processKnownTargets)
+static
+bool isKnownTarget(uint64_t f)
+{
+    return (f == (uint64_t) makeDynamic) ||
+           (f == (uint64_t) makeStatic) ||
+           (f == (uint64_t) dbrew_apply4_R8V8) ||
+           (f == (uint64_t) dbrew_apply4_R8V8V8) ||
+           (f == (uint64_t) dbrew_apply4_R8P8);
+}
+
+// number of parameter registers with known values
+static
+int staticParCount(EmuState* es)
+{
+    int count = 0;
+
+    for(int i = 0; i < 6; i++)
+        if (msIsStatic(es->reg_state[parReg[i]])) count++;
+    return count;
+}
+
+// cost model for inlining a call to <f>: the code size of the function
+// (if known) has to be within the configured limit, which grows with
+// known parameters (more specialization) and shrinks with each copy of
+// the function already inlined. Can be overwritten per function
+static
+bool shouldInline(Rewriter* r, uint64_t f)
+{
+    MemRangeConfig* mrc = (MemRangeConfig*) config_find_function(r, f);
+    FunctionConfig* fc = (mrc && (mrc->start == f)) ? (FunctionConfig*) mrc : 0;
+    int limit = r->cc->inline_limit;
+    DBrewInline mode = fc ? fc->inlining : DBREW_INLINE_AUTO;
+
+    if (mode == DBREW_INLINE_AUTO)
+        mode = config_directive(r, f, DBREW_DIRECTIVE_INLINE, mode);
+    if (mode == DBREW_INLINE_ALWAYS) return true;
+    if (mode == DBREW_INLINE_NEVER) return false;
+    if ((limit == 0) || !fc || (fc->size == 0)) return true;
+
+    return fc->size * (1 + fc->inlineCount) <=
+            limit * (1 + staticParCount(r->es));
+}
+
+// get code of a clone of <f> specialized for known parameter registers,
+// rewritten by a related rewriter. Returns <f> if not possible
+static
+uint64_t getClone(Rewriter* r, uint64_t f)
+{
+    EmuState* es = r->es;
+    CallFrame cf;
+    Rewriter* rr;
+
+    // no clones of clones, avoiding endless cloning
+    if (r->cloneParStatic >= 0) return f;
+    setFramePars(es, &cf);
+    if (cf.parStatic == 0) return f;
+
+    // already done before?
+    for(rr = r->next; rr != 0; rr = rr->next) {
+        if ((rr->func == f) && (rr->cloneParStatic == (int) cf.parStatic) &&
+            (memcmp(rr->clonePar, cf.par, sizeof(cf.par)) == 0))
+            return rr->generatedCodeAddr ? rr->generatedCodeAddr : f;
+    }
+
+    rr = dbrew_new();
+    // add to related rewriter list of <r>
+    rr->next = r->next;
+    r->next = rr;
+
+    if (r->showEmuSteps)
+        printf("Generating clone of %lx for known parameters\n", f);
+    dbrew_set_function(rr, f);
+    config_copy(rr, r);
+    rr->cloneParStatic = cf.parStatic;
+    memcpy(rr->clonePar, cf.par, sizeof(cf.par));
+    dbrew_config_parcount(rr, 6);
+    for(int i = 0; i < 6; i++) {
+        if (es->reg_state[parReg[i]].cState == CS_STATIC2)
+            dbrew_config_staticpar(rr, i);
+        else if (msIsStatic(es->reg_state[parReg[i]]))
+            dbrew_config_staticpar_shallow(rr, i);
+    }
+
+    // dynamic parameters are passed through, values do not matter
+    uint64_t res = dbrew_rewrite(rr, cf.par[0], cf.par[1], cf.par[2],
+                                 cf.par[3], cf.par[4], cf.par[5]);
+    if (res == f) rr->generatedCodeAddr = 0; // failed, call original
+    return res;
+}
+
+// keep call to <f> instead of inlining it: call a specialized clone
+static
+void keepCall(RContext* c, uint64_t f)
+{
+    uint64_t target = getClone(c->r, f);
+
+    if (c->r->showEmuSteps)
+        printf("Keeping call to %lx (calling %lx)\n", f, target);
+    captureRealCall(c, getImmOp(VT_64, target));
+}
+
+// Indirect call with unknown target: done as real call, which requires
+// an expected target with known signature (see dbrew_config_call_target
+// and dbrew_config_function_parcount). For expected targets, an inline
+// cache is captured: the target gets compared with each expected one,
+// branching to paths with the call instruction emulated for a known
+// target, i.e. inlined. The real call is the fallback, continuing after
+// the call instruction
+static
+void emulateDynamicCall(RContext* c, Instr* instr)
+{
+    uint64_t targets[CC_MAXCALLTARGETS], sig;
+    CBB *cbb, *next, *fallback;
+    Operand r11;
+    MetaState ms;
+    ExprNode* dep;
+    RegIndex ri;
+    int count, esID;
+    Instr i;
+
+    Rewriter* r = c->r;
+    EmuState* es = r->es;
+
+    // arguments are passed the same way to all targets of a call site:
+    // use the signature of an expected target for the real call
+    count = config_call_targets(r, instr->addr, targets, CC_MAXCALLTARGETS);
+    sig = 0;
+    for(int j = 0; j < count; j++) {
+        if (regArgsOnly(r, targets[j])) {
+            sig = targets[j];
+            break;
+        }
+    }
+    if ((sig == 0) || !canCallReal(r, sig)) {
+        setEmulatorError(c, instr, ET_UnsupportedOperands,
+                         "Call to unknown target with unsupported parameters");
+        return;
+    }
+
+    copyOperand(&r11, getRegOp(getReg(RT_GP64, RI_11)));
+    ri = instr->dst.reg.ri;
+    if ((instr->dst.type != OT_Reg64) ||
+        (ri == RI_SP) || (ri == RI_BP) || (ri == RI_11) ||
+        r->cc->branches_known)
+        count = 0;
+
+    if (count == 0) {
+        // load target into r11 (not used for parameters), as stack
+        // pointer and rbp get modified for the call
+        initBinaryInstr(&i, IT_MOV, VT_64, &r11, &(instr->dst));
+        processInstr(c, &i);
+        if (c->e) return;
+        captureRealCall(c, &r11);
+        return;
+    }
+
+    if (r->showEmuSteps)
+        printf("Inline cache with %d targets\n", count);
+
+    // r11 is used for comparisons, which change flags
+    initRegState(es, RI_11, CS_DEAD);
+    setFlagsState(es, FS_CZSOP, CS_DEAD);
+    es->flagsPending = FS_None;
+
+    // compares captured into current CBB and further ones (without
+    // emulator state) branch to the call with known target
+    ms = es->reg_state[ri];
+    dep = getRegDep(es, ri);
+    cbb = popCaptureBB(r);
+    for(int j = 0; j < count; j++) {
+        es->reg[ri] = targets[j];
+        initRegState(es, ri, CS_STATIC);
+        esID = saveEmuState(c);
+        es->reg_state[ri] = ms;
+        setRegDep(es, ri, dep);
+        if (c->e) return;
+
+        r->currentCapBB = cbb;
+        initBinaryInstr(&i, IT_MOV, VT_64, &r11, getImmOp(VT_64, targets[j]));
+        capture(c, &i);
+        initBinaryInstr(&i, IT_CMP, VT_64, getRegOp(getReg(RT_GP64, ri)), &r11);
+        capture(c, &i);
+        r->currentCapBB = 0;
+        if (c->e) return;
+
+        cbb->endType = IT_JZ;
+        cbb->preferBranch = true;
+        cbb->nextBranch = getCaptureBB(c, instr->addr, esID);
+        if (c->e) return;
+        pushCaptureBB(c, cbb->nextBranch);
+        next = newCaptureBB(c, instr->addr, -1);
+        if (c->e) return;
+        cbb->nextFallThrough = next;
+        cbb = next;
+    }
+
+    // fallback: real call, continue with state after the call
+    fallback = cbb;
+    r->currentCapBB = fallback;
+    captureRealCall(c, getRegOp(getReg(RT_GP64, ri)));
+    r->currentCapBB = 0;
+    if (c->e) return;
+    esID = saveEmuState(c);
+    if (c->e) return;
+    fallback->endType = IT_JMP;
+    fallback->nextFallThrough = getCaptureBB(c, instr->addr + instr->len, esID);
+    if (c->e) return;
+    pushCaptureBB(c, fallback->nextFallThrough);
+
+    c->exit = instr->addr + instr->len;
+}
+
+static
+void emulateCall(RContext* c, Instr* instr)
+{
+    FunctionConfig* fc;
+    EmuValue v1;
+    int count;
+
+    Rewriter* r = c->r;
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+    if (!msIsStatic(v1.state)) {
+        emulateDynamicCall(c, instr);
+        return;
+    }
+
+    // calls are inlined. Recursion gets unrolled as long as known
+    // parameters change, otherwise do a real call
+    count = callCount(es, v1.val);
+    if (count > 0) {
+        bool tooDeep = (count >= r->cc->max_recursion);
+        if ((tooDeep || !parsChanged(es, v1.val)) && canCallReal(r, v1.val)) {
+            captureRealCall(c, getImmOp(VT_64, v1.val));
+            return;
+        }
+        if (tooDeep) {
+            setEmulatorError(c, instr, ET_BufferOverflow,
+                             "Recursion too deep");
+            return;
+        }
+    }
+
+    // keep call instead of inlining? Functions handled specially by
+    // the rewriter (see processKnownTargets) always are inlined
+    if (!isKnownTarget(v1.val) &&
+        !shouldInline(r, v1.val) && canCallReal(r, v1.val)) {
+        keepCall(c, v1.val);
+        return;
+    }
+    fc = config_find_function(r, v1.val);
+    if (fc && (fc->start == v1.val)) fc->inlineCount++;
+
+    Instr i;
+    Operand o;
+
+    // push address of instruction after CALL onto stack
+    copyOperand(&o, getImmOp(VT_64, instr->addr + instr->len));
+    initUnaryInstr(&i, IT_PUSH, &o);
+    processInstr(c, &i);
+    if (c->e) return; // error
+
+    if (es->depth == es->callCapacity) {
+        es->callCapacity = (es->callCapacity == 0) ? 8 : 2 * es->callCapacity;
+        es->callStack = (CallFrame*) realloc(es->callStack,
+                                             es->callCapacity * sizeof(CallFrame));
+    }
+    es->callStack[es->depth].ret = o.val;
+    es->callStack[es->depth].func = v1.val;
+    setFramePars(es, &(es->callStack[es->depth]));
+    es->depth++;
+
+    if (r->addInliningHints) {
+        initSimpleInstr(&i, IT_HINT_CALL);
+        capture(c, &i);
+    }
+
+    // address to jump to
+    c->exit = v1.val;
+}
+
+static
+void emulateCltq(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+
+    // cltq: sign-extend eax to rax
+    es->reg[RI_A] = (int64_t) (int32_t) es->reg[RI_A];
+    if (!msIsStatic(es->reg_state[RI_A]))
+        capture(c, instr);
+}
+
+static
+void emulateCwtl(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+
+    // cwtl: sign-extend ax to eax
+    es->reg[RI_A] = (int32_t) (int16_t) es->reg[RI_A];
+    if (!msIsStatic(es->reg_state[RI_A]))
+        capture(c, instr);
+}
+
+static
+void emulateCqto(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+
+    switch(instr->vtype) {
+    case VT_64:
+        // sign-extend eax to edx:eax
+        es->reg[RI_D] = (es->reg[RI_A] & (1<<30)) ? ((uint32_t)-1) : 0;
+        break;
+    case VT_128:
+        // sign-extend rax to rdx:rax
+        es->reg[RI_D] = (es->reg[RI_A] & (1ul<<62)) ? ((uint64_t)-1) : 0;
+        break;
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    es->reg_state[RI_D] = es->reg_state[RI_A];
+    setRegDep(es, RI_D, 0);
+    if (!msIsStatic(es->reg_state[RI_A]))
+        capture(c, instr);
+}
+
+static
+void emulateCMov(RContext* c, Instr* instr)
+{
+    EmuValue vres;
+
+    FlagType ft;
+    bool cond;
+
+    EmuState* es = c->r->es;
+
+    switch(instr->type) {
+    case IT_CMOVZ:  ft = FT_Zero;     cond =  getFlag(es, ft); break;
+    case IT_CMOVNZ: ft = FT_Zero;     cond = !getFlag(es, ft); break;
+    case IT_CMOVC:  ft = FT_Carry;    cond =  getFlag(es, ft); break;
+    case IT_CMOVNC: ft = FT_Carry;    cond = !getFlag(es, ft); break;
+    case IT_CMOVO:  ft = FT_Overflow; cond =  getFlag(es, ft); break;
+    case IT_CMOVNO: ft = FT_Overflow; cond = !getFlag(es, ft); break;
+    case IT_CMOVS:  ft = FT_Sign;     cond =  getFlag(es, ft); break;
+    case IT_CMOVNS: ft = FT_Sign;     cond = !getFlag(es, ft); break;
+    default: assert(0);
+    }
+    assert(opValType(&(instr->src)) == opValType(&(instr->dst)));
+    instr->getSrc(c, &vres, &(instr->src));
+    captureCMov(c, instr, es, &vres, es->flag_state[ft], cond);
+    if (!msIsStatic(es->flag_state[ft])) {
+        // destination value unknown, whether moved or not
+        setOpState(&vres, es, &(instr->dst));
+        return;
+    }
+    if (cond == true) {
+        setOpValue(&vres, es, &(instr->dst));
+        setOpState(&vres, es, &(instr->dst));
+    }
+}
+
+static
+void emulateCmp(RContext* c, Instr* instr)
+{
+    EmuValue v1, v2;
+    CaptureState cs;
+    ValType vt;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
+
+    vt = opValType(&(instr->dst));
+    // sign-extend src/v2 if needed
+    if (instr->src.type == OT_Imm8) {
+        // sign-extend to 64bit (may be cutoff later)
+        v2.val = (int64_t) (int8_t) v2.val;
+        v2.type = vt;
+    }
+    cs = setFlagsSub(es, &v1, &v2);
+    captureCmp(c, instr, es, cs);
+}
+
+static
+void emulateDec(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+
+    vres.type = v1.type;
+    initValueState(&vres, v1.state.cState);
+    switch(instr->dst.type) {
+    case OT_Reg32:
+    case OT_Ind32:
+        vres.val = (uint32_t)(((int32_t) v1.val) - 1);
+        break;
+
+    case OT_Reg64:
+    case OT_Ind64:
+        vres.val = (uint64_t)(((int64_t) v1.val) - 1);
+        break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    captureUnaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
+
+static
+void emulateIMul(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1, v2;
+    CaptureState cs;
+
+    EmuState* es = c->r->es;
+
+    if (instr->form == OF_2) {
+        instr->getDst(c, &v1, &(instr->dst));
+        instr->getSrc(c, &v2, &(instr->src));
+        assert(opIsGPReg(&(instr->dst)));
+    } else if (instr->form == OF_3) {
+        instr->getSrc(c, &v1, &(instr->src));
+        instr->getSrc2(c, &v2, &(instr->src2));
+        assert(opIsGPReg(&(instr->dst)));
+    } else {
+        assert(false && "IMUL_1 emulation not implemented");
+        return;
+    }
+
+    assert(v1.type == v2.type);
+    switch(instr->src.type) {
+    case OT_Reg32:
+    case OT_Ind32:
+        vres.type = VT_32;
+        vres.val = (uint64_t) ((int32_t) v1.val * (int32_t) v2.val);
+        break;
+
+    case OT_Reg64:
+    case OT_Ind64:
+        vres.type = VT_64;
+        vres.val = (uint64_t) ((int64_t) v1.val * (int64_t) v2.val);
+        break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+
+    // optimization: multiply with static 0 results in static 0
+    if ((msIsStatic(v1.state) && (v1.val == 0)) ||
+        (msIsStatic(v2.state) && (v2.val == 0)))
+        cs = CS_STATIC;
+    else
+        cs = combineState(v1.state.cState, v2.state.cState, 0);
+    initValueState(&vres, cs);
+    setAffineDep(c, IT_IMUL, &vres, &v1, &v2);
+
+    // for capture we need state of dst, do before setting dst
+    captureBinaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
+
+static
+void emulateIDiv(RContext* c, Instr* instr)
+{
+    EmuValue v1;
+    CaptureState cs;
+    uint64_t v, quRes, modRes;
+
+    EmuState* es = c->r->es;
+
+    // FIXME: Set flags!
+    instr->getDst(c, &v1, &(instr->dst));
+    // TODO: raise "division by 0" exception
+    assert(v1.val != 0);
+    cs = combineState(es->reg_state[RI_D].cState,
+                      es->reg_state[RI_A].cState, 1);
+    cs = combineState(cs, v1.state.cState, 0);
+
+    switch(instr->dst.type) {
+    case OT_Reg32:
+    case OT_Ind32:
+        v = (es->reg[RI_D] << 32) + (es->reg[RI_A] & ((1ul<<32)-1) );
+        v1.val = (int32_t) v1.val;
+        quRes = v / v1.val;
+        assert(quRes < (1u<<31)); // fits into 32 bit (TODO: raise exc)
+        modRes = v % v1.val;
+        break;
+
+    case OT_Reg64:
+    case OT_Ind64:
+        // FIXME: should use rdx
+        quRes = es->reg[RI_A] / v1.val;
+        modRes = es->reg[RI_A] % v1.val;
+        break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+
+    captureIDiv(c, instr, cs, es);
+
+    es->reg[RI_A] = quRes;
+    es->reg[RI_D] = modRes;
+    initRegState(es, RI_D, cs);
+    initRegState(es, RI_A, cs);
+}
+
+static
+void emulateInc(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+
+    vres.type = v1.type;
+    initValueState(&vres, v1.state.cState);
+    switch(instr->dst.type) {
+    case OT_Reg32:
+    case OT_Ind32:
+        vres.val = (uint32_t)(((int32_t) v1.val) + 1);
+        break;
+
+    case OT_Reg64:
+    case OT_Ind64:
+        vres.val = (uint64_t)(((int64_t) v1.val) + 1);
+        break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    captureUnaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
+
+// maximal number of entries in jump tables to dispatch on
+#define JUMPTABLE_MAX 1024
+
+// previous instruction in same decoded BB as <instr>, or 0
+static
+Instr* prevInstr(RContext* c, Instr* instr, int back)
+{
+    DBB* dbb = c->dbb;
+
+    if (!dbb || (instr < dbb->instr) || (instr >= dbb->instr + dbb->count))
+        return 0;
+    if (instr - dbb->instr < back) return 0;
+    return instr - back;
+}
+
+// does decoded BB at <addr> end in an indirect jump?
+static
+bool endsInJmpi(Rewriter* r, uint64_t addr)
+{
+    DBB* dbb = dbrew_decode(r, addr);
+
+    if (!dbb || (dbb->count == 0)) return false;
+    return (dbb->instr[dbb->count - 1].type == IT_JMPI);
+}
+
+// Jump tables of "switch" statements are guarded by an unsigned check
+// of an unknown index against a known value ("cmp idx, N; ja default").
+// If the path with valid index goes to an indirect jump, get the bound
+// of the index for that path
+static
+bool getJccBound(RContext* c, Instr* instr, Bound* b)
+{
+    EmuState* es = c->r->es;
+    Instr* cmp = prevInstr(c, instr, 1);
+    uint64_t max, target;
+
+    if (!cmp || (cmp->type != IT_CMP)) return false;
+    if (((cmp->dst.type != OT_Reg32) && (cmp->dst.type != OT_Reg64)) ||
+        !opIsImm(&(cmp->src)))
+        return false;
+    if (!msIsDynamic(es->reg_state[cmp->dst.reg.ri])) return false;
+
+    max = cmp->src.val;
+    if (cmp->src.type == OT_Imm8) max = (int64_t) (int8_t) max;
+    switch(instr->type) {
+    case IT_JA:  // taken if idx > max
+        b->onBranch = false;
+        break;
+    case IT_JBE: // taken if idx <= max
+        b->onBranch = true;
+        break;
+    case IT_JNC: // taken if idx >= max
+    case IT_JC:  // taken if idx < max
+        if (max == 0) return false;
+        max--;
+        b->onBranch = (instr->type == IT_JC);
+        break;
+    default:
+        return false;
+    }
+    if (max >= JUMPTABLE_MAX) return false;
+
+    target = b->onBranch ? instr->dst.val : instr->addr + instr->len;
+    if (!endsInJmpi(c->r, target)) return false;
+
+    b->ri = cmp->dst.reg.ri;
+    b->max = max;
+    return true;
+}
+
+// Loop re-rolling
+//
+// A loop with known trip count gets unrolled. If the code captured in the
+// last iterations only differs in immediates changing linearly, and the
+// static state only differs in registers or stack words changing by a
+// constant stride (induction variables), these become unknown at the
+// backward jump. The loop condition then is unknown in the next iteration,
+// and as the state at the loop start converges, a real loop gets
+// generated. Other known values stay specialized.
+
+// same operand ignoring immediate/displacement?
+static
+bool opHasSameShape(Operand* o1, Operand* o2)
+{
+    if (o1->type != o2->type) return false;
+    if ((o1->type == OT_None) || opIsImm(o1)) return true;
+    if (!regIsEqual(o1->reg, o2->reg)) return false;
+    if (opIsReg(o1)) return true;
+    if ((o1->seg != o2->seg) || (o1->scale != o2->scale)) return false;
+    return (o1->scale == 0) || regIsEqual(o1->ireg, o2->ireg);
+}
+
+// do operands of 3 consecutive iterations only differ linearly in value?
+static
+bool opIsLinear(Operand* o1, Operand* o2, Operand* o3)
+{
+    if (!opHasSameShape(o1, o2) || !opHasSameShape(o2, o3)) return false;
+    if ((o1->type == OT_None) || opIsReg(o1)) return true;
+    return (o2->val - o1->val) == (o3->val - o2->val);
+}
+
+static
+bool instrIsLinear(Instr* i1, Instr* i2, Instr* i3)
+{
+    if ((i1->type != i2->type) || (i2->type != i3->type)) return false;
+    if ((i1->form != i2->form) || (i2->form != i3->form)) return false;
+    if ((i1->vtype != i2->vtype) || (i2->vtype != i3->vtype)) return false;
+    if ((i1->ptLen != i2->ptLen) || (i2->ptLen != i3->ptLen)) return false;
+    if ((i1->ptLen > 0) &&
+        ((memcmp(i1->ptOpc, i2->ptOpc, i1->ptLen) != 0) ||
+         (memcmp(i2->ptOpc, i3->ptOpc, i1->ptLen) != 0)))
+        return false;
+
+    return opIsLinear(&(i1->dst), &(i2->dst), &(i3->dst)) &&
+           opIsLinear(&(i1->src), &(i2->src), &(i3->src)) &&
+           opIsLinear(&(i1->src2), &(i2->src2), &(i3->src2));
+}
+
+// tracker for loop with backward jump at <addr>, new one if <create>
+static
+LoopTrack* getLoopTrack(Rewriter* r, uint64_t addr, bool create)
+{
+    LoopTrack *t, *unused = 0;
+
+    for(int i = 0; i < LOOPTRACK_MAX; i++) {
+        t = r->loopTrack + i;
+        if (t->addr == addr) return t;
+        if ((t->addr == 0) && !unused) unused = t;
+    }
+    if (!create) return 0;
+
+    // use unused tracker, otherwise replace round-robin
+    t = unused;
+    if (!t) {
+        t = r->loopTrack + r->loopTrackNext;
+        r->loopTrackNext = (r->loopTrackNext + 1) % LOOPTRACK_MAX;
+    }
+    t->addr = addr;
+    t->iterations = 0;
+    return t;
+}
+
+// is conditional jump of type <it> taken with given flags?
+static
+bool jccTaken(InstrType it, bool* flag)
+{
+    switch(it) {
+    case IT_JO:  return flag[FT_Overflow];
+    case IT_JNO: return !flag[FT_Overflow];
+    case IT_JC:  return flag[FT_Carry];
+    case IT_JNC: return !flag[FT_Carry];
+    case IT_JZ:  return flag[FT_Zero];
+    case IT_JNZ: return !flag[FT_Zero];
+    case IT_JS:  return flag[FT_Sign];
+    case IT_JNS: return !flag[FT_Sign];
+    case IT_JP:  return flag[FT_Parity];
+    case IT_JNP: return !flag[FT_Parity];
+    case IT_JBE: return flag[FT_Carry] || flag[FT_Zero];
+    case IT_JA:  return !flag[FT_Carry] && !flag[FT_Zero];
+    case IT_JLE: return flag[FT_Zero] || (flag[FT_Sign] != flag[FT_Overflow]);
+    case IT_JG:  return !flag[FT_Zero] && (flag[FT_Sign] == flag[FT_Overflow]);
+    case IT_JL:  return flag[FT_Sign] != flag[FT_Overflow];
+    case IT_JGE: return flag[FT_Sign] == flag[FT_Overflow];
+    default: assert(0);
+    }
+    return false;
+}
+
+// remember operation flags at backward jump are derived from in <s>
+static
+void snapshotFlags(EmuState* es, LoopSnapshot* s)
+{
+    bool flag[FT_Max];
+
+    s->flagsOp = IT_None;
+    if ((es->flagsOp != IT_ADD) && (es->flagsOp != IT_SUB) &&
+        (es->flagsOp != IT_AND) && (es->flagsOp != IT_XOR) &&
+        (es->flagsOp != IT_OR))
+        return;
+    if ((es->flagsOpType != VT_8) && (es->flagsOpType != VT_32) &&
+        (es->flagsOpType != VT_64))
+        return;
+
+    // flags may have been set directly after the operation
+    computeFlags(es, FS_CZSOP);
+    computeOpFlags(flag, FS_CZSOP, es->flagsOp, es->flagsOpType,
+                   es->flagsOpD, es->flagsOpS);
+    for(int i = 0; i < FT_Max; i++)
+        if (flag[i] != es->flag[i]) return;
+
+    s->flagsOp = es->flagsOp;
+    s->flagsOpType = es->flagsOpType;
+    s->flagsOpD = es->flagsOpD;
+    s->flagsOpS = es->flagsOpS;
+}
+
+// maximal number of iterations predicted for a loop
+#define LOOP_MAXPREDICT (1 << 20)
+
+// value <v> of type <vt> as signed or unsigned integer
+static
+__int128 loopValue(uint64_t v, ValType vt, bool isSigned)
+{
+    switch(vt) {
+    case VT_8:  return isSigned ? (__int128) (int8_t) v  : (uint8_t) v;
+    case VT_16: return isSigned ? (__int128) (int16_t) v : (uint16_t) v;
+    case VT_32: return isSigned ? (__int128) (int32_t) v : (uint32_t) v;
+    default:    return isSigned ? (__int128) (int64_t) v : v;
+    }
+}
+
+// number of iterations left for loop with backward jump <instr> if
+// operands of the compare setting the flags change with constant stride
+// in snapshots <s> of the last iterations, -1 if not predictable.
+// Computed in closed form, as long as operands do not wrap around
+static
+int loopItersLeft(Instr* instr, LoopSnapshot** s)
+{
+    InstrType op = s[0]->flagsOp;
+    ValType vt = s[0]->flagsOpType;
+    __int128 d, v, dd, ds, diff, step, a, b, k;
+    bool isSigned;
+
+    if (op != IT_SUB) return -1;
+    dd = loopValue(s[1]->flagsOpD - s[0]->flagsOpD, vt, true);
+    ds = loopValue(s[1]->flagsOpS - s[0]->flagsOpS, vt, true);
+    for(int j = 1; j < LOOPTRACK_SNAPSHOTS; j++) {
+        if ((s[j]->flagsOp != op) || (s[j]->flagsOpType != vt) ||
+            (loopValue(s[j]->flagsOpD - s[j-1]->flagsOpD, vt, true) != dd) ||
+            (loopValue(s[j]->flagsOpS - s[j-1]->flagsOpS, vt, true) != ds))
+            return -1;
+    }
+
+    switch(instr->type) {
+    case IT_JC: case IT_JNC: case IT_JBE: case IT_JA:
+        isSigned = false; break;
+    case IT_JNZ:
+    case IT_JL: case IT_JGE: case IT_JLE: case IT_JG:
+        isSigned = true; break;
+    default:
+        return -1;
+    }
+
+    // difference of operands in iteration k from now: diff + k * step
+    LoopSnapshot* last = s[LOOPTRACK_SNAPSHOTS - 1];
+    d = loopValue(last->flagsOpD, vt, isSigned);
+    v = loopValue(last->flagsOpS, vt, isSigned);
+    diff = d - v;
+    step = dd - ds;
+
+    if (instr->type == IT_JNZ) {
+        // first k with diff + k * step == 0
+        if ((step == 0) || ((-diff) % step != 0)) return -1;
+        k = -diff / step;
+    }
+    else {
+        // jump taken as long as a + k * b < 0: find first k not taken
+        switch(instr->type) {
+        case IT_JC:  case IT_JL:  a = diff;      b = step;  break;
+        case IT_JBE: case IT_JLE: a = diff - 1;  b = step;  break;
+        case IT_JA:  case IT_JG:  a = -diff;     b = -step; break;
+        default:                  a = -diff - 1; b = -step; break;
+        }
+        if (a + b >= 0) k = 1;
+        else if (b <= 0) return -1;
+        else k = (-a + b - 1) / b;
+    }
+    if ((k < 1) || (k > LOOP_MAXPREDICT)) return -1;
+
+    // no wrap-around of operands up to iteration k
+    if ((loopValue(d + k * dd, vt, isSigned) != d + k * dd) ||
+        (loopValue(v + k * ds, vt, isSigned) != v + k * ds))
+        return -1;
+    return (int) k;
+}
+
+// called on backward jump <instr>. If the jump is taken with known
+// condition, the loop is <iterating>, otherwise tracking of it stops
+static
+void rerollLoop(RContext* c, Instr* instr, bool iterating)
+{
+    Rewriter* r = c->r;
+    EmuState* es = r->es;
+    LoopTrack* t;
+    LoopSnapshot *s, *s0, *s1, *s2, *s3;
+    int n, changed, iter, stackOff, limit, factor, u;
+    int slot[LOOPTRACK_STACKSLOTS], slotCount; // 8-byte slots changing
+    Instr i;
+
+    if (!r->cc) return;
+    factor = config_loop_unroll(r, instr->dst.val);
+    limit = r->cc->loop_reroll;
+    if ((limit == 0) && (factor > 0)) limit = factor;
+    if (limit == 0) return;
+    if (!iterating || !r->currentCapBB) {
+        t = getLoopTrack(r, instr->addr, false);
+        if (t) t->addr = 0;
+        return;
+    }
+
+    t = getLoopTrack(r, instr->addr, true);
+    s = t->snap + (t->iterations % LOOPTRACK_SNAPSHOTS);
+    memcpy(s->reg, es->reg, sizeof(s->reg));
+    for(int j = 0; j < RI_GPMax; j++) {
+        s->cs[j] = es->reg_state[j].cState;
+        if (s->cs[j] == CS_STATIC2) s->cs[j] = CS_STATIC;
+    }
+    stackOff = es->stackAccessed - es->stackStart;
+    s->stackLen = es->stackSize - stackOff;
+    if (s->stackLen <= LOOPSNAPSHOT_STACK) {
+        memcpy(s->stack, es->stack + stackOff, s->stackLen);
+        memcpy(s->stackState, es->stackState + stackOff, s->stackLen);
+        for(int j = 0; j < s->stackLen; j++)
+            if (s->stackState[j] == CS_STATIC2) s->stackState[j] = CS_STATIC;
+        s->fp = esMemFingerprint(es, 0);
+    }
+    else {
+        s->stackLen = -1;
+        s->fp = esMemFingerprint(es, es->stackHash);
+    }
+    s->capCount = r->capInstrCount;
+    snapshotFlags(es, s);
+    t->iterations++;
+
+    iter = t->iterations;
+    if ((iter < LOOPTRACK_SNAPSHOTS) || (iter < limit)) return;
+    s0 = t->snap + (iter % LOOPTRACK_SNAPSHOTS);
+    s1 = t->snap + ((iter + 1) % LOOPTRACK_SNAPSHOTS);
+    s2 = t->snap + ((iter + 2) % LOOPTRACK_SNAPSHOTS);
+    s3 = t->snap + ((iter + 3) % LOOPTRACK_SNAPSHOTS);
+
+    // besides GP registers and stack, static state must be the same
+    if ((s0->fp != s1->fp) || (s1->fp != s2->fp) || (s2->fp != s3->fp))
+        return;
+    slotCount = 0;
+    if ((s0->stackLen != s1->stackLen) || (s1->stackLen != s2->stackLen) ||
+        (s2->stackLen != s3->stackLen))
+        return;
+    if (s0->stackLen > 0) {
+        // stack words changing must be static with constant, non-zero stride
+        stackOff = es->stackSize - s0->stackLen;
+        for(int j = 0; j < s0->stackLen; j++) {
+            if ((s0->stackState[j] != s1->stackState[j]) ||
+                (s1->stackState[j] != s2->stackState[j]) ||
+                (s2->stackState[j] != s3->stackState[j]))
+                return;
+        }
+        for(int j = 0; j < s0->stackLen; j++) {
+            int w = j - ((stackOff + j) & 3); // start of aligned word
+            int q; // start of aligned 8-byte slot
+            uint32_t v[LOOPTRACK_SNAPSHOTS];
+
+            if ((s0->stackState[j] != CS_STATIC) ||
+                ((s0->stack[j] == s1->stack[j]) &&
+                 (s1->stack[j] == s2->stack[j]) &&
+                 (s2->stack[j] == s3->stack[j])))
+                continue;
+            if ((w < 0) || (w + 4 > s0->stackLen)) return;
+            for(int k = w; k < w + 4; k++)
+                if (s0->stackState[k] != CS_STATIC) return;
+            memcpy(v + 0, s0->stack + w, 4);
+            memcpy(v + 1, s1->stack + w, 4);
+            memcpy(v + 2, s2->stack + w, 4);
+            memcpy(v + 3, s3->stack + w, 4);
+            if ((v[1] == v[0]) ||
+                (v[2] - v[1] != v[1] - v[0]) || (v[3] - v[2] != v[1] - v[0]))
+                return;
+            j = w + 3;
+
+            // whole 8-byte slot is stored when re-rolling, as the word
+            // may be part of a 64-bit variable. Its other word must be
+            // either completely known or completely unknown
+            q = w - ((stackOff + w) & 7);
+            if ((slotCount > 0) && (slot[slotCount - 1] == stackOff + q))
+                continue;
+            if ((q < 0) || (q + 8 > s0->stackLen) ||
+                (slotCount == LOOPTRACK_STACKSLOTS))
+                return;
+            for(int h = q; h < q + 8; h += 4) {
+                int known = 0;
+                for(int k = h; k < h + 4; k++)
+                    if (s0->stackState[k] == CS_STATIC) known++;
+                if ((known != 0) && (known != 4)) return;
+            }
+            slot[slotCount++] = stackOff + q;
+        }
+    }
+
+    // registers changing must be static with constant, non-zero stride
+    changed = 0;
+    for(int j = 0; j < RI_GPMax; j++) {
+        uint64_t d = s1->reg[j] - s0->reg[j];
+
+        if ((s0->cs[j] != s1->cs[j]) || (s1->cs[j] != s2->cs[j]) ||
+            (s2->cs[j] != s3->cs[j]))
+            return;
+        if ((s0->cs[j] != CS_STATIC) && (s0->cs[j] != CS_STACKRELATIVE))
+            continue;
+        if ((d == 0) && (s2->reg[j] == s1->reg[j]) &&
+            (s3->reg[j] == s2->reg[j]))
+            continue;
+        if ((s0->cs[j] != CS_STATIC) || (d == 0) ||
+            (s2->reg[j] - s1->reg[j] != d) || (s3->reg[j] - s2->reg[j] != d))
+            return;
+        changed |= 1 << j;
+    }
+    if ((changed == 0) && (slotCount == 0)) return;
+    if ((slotCount > 0) && (s0->cs[RI_SP] != CS_STACKRELATIVE)) return;
+
+    // same instructions captured in last iterations (in capture order,
+    // possibly into multiple CBBs), none without capturing
+    n = s1->capCount - s0->capCount;
+    if ((n == 0) || (s2->capCount - s1->capCount != n) ||
+        (s3->capCount - s2->capCount != n))
+        return;
+    for(int k = 0; k < n; k++)
+        if (!instrIsLinear(r->capInstr + s0->capCount + k,
+                           r->capInstr + s1->capCount + k,
+                           r->capInstr + s2->capCount + k))
+            return;
+
+    // partial unrolling: with known trip count, first unroll iterations
+    // not filling the unrolled body completely
+    if (es->unrollCount == UNROLL_MAX) factor = 1;
+    if (factor > 1) {
+        LoopSnapshot* last[LOOPTRACK_SNAPSHOTS] = { s0, s1, s2, s3 };
+        int left = loopItersLeft(instr, last);
+        if ((left > 0) && (left % factor != 0)) return;
+    }
+
+    if (r->showEmuSteps) {
+        printf("Re-rolling loop of jump at %s after %d iterations",
+               prettyAddress(instr->addr, c->dbb ? c->dbb->fc : 0), iter);
+        if (factor > 1)
+            printf(", unrolled by %d", factor);
+        printf("\n");
+    }
+
+    // load induction variables and make them unknown
+    for(int j = 0; j < RI_GPMax; j++) {
+        if ((changed & (1 << j)) == 0) continue;
+        initBinaryInstr(&i, IT_MOV, VT_64,
+                        getRegOp(getReg(RT_GP64, (RegIndex) j)),
+                        getImmOp(VT_64, es->reg[j]));
+        capture(c, &i);
+        initRegState(es, j, CS_DYNAMIC);
+    }
+    for(int j = 0; j < slotCount; j++) {
+        // store known words of slot and make them unknown
+        for(int w = slot[j]; w < slot[j] + 8; w += 4) {
+            EmuValue off;
+            MetaState ms;
+            Operand mem;
+
+            if (!csIsStatic(es->stackState[w])) continue;
+            mem.type = OT_Ind32;
+            mem.reg = getReg(RT_GP64, RI_SP);
+            mem.scale = 0;
+            mem.val = es->stackStart + w - es->reg[RI_SP];
+            mem.seg = OSO_None;
+            initBinaryInstr(&i, IT_MOV, VT_32, &mem,
+                            getImmOp(VT_32, *(uint32_t*) (es->stack + w)));
+            capture(c, &i);
+
+            off.type = VT_32;
+            off.val = w;
+            initValueState(&off, CS_STATIC);
+            initMetaState(&ms, CS_DYNAMIC);
+            setStackState(es, &off, VT_32, ms, 0);
+        }
+    }
+    if (factor > 1) {
+        for(u = 0; u < es->unrollCount; u++)
+            if (es->unrollJump[u] == instr->addr) break;
+        if (u == es->unrollCount) es->unrollCount++;
+        es->unrollJump[u] = instr->addr;
+        es->unrollFactor[u] = factor;
+        es->unrollPhase[u] = 0;
+    }
+    t->addr = 0;
+}
+
+static
+void emulateJcc(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+    InstrType it = instr->type; // type of captured jump
+    bool isDynamic, taken;
+    int u, dir;
+
+    switch(instr->type) {
+    case IT_JO:
+    case IT_JNO:
+        isDynamic = msIsDynamic(es->flag_state[FT_Overflow]);
+        break;
+    case IT_JC:
+    case IT_JNC:
+        isDynamic = msIsDynamic(es->flag_state[FT_Carry]);
+        break;
+    case IT_JZ:
+    case IT_JNZ:
+        isDynamic = msIsDynamic(es->flag_state[FT_Zero]);
+        break;
+    case IT_JS:
+    case IT_JNS:
+        isDynamic = msIsDynamic(es->flag_state[FT_Sign]);
+        break;
+    case IT_JP:
+    case IT_JNP:
+        isDynamic = msIsDynamic(es->flag_state[FT_Parity]);
+        break;
+    case IT_JBE:
+    case IT_JA:
+        isDynamic = msIsDynamic(es->flag_state[FT_Carry]) ||
+                    msIsDynamic(es->flag_state[FT_Zero]);
+        break;
+    case IT_JLE:
+    case IT_JG:
+        isDynamic = msIsDynamic(es->flag_state[FT_Zero]) ||
+                    msIsDynamic(es->flag_state[FT_Sign]) ||
+                    msIsDynamic(es->flag_state[FT_Overflow]);
+        break;
+    case IT_JL:
+    case IT_JGE:
+        isDynamic = msIsDynamic(es->flag_state[FT_Sign]) ||
+                    msIsDynamic(es->flag_state[FT_Overflow]);
+        break;
+    default: assert(0);
+    }
+    computeFlags(es, FS_CZSOP);
+    taken = jccTaken(instr->type, es->flag);
+
+    // outcome of jump with unknown condition given by directive?
+    dir = -1;
+    if (isDynamic)
+        dir = config_directive(c->r, instr->addr, DBREW_DIRECTIVE_BRANCH, -1);
+    if (dir >= 0)
+        taken = (dir != 0);
+
+    // backward jump of partially unrolled loop?
+    for(u = 0; u < es->unrollCount; u++)
+        if (es->unrollJump[u] == instr->addr) break;
+
+    if (isDynamic && (dir < 0) &&
+        (u < es->unrollCount) && !c->r->cc->branches_known)
+        captureUnrolledJcc(c, it, instr->dst.val, instr->addr + instr->len, u);
+    else if (isDynamic && (dir < 0)) {
+        Bound b;
+        bool hasBound = getJccBound(c, instr, &b);
+        captureJcc(c, it, instr->dst.val, instr->addr + instr->len,
+                   hasBound ? &b : 0);
+    }
+    if (instr->dst.val <= instr->addr)
+        rerollLoop(c, instr, !isDynamic && taken);
+    // also for dynamic condition, c->exit needs to be set to non-zero
+    if (taken)
+        c->exit = instr->dst.val;
+    else
+        c->exit = instr->addr + instr->len;
+}
+
+static
+void emulateJmp(RContext* c, Instr* instr)
+{
+    if (instr->dst.type != OT_Imm64) {
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+
+    // address to jump to
+    c->exit = instr->dst.val;
+}
+
+// indexes [lo;hi] of a jump table with same target
+typedef struct _TableRange {
+    uint64_t lo, hi;
+    uint64_t target;
+    int esID;
+} TableRange;
+
+// get known upper bound of unknown index in register <ri>, -1 if none
+static
+int64_t indexBound(EmuState* es, RegIndex ri)
+{
+    MetaState* ms = &(es->reg_state[ri]);
+
+    if (!msIsDynamic(*ms) || (ms->bound == 0))
+        return -1;
+    return ms->bound - 1;
+}
+
+// binary tree of compares on index in register <ri> selecting target
+// of ranges [from;to]. Comparison at root is captured into <cbb>
+static
+void captureDispatchTree(RContext* c, CBB* cbb, RegIndex ri,
+                         TableRange* tr, int from, int to)
+{
+    Rewriter* r = c->r;
+    int mid = (from + to) / 2;
+    CBB* child[2];
+    Instr i;
+
+    assert(from < to);
+    r->currentCapBB = cbb;
+    initBinaryInstr(&i, IT_CMP, VT_64, getRegOp(getReg(RT_GP64, ri)),
+                    getImmOp(VT_64, tr[mid].hi));
+    capture(c, &i);
+    r->currentCapBB = 0;
+    if (c->e) return;
+
+    cbb->endType = IT_JA;
+    cbb->preferBranch = false;
+    for(int j = 0; j < 2; j++) {
+        int f = (j == 0) ? from : mid + 1;
+        int t = (j == 0) ? mid : to;
+
+        if (f == t) {
+            child[j] = getCaptureBB(c, tr[f].target, tr[f].esID);
+            if (c->e) return;
+            pushCaptureBB(c, child[j]);
+        }
+        else {
+            // node for compare only: not emulated, no emulator state
+            child[j] = newCaptureBB(c, cbb->dec_addr, -1);
+            if (c->e) return;
+            captureDispatchTree(c, child[j], ri, tr, f, t);
         }
+        if (c->e) return;
+    }
+    cbb->nextFallThrough = child[0];
+    cbb->nextBranch = child[1];
+}
 
-        captureIDiv(c, instr, cs, es);
+// Indirect jump via jump table with unknown index in register <ri> known
+// to be <= <max>. <getTarget> returns the target for an index.
+// Each target gets traced separately (with known index if unique), and
+// a tree of compares on the index is captured, selecting the target.
+// With known jump target in register <tri> (if not RI_None)
+static
+void emulateJumpTable(RContext* c, Instr* instr, RegIndex ri, int64_t max,
+                      uint64_t (*getTarget)(EmuState*, Instr*, uint64_t),
+                      RegIndex tri)
+{
+    Rewriter* r = c->r;
+    EmuState* es = r->es;
+    MetaState ms = es->reg_state[ri];
+    ExprNode* dep = getRegDep(es, ri);
+    TableRange* tr;
+    int count = 0;
+
+    tr = (TableRange*) malloc((max + 1) * sizeof(TableRange));
+    if (!tr) {
+        setEmulatorError(c, instr, ET_BufferOverflow,
+                         "No memory for jump table targets");
+        return;
+    }
+    for(uint64_t k = 0; k <= (uint64_t) max; k++) {
+        uint64_t target = getTarget(es, instr, k);
+        if ((count > 0) && (tr[count-1].target == target)) {
+            tr[count-1].hi = k;
+            continue;
+        }
+        tr[count].lo = k;
+        tr[count].hi = k;
+        tr[count].target = target;
+        count++;
+    }
+    if (r->showEmuSteps)
+        printf("Jump table with %ld entries: %d targets\n", max + 1, count);
 
-        es->reg[RI_A] = quRes;
-        es->reg[RI_D] = modRes;
-        initMetaState(&(es->reg_state[RI_D]), cs);
-        initMetaState(&(es->reg_state[RI_A]), cs);
-        break;
+    // compares in captured code change flags
+    if (count > 1) {
+        setFlagsState(es, FS_CZSOP, CS_DEAD);
+        es->flagsPending = FS_None;
     }
-    case IT_INC:
-        getOpValue(c, &v1, &(instr->dst));
-
-        vres.type = v1.type;
-        initMetaState(&(vres.state), v1.state.cState);
-        switch(instr->dst.type) {
-        case OT_Reg32:
-        case OT_Ind32:
-            vres.val = (uint32_t)(((int32_t) v1.val) + 1);
-            break;
 
-        case OT_Reg64:
-        case OT_Ind64:
-            vres.val = (uint64_t)(((int64_t) v1.val) + 1);
-            break;
+    for(int j = 0; j < count; j++) {
+        es->reg_state[ri] = ms;
+        es->reg_state[ri].bound = 0;
+        setRegDep(es, ri, dep);
+        if (tr[j].lo == tr[j].hi) {
+            es->reg[ri] = tr[j].lo;
+            initRegState(es, ri, CS_STATIC);
+        }
+        if (tri != RI_None) {
+            es->reg[tri] = tr[j].target;
+            initRegState(es, tri, CS_STATIC);
+        }
+        if (count == 1) break; // continue in current CBB
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        tr[j].esID = saveEmuState(c);
+        if (c->e) {
+            free(tr);
             return;
         }
-        captureUnaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
+    }
 
-    case IT_JO:
-        if (msIsDynamic(es->flag_state[FT_Overflow])) {
-            captureJcc(c, IT_JO, instr->dst.val, instr->addr + instr->len);
-            // fallthrough to set value of c->exit to non-zero
+    if (count > 1)
+        captureDispatchTree(c, popCaptureBB(r), ri, tr, 0, count - 1);
+    c->exit = tr[0].target;
+    free(tr);
+}
+
+// target of "jmp *disp(base,idx,8)" for index <k>
+static
+uint64_t tableTarget(EmuState* es, Instr* instr, uint64_t k)
+{
+    uint64_t a = instr->dst.val + instr->dst.scale * k;
+
+    if (instr->dst.reg.rt != RT_None)
+        a += es->reg[instr->dst.reg.ri];
+    return *(uint64_t*) a;
+}
+
+// position-independent jump table with 32-bit offsets:
+//   movslq (base,idx,4),tr; add base,tr; jmp *tr
+static
+uint64_t relTableTarget(EmuState* es, Instr* instr, uint64_t k)
+{
+    Instr* load = instr - 2;
+    uint64_t base = es->reg[load->src.reg.ri];
+
+    return base + *(int32_t*) (base + load->src.val + load->src.scale * k);
+}
+
+// try to dispatch jump via jump table with unknown but bounded index
+static
+bool emulateJmpiTable(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+    Operand* o = &(instr->dst);
+    Instr *add, *load;
+    uint64_t table;
+    int64_t max;
+
+    if (o->type == OT_Ind64) {
+        if ((o->scale != 8) || (o->ireg.rt != RT_GP64) ||
+            ((o->reg.rt != RT_None) &&
+             ((o->reg.rt != RT_GP64) || !msIsStatic(es->reg_state[o->reg.ri]))))
+            return false;
+        max = indexBound(es, o->ireg.ri);
+        if (max < 0) return false;
+        // table entries must not change
+        table = o->val;
+        if (o->reg.rt != RT_None) table += es->reg[o->reg.ri];
+        if (!config_is_constant(c->r, table, (max + 1) * 8)) return false;
+        emulateJumpTable(c, instr, o->ireg.ri, max, tableTarget, RI_None);
+        return true;
+    }
+
+    assert(o->type == OT_Reg64);
+    add = prevInstr(c, instr, 1);
+    load = prevInstr(c, instr, 2);
+    if (!add || (add->type != IT_ADD) ||
+        (add->dst.type != OT_Reg64) || (add->dst.reg.ri != o->reg.ri) ||
+        (add->src.type != OT_Reg64))
+        return false;
+    if (!load || (load->type != IT_MOVSX) ||
+        (load->dst.type != OT_Reg64) || (load->dst.reg.ri != o->reg.ri) ||
+        (load->src.type != OT_Ind32) || (load->src.scale != 4) ||
+        (load->src.reg.rt != RT_GP64) ||
+        (load->src.reg.ri != add->src.reg.ri) ||
+        (load->src.ireg.rt != RT_GP64))
+        return false;
+    if (!msIsStatic(es->reg_state[add->src.reg.ri])) return false;
+    max = indexBound(es, load->src.ireg.ri);
+    if (max < 0) return false;
+    table = es->reg[add->src.reg.ri] + load->src.val;
+    if (!config_is_constant(c->r, table, (max + 1) * 4)) return false;
+    emulateJumpTable(c, instr, load->src.ireg.ri, max, relTableTarget,
+                     o->reg.ri);
+    return true;
+}
+
+static
+void emulateJmpi(RContext* c, Instr* instr)
+{
+    EmuValue v1, v2;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+
+    switch(instr->dst.type) {
+    case OT_Reg64: break;
+    case OT_Ind64:
+        getOpAddr(&v2, es, &(instr->dst));
+        if (msIsStatic(v2.state)) {
+            // Assume indirect jump with target at constant address
+            // in memory to be constant: follow resolved PLT entries
+            v1.state.cState = CS_STATIC;
         }
-        if (es->flag[FT_Overflow] == true)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
         break;
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
 
-    case IT_JNO:
-        if (msIsDynamic(es->flag_state[FT_Overflow])) {
-            captureJcc(c, IT_JNO, instr->dst.val, instr->addr + instr->len);
+    if (!msIsStatic(v1.state)) {
+        // jump table with bounded index?
+        if (emulateJmpiTable(c, instr)) return;
+
+        // call target must be known
+        setEmulatorError(c, instr, ET_BufferOverflow,
+                         "Call to unknown target not supported");
+        return;
+    }
+    c->exit = v1.val; // address to jump to
+}
+
+static
+void emulateLea(RContext* c, Instr* instr)
+{
+    EmuValue vres;
+
+    EmuState* es = c->r->es;
+
+    switch(instr->dst.type) {
+    case OT_Reg32:
+    case OT_Reg64:
+        assert(opIsInd(&(instr->src)));
+        getOpAddr(&vres, es, &(instr->src));
+        setAffineAddrDep(c, &vres, &(instr->src));
+        if (opValType(&(instr->dst)) == VT_32) {
+            vres.val = (uint32_t) vres.val;
+            vres.type = VT_32;
         }
-        if (es->flag[FT_Overflow] == false)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+        captureLea(c, instr, es, &vres);
+        // may overwrite a state needed for correct capturing
+        setOpValue(&vres, es, &(instr->dst));
+        setOpState(&vres, es, &(instr->dst));
         break;
 
-    case IT_JC:
-        if (msIsDynamic(es->flag_state[FT_Carry])) {
-            captureJcc(c, IT_JC, instr->dst.val, instr->addr + instr->len);
+    default:assert(0);
+    }
+}
+
+static
+void emulateLeave(RContext* c, Instr* instr)
+{
+    // leave = mov rbp,rsp + pop rbp
+    Instr i;
+    Operand src, dst;
+
+    (void) instr;
+
+    // mov rbp,rsp (restore stack pointer)
+    copyOperand( &src, getRegOp(getReg(RT_GP64, RI_BP)) );
+    copyOperand( &dst, getRegOp(getReg(RT_GP64, RI_SP)) );
+    initBinaryInstr(&i, IT_MOV, VT_None, &dst, &src);
+    processInstr(c, &i);
+    if (c->e) return; // error
+
+    // pop rbp
+    initUnaryInstr(&i, IT_POP, getRegOp(getReg(RT_GP64, RI_BP)));
+    processInstr(c, &i);
+    if (c->e) return; // error
+}
+
+static
+void emulateMov(RContext* c, Instr* instr)
+{
+    EmuValue vres;
+
+    EmuState* es = c->r->es;
+
+    ValType dst_t = opValType(&(instr->dst));
+    instr->getSrc(c, &vres, &(instr->src));
+
+    switch(instr->src.type) {
+    case OT_Reg8:
+    case OT_Ind8:
+    case OT_Imm8:
+        switch (dst_t) {
+        case VT_8:
+            break;
+        case VT_16:
+            vres.val = (int16_t) (int8_t) vres.val;
+            vres.type = VT_16;
+            break;
+        case VT_32:
+            vres.val = (int32_t) (int8_t) vres.val;
+            vres.type = VT_32;
+            break;
+        case VT_64:
+            vres.val = (int64_t) (int8_t) vres.val;
+            vres.type = VT_64;
+            break;
+        default:
+            assert(0);
         }
-        if (es->flag[FT_Carry] == true)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
         break;
 
-    case IT_JNC:
-        if (msIsDynamic(es->flag_state[FT_Carry])) {
-            captureJcc(c, IT_JNC, instr->dst.val, instr->addr + instr->len);
+    case OT_Reg16:
+    case OT_Ind16:
+    case OT_Imm16:
+        switch (dst_t) {
+        case VT_16:
+            break;
+        case VT_32:
+            vres.val = (int32_t) (int16_t) vres.val;
+            vres.type = VT_32;
+            break;
+        case VT_64:
+            vres.val = (int64_t) (int16_t) vres.val;
+            vres.type = VT_64;
+            break;
+        default:
+            assert(0);
         }
-        if (es->flag[FT_Carry] == false)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
         break;
 
-    case IT_JZ:
-        if (msIsDynamic(es->flag_state[FT_Zero])) {
-            captureJcc(c, IT_JZ, instr->dst.val, instr->addr + instr->len);
+    case OT_Reg32:
+    case OT_Ind32:
+    case OT_Imm32:
+        assert(dst_t == VT_32 || dst_t == VT_64);
+        if (dst_t == VT_64) {
+            // also a regular mov may sign-extend: imm32->64
+            // assert(instr->type == IT_MOVSX);
+            // sign extend lower 32 bit to 64 bit
+            vres.val = (int64_t) (int32_t) vres.val;
+            vres.type = VT_64;
         }
-        if (es->flag[FT_Zero] == true)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
         break;
 
-    case IT_JNZ:
-        if (msIsDynamic(es->flag_state[FT_Zero])) {
-            captureJcc(c, IT_JNZ, instr->dst.val, instr->addr + instr->len);
-        }
-        if (es->flag[FT_Zero] == false)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+    case OT_Reg64:
+    case OT_Ind64:
+    case OT_Imm64:
+        assert(dst_t == VT_64);
         break;
 
-    case IT_JBE:
-        if (msIsDynamic(es->flag_state[FT_Carry]) ||
-            msIsDynamic(es->flag_state[FT_Zero])) {
-            captureJcc(c, IT_JLE, instr->dst.val, instr->addr + instr->len);
-        }
-        if ((es->flag[FT_Carry] == true) ||
-            (es->flag[FT_Zero] == true))
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    captureMov(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
+
+static
+void emulateNop(RContext* c, Instr* instr)
+{
+    // nothing to do
+    (void) c;
+    (void) instr;
+}
+
+static
+void emulateNeg(RContext* c, Instr* instr)
+{
+    EmuValue v0, v1;
+
+    EmuState* es = c->r->es;
+
+    instr->getDst(c, &v1, &(instr->dst));
+    // flags as for "0 - v1"
+    v0 = staticEmuValue(0, v1.type);
+    setFlagsSub(es, &v0, &v1);
+    switch(instr->dst.type) {
+    case OT_Reg32:
+    case OT_Ind32:
+        v1.val = (uint32_t)(- ((int32_t) v1.val));
         break;
 
-    case IT_JA:
-        if (msIsDynamic(es->flag_state[FT_Carry]) ||
-            msIsDynamic(es->flag_state[FT_Zero])) {
-            captureJcc(c, IT_JG, instr->dst.val, instr->addr + instr->len);
-        }
-        if ((es->flag[FT_Carry] == false) &&
-            (es->flag[FT_Zero] == false))
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+
+    case OT_Reg64:
+    case OT_Ind64:
+        v1.val = (uint64_t)(- ((int64_t) v1.val));
         break;
 
-    case IT_JS:
-        if (msIsDynamic(es->flag_state[FT_Sign])) {
-            captureJcc(c, IT_JS, instr->dst.val, instr->addr + instr->len);
-        }
-        if (es->flag[FT_Sign] == true)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+    captureUnaryOp(c, instr, es, &v1);
+    setOpValue(&v1, es, &(instr->dst));
+    setOpState(&v1, es, &(instr->dst));
+}
+
+static
+void emulatePop(RContext* c, Instr* instr)
+{
+    EmuValue v1, addr;
+
+    EmuState* es = c->r->es;
+
+    switch(instr->dst.type) {
+    case OT_Reg16:
+        addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
+        getMemValue(c, &v1, &addr, VT_16, 1);
+        setOpValue(&v1, es, &(instr->dst));
+        setOpState(&v1, es, &(instr->dst));
+        es->reg[RI_SP] += 2;
+        if (!msIsStatic(v1.state))
+            capture(c, instr);
         break;
 
-    case IT_JNS:
-        if (msIsDynamic(es->flag_state[FT_Sign])) {
-            captureJcc(c, IT_JNS, instr->dst.val, instr->addr + instr->len);
-        }
-        if (es->flag[FT_Sign] == false)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+    case OT_Reg64:
+        addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
+        getMemValue(c, &v1, &addr, VT_64, 1);
+        setOpValue(&v1, es, &(instr->dst));
+        setOpState(&v1, es, &(instr->dst));
+        es->reg[RI_SP] += 8;
+        if (!msIsStatic(v1.state))
+            capture(c, instr);
         break;
 
-    case IT_JP:
-        if (msIsDynamic(es->flag_state[FT_Parity])) {
-            captureJcc(c, IT_JP, instr->dst.val, instr->addr + instr->len);
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+}
+
+static
+void emulatePush(RContext* c, Instr* instr)
+{
+    EmuValue vres, addr;
+
+    EmuState* es = c->r->es;
+
+    // emulated stack must not overflow
+    if (es->reg[RI_SP] - 8 < es->stackStart) {
+        setEmulatorError(c, instr, ET_BufferOverflow,
+                         "Emulated stack overflow");
+        return;
+    }
+
+    switch(instr->dst.type) {
+    case OT_Ind16:
+    case OT_Reg16:
+    case OT_Imm16:
+        es->reg[RI_SP] -= 2;
+        addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
+        instr->getDst(c, &vres, &(instr->dst));
+        setMemValue(&vres, &addr, es, VT_16, 1);
+        setMemState(es, &addr, VT_16, vres.state, vres.parDep, 1);
+        if (!msIsStatic(vres.state))
+            capture(c, instr);
+        break;
+
+    case OT_Ind64:
+    case OT_Reg64:
+    case OT_Imm64:
+    case OT_Imm8:
+    case OT_Imm32:
+        es->reg[RI_SP] -= 8;
+        addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
+        instr->getDst(c, &vres, &(instr->dst));
+
+        // Sign-extend 8-bit and 32-bit immediate values to 64-bit
+        switch(vres.type) {
+        case VT_8:
+            vres.val = (int64_t) (int8_t) vres.val;
+            break;
+        case VT_32:
+            vres.val = (int64_t) (int32_t) vres.val;
+            break;
+        case VT_64:
+            break;
+        default:
+            assert(0);
         }
-        if (es->flag[FT_Parity] == true)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
-        break;
 
-    case IT_JNP:
-        if (msIsDynamic(es->flag_state[FT_Parity])) {
-            captureJcc(c, IT_JNP, instr->dst.val, instr->addr + instr->len);
-        }
-        if (es->flag[FT_Parity] == false)
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
+        vres.type = VT_64;
+        setMemValue(&vres, &addr, es, VT_64, 1);
+        setMemState(es, &addr, VT_64, vres.state, vres.parDep, 1);
+        if (!msIsStatic(vres.state))
+            capture(c, instr);
         break;
 
-    case IT_JLE:
-        if (msIsDynamic(es->flag_state[FT_Zero]) ||
-            msIsDynamic(es->flag_state[FT_Sign])) {
-            captureJcc(c, IT_JLE, instr->dst.val, instr->addr + instr->len);
-        }
-        if ((es->flag[FT_Zero] == true) ||
-            (es->flag[FT_Sign] == true)) c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
-        break;
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
+}
 
-    case IT_JG:
-        if (msIsDynamic(es->flag_state[FT_Zero]) ||
-            msIsDynamic(es->flag_state[FT_Sign])) {
-            captureJcc(c, IT_JG, instr->dst.val, instr->addr + instr->len);
-        }
-        if ((es->flag[FT_Zero] == false) &&
-            (es->flag[FT_Sign] == false)) c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
-        break;
+static
+void emulateShift(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1, v2;
+    CaptureState cs;
+    ValType vt;
 
-    case IT_JL:
-        if (msIsDynamic(es->flag_state[FT_Sign]) ||
-            msIsDynamic(es->flag_state[FT_Overflow])) {
-            captureJcc(c, IT_JL, instr->dst.val, instr->addr + instr->len);
-        }
-        if (es->flag[FT_Sign] != es->flag[FT_Overflow])
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
-        break;
+    EmuState* es = c->r->es;
 
-    case IT_JGE:
-        if (msIsDynamic(es->flag_state[FT_Sign]) ||
-            msIsDynamic(es->flag_state[FT_Overflow])) {
-            captureJcc(c, IT_JGE, instr->dst.val, instr->addr + instr->len);
+    // FIXME: do flags (shifting into CF, set OF)
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
+
+    vt = opValType(&(instr->dst));
+    vres.type = vt;
+    cs = combineState(v1.state.cState, v2.state.cState, 0);
+    initValueState(&vres, cs);
+    switch(vt) {
+    case VT_8:
+        switch (instr->type) {
+        case IT_SHL: vres.val = (uint8_t) (v1.val << (v2.val & 7)); break;
+        case IT_SHR: vres.val = (uint8_t) (v1.val >> (v2.val & 7)); break;
+        case IT_SAR:
+            vres.val = (uint8_t) ((int8_t)v1.val >> (v2.val & 7)); break;
+        default: assert(0);
         }
-        if (es->flag[FT_Sign] == es->flag[FT_Overflow])
-            c->exit = instr->dst.val;
-        else
-            c->exit = instr->addr + instr->len;
         break;
 
-    case IT_JMP:
-        if (instr->dst.type != OT_Imm64) {
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
+    case VT_16:
+        switch (instr->type) {
+        case IT_SHL: vres.val = (uint16_t) (v1.val << (v2.val & 15)); break;
+        case IT_SHR: vres.val = (uint16_t) (v1.val >> (v2.val & 15)); break;
+        case IT_SAR:
+            vres.val = (uint16_t) ((int16_t)v1.val >> (v2.val & 15)); break;
+        default: assert(0);
         }
-
-        // address to jump to
-        c->exit = instr->dst.val;
         break;
 
-    case IT_JMPI:
-        getOpValue(c, &v1, &(instr->dst));
-
-        switch(instr->dst.type) {
-        case OT_Reg64: break;
-        case OT_Ind64:
-            getOpAddr(&v2, es, &(instr->dst));
-            if (msIsStatic(v2.state)) {
-                // Assume indirect jump with target at constant address
-                // in memory to be constant: follow resolved PLT entries
-                v1.state.cState = CS_STATIC;
-            }
-            break;
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
+    case VT_32:
+        switch (instr->type) {
+        case IT_SHL: vres.val = (uint32_t) (v1.val << (v2.val & 31)); break;
+        case IT_SHR: vres.val = (uint32_t) (v1.val >> (v2.val & 31)); break;
+        case IT_SAR:
+            vres.val = (uint32_t) ((int32_t)v1.val >> (v2.val & 31)); break;
+        default: assert(0);
         }
+        break;
 
-        if (!msIsStatic(v1.state)) {
-            // call target must be known
-            setEmulatorError(c, instr, ET_BufferOverflow,
-                             "Call to unknown target not supported");
-            return;
+    case VT_64:
+        switch (instr->type) {
+        case IT_SHL: vres.val = v1.val << (v2.val & 63); break;
+        case IT_SHR: vres.val = v1.val >> (v2.val & 63); break;
+        case IT_SAR: vres.val = ((int64_t)v1.val >> (v2.val & 63)); break;
+        default: assert(0);
         }
-        c->exit = v1.val; // address to jump to
-        break;
-
-    case IT_LEA:
-        switch(instr->dst.type) {
-        case OT_Reg32:
-        case OT_Reg64:
-            assert(opIsInd(&(instr->src)));
-            getOpAddr(&vres, es, &(instr->src));
-            if (opValType(&(instr->dst)) == VT_32) {
-                vres.val = (uint32_t) vres.val;
-                vres.type = VT_32;
-            }
-            captureLea(c, instr, es, &vres);
-            // may overwrite a state needed for correct capturing
-            setOpValue(&vres, es, &(instr->dst));
-            setOpState(vres.state, es, &(instr->dst));
-            break;
-
-        default:assert(0);
+        // Some weird trickery for handling flags. TODO: generalize.
+        if (v2.val & 63) {
+            es->flag[FT_Zero] = vres.val == 0;
+            es->flagsPending &= ~FS_Zero;
+            initMetaState(&(es->flag_state[FT_Zero]), cs);
         }
+        setAffineDep(c, instr->type, &vres, &v1, &v2);
         break;
 
-    case IT_LEAVE: {
-        // leave = mov rbp,rsp + pop rbp
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
+    }
 
-        Instr i;
-        Operand src, dst;
+    captureBinaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
 
-        // mov rbp,rsp (restore stack pointer)
-        copyOperand( &src, getRegOp(getReg(RT_GP64, RI_BP)) );
-        copyOperand( &dst, getRegOp(getReg(RT_GP64, RI_SP)) );
-        initBinaryInstr(&i, IT_MOV, VT_None, &dst, &src);
-        processInstr(c, &i);
-        if (c->e) return; // error
+static
+void emulateSub(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1, v2;
+    CaptureState cs;
+    ValType vt;
 
-        // pop rbp
-        initUnaryInstr(&i, IT_POP, getRegOp(getReg(RT_GP64, RI_BP)));
-        processInstr(c, &i);
-        if (c->e) return; // error
-        break;
-    }
+    EmuState* es = c->r->es;
 
-    case IT_MOV:
-    case IT_MOVSX: { // converting move
-        ValType dst_t = opValType(&(instr->dst));
-        getOpValue(c, &vres, &(instr->src));
-
-        switch(instr->src.type) {
-        case OT_Reg8:
-        case OT_Ind8:
-        case OT_Imm8:
-            switch (dst_t) {
-            case VT_8:
-                break;
-            case VT_16:
-                vres.val = (int16_t) (int8_t) vres.val;
-                vres.type = VT_16;
-                break;
-            case VT_32:
-                vres.val = (int32_t) (int8_t) vres.val;
-                vres.type = VT_32;
-                break;
-            case VT_64:
-                vres.val = (int64_t) (int8_t) vres.val;
-                vres.type = VT_64;
-                break;
-            default:
-                assert(0);
-            }
-            break;
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
 
-        case OT_Reg16:
-        case OT_Ind16:
-        case OT_Imm16:
-            switch (dst_t) {
-            case VT_16:
-                break;
-            case VT_32:
-                vres.val = (int32_t) (int16_t) vres.val;
-                vres.type = VT_32;
-                break;
-            case VT_64:
-                vres.val = (int64_t) (int16_t) vres.val;
-                vres.type = VT_64;
-                break;
-            default:
-                assert(0);
-            }
-            break;
+    vt = opValType(&(instr->dst));
+    // sign-extend src/v2 if needed
+    if (instr->src.type == OT_Imm8) {
+        // sign-extend to 64bit (may be cutoff later)
+        v2.val = (int64_t) (int8_t) v2.val;
+        v2.type = vt;
+    }
+    else if (instr->src.type == OT_Imm32 && vt == VT_64) {
+        // sign-extend to 64bit (may be cutoff later)
+        v2.val = (int64_t) (int32_t) v2.val;
+        v2.type = vt;
+    }
 
-        case OT_Reg32:
-        case OT_Ind32:
-        case OT_Imm32:
-            assert(dst_t == VT_32 || dst_t == VT_64);
-            if (dst_t == VT_64) {
-                // also a regular mov may sign-extend: imm32->64
-                // assert(instr->type == IT_MOVSX);
-                // sign extend lower 32 bit to 64 bit
-                vres.val = (int64_t) (int32_t) vres.val;
-                vres.type = VT_64;
-            }
-            break;
+    setFlagsSub(es, &v1, &v2);
+    assert(v1.type == v2.type);
 
-        case OT_Reg64:
-        case OT_Ind64:
-        case OT_Imm64:
-            assert(dst_t == VT_64);
-            break;
+    switch(vt) {
+    case VT_32:
+        vres.val = ((uint32_t) v1.val - (uint32_t) v2.val);
+        break;
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
-        captureMov(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
+    case VT_64:
+        vres.val = v1.val - v2.val;
         break;
+
+    default:
+        setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
+        return;
     }
+    vres.type = vt;
+    cs = combineState(v1.state.cState, v2.state.cState, 0);
+    initValueState(&vres, cs);
+    setAffineDep(c, IT_SUB, &vres, &v1, &v2);
+    // for capturing we need state of original dst, do before setting dst
+    captureBinaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
 
-    case IT_NOP:
-        // nothing to do
-        break;
+static
+void emulateTest(RContext* c, Instr* instr)
+{
+    EmuValue v1, v2;
+    CaptureState cs;
 
-    case IT_NEG:
-        getOpValue(c, &v1, &(instr->dst));
-        switch(instr->dst.type) {
-        case OT_Reg32:
-        case OT_Ind32:
-            v1.val = (uint32_t)(- ((int32_t) v1.val));
-            break;
+    EmuState* es = c->r->es;
 
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
 
-        case OT_Reg64:
-        case OT_Ind64:
-            v1.val = (uint64_t)(- ((int64_t) v1.val));
-            break;
+    assert(v1.type == v2.type);
+    cs = setFlagsBit(es, IT_AND, &v1, &v2, false);
+    captureTest(c, instr, es, cs);
+}
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
-        captureUnaryOp(c, instr, es, &v1);
-        setOpValue(&v1, es, &(instr->dst));
-        setOpState(v1.state, es, &(instr->dst));
-        break;
+static
+void emulateBitOp(RContext* c, Instr* instr)
+{
+    EmuValue vres, v1, v2;
+    CaptureState cs;
 
+    EmuState* es = c->r->es;
 
-    case IT_POP:
-        switch(instr->dst.type) {
-        case OT_Reg16:
-            addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
-            getMemValue(c, &v1, &addr, VT_16, 1);
-            setOpValue(&v1, es, &(instr->dst));
-            setOpState(v1.state, es, &(instr->dst));
-            es->reg[RI_SP] += 2;
-            if (!msIsStatic(v1.state))
-                capture(c, instr);
-            break;
+    instr->getDst(c, &v1, &(instr->dst));
+    instr->getSrc(c, &v2, &(instr->src));
 
-        case OT_Reg64:
-            addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
-            getMemValue(c, &v1, &addr, VT_64, 1);
-            setOpValue(&v1, es, &(instr->dst));
-            setOpState(v1.state, es, &(instr->dst));
-            es->reg[RI_SP] += 8;
-            if (!msIsStatic(v1.state))
-                capture(c, instr);
-            break;
+    assert(v1.type == v2.type);
+    cs = setFlagsBit(es, instr->type, &v1, &v2,
+                     opIsEqual(&(instr->dst), &(instr->src)));
+    switch(instr->type) {
+    case IT_AND: vres.val = v1.val & v2.val; break;
+    case IT_XOR: vres.val = v1.val ^ v2.val; break;
+    case IT_OR:  vres.val = v1.val | v2.val; break;
+    default: assert(0);
+    }
+    vres.type = v1.type;
+    initValueState(&vres, cs);
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
-        break;
+    // for capturing we need state of original dst
+    captureBinaryOp(c, instr, es, &vres);
+    setOpValue(&vres, es, &(instr->dst));
+    setOpState(&vres, es, &(instr->dst));
+}
 
-    case IT_PUSH:
-        switch(instr->dst.type) {
-        case OT_Ind16:
-        case OT_Reg16:
-        case OT_Imm16:
-            es->reg[RI_SP] -= 2;
-            addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
-            getOpValue(c, &vres, &(instr->dst));
-            setMemValue(&vres, &addr, es, VT_16, 1);
-            setMemState(es, &addr, VT_16, vres.state, 1);
-            if (!msIsStatic(vres.state))
-                capture(c, instr);
-            break;
+static
+void emulateUnsupported(RContext* c, Instr* instr)
+{
+    setEmulatorError(c, instr, ET_UnsupportedInstr, 0);
+}
 
-        case OT_Ind64:
-        case OT_Reg64:
-        case OT_Imm64:
-        case OT_Imm8:
-        case OT_Imm32:
-            es->reg[RI_SP] -= 8;
-            addr = emuValue(es->reg[RI_SP], VT_64, es->reg_state[RI_SP]);
-            getOpValue(c, &vres, &(instr->dst));
-
-            // Sign-extend 8-bit and 32-bit immediate values to 64-bit
-            switch(vres.type) {
-            case VT_8:
-                vres.val = (int64_t) (int8_t) vres.val;
-                break;
-            case VT_32:
-                vres.val = (int64_t) (int32_t) vres.val;
-                break;
-            case VT_64:
-                break;
-            default:
-                assert(0);
-            }
+// memory addressing in captured instructions depends on emu state
+static
+void emulatePassThrough(RContext* c, Instr* instr)
+{
+    // vector registers read need to contain static values
+    loadStaticVRegs(c, instr, true);
+    capturePassThrough(c, instr, c->r->es);
+}
 
-            vres.type = VT_64;
-            setMemValue(&vres, &addr, es, VT_64, 1);
-            setMemState(es, &addr, VT_64, vres.state, 1);
-            if (!msIsStatic(vres.state))
-                capture(c, instr);
-            break;
+// SSE instructions: folded if inputs are static
+static
+void emulateVec(RContext* c, Instr* instr)
+{
+    if (processVec(c, instr)) return;
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
+    // no constant pool for static values: just capture
+    if (instr->ptLen > 0) {
+        emulatePassThrough(c, instr);
+        return;
+    }
+    switch(instr->type) {
+    case IT_ADDSS:
+    case IT_ADDSD:
+    case IT_ADDPS:
+    case IT_ADDPD:
+        captureVec(c, instr, c->r->es);
         break;
+    default:
+        emulateUnsupported(c, instr);
+    }
+}
 
-    case IT_RET:
-        emulateRet(c, instr);
-        break;
+// get the handler to emulate an instruction
+static
+EmuHandler getEmuHandler(Instr* instr)
+{
+    if (vecIsTracked(instr)) return emulateVec;
+    if (instr->ptLen > 0) return emulatePassThrough;
 
+    switch(instr->type) {
+    case IT_ADD:   return emulateAdd;
+    case IT_CALL:  return emulateCall;
+    case IT_CLTQ:  return emulateCltq;
+    case IT_CWTL:  return emulateCwtl;
+    case IT_CQTO:  return emulateCqto;
+    case IT_CMOVZ: case IT_CMOVNZ:
+    case IT_CMOVC: case IT_CMOVNC:
+    case IT_CMOVO: case IT_CMOVNO:
+    case IT_CMOVS: case IT_CMOVNS:
+        return emulateCMov;
+    case IT_CMP:   return emulateCmp;
+    case IT_DEC:   return emulateDec;
+    case IT_IMUL:  return emulateIMul;
+    case IT_IDIV1: return emulateIDiv;
+    case IT_INC:   return emulateInc;
+    case IT_JO:  case IT_JNO:
+    case IT_JC:  case IT_JNC:
+    case IT_JZ:  case IT_JNZ:
+    case IT_JBE: case IT_JA:
+    case IT_JS:  case IT_JNS:
+    case IT_JP:  case IT_JNP:
+    case IT_JLE: case IT_JG:
+    case IT_JL:  case IT_JGE:
+        return emulateJcc;
+    case IT_JMP:   return emulateJmp;
+    case IT_JMPI:  return emulateJmpi;
+    case IT_LEA:   return emulateLea;
+    case IT_LEAVE: return emulateLeave;
+    case IT_MOV:
+    case IT_MOVSX: return emulateMov;
+    case IT_NOP:   return emulateNop;
+    case IT_NEG:   return emulateNeg;
+    case IT_POP:   return emulatePop;
+    case IT_PUSH:  return emulatePush;
+    case IT_RET:   return emulateRet;
     case IT_SHL:
     case IT_SHR:
-    case IT_SAR:
-        // FIXME: do flags (shifting into CF, set OF)
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
+    case IT_SAR:   return emulateShift;
+    case IT_SUB:   return emulateSub;
+    case IT_TEST:  return emulateTest;
+    case IT_XOR:
+    case IT_OR:
+    case IT_AND:   return emulateBitOp;
+    case IT_ADDSS:
+    case IT_ADDSD:
+    case IT_ADDPS:
+    case IT_ADDPD: return emulateVec;
+    default: break;
+    }
+    return emulateUnsupported;
+}
 
-        vt = opValType(&(instr->dst));
-        vres.type = vt;
-        cs = combineState(v1.state.cState, v2.state.cState, 0);
-        initMetaState(&(vres.state), cs);
-        switch(vt) {
-        case VT_8:
-            switch (instr->type) {
-            case IT_SHL: vres.val = (uint8_t) (v1.val << (v2.val & 7)); break;
-            case IT_SHR: vres.val = (uint8_t) (v1.val >> (v2.val & 7)); break;
-            case IT_SAR:
-                vres.val = (uint8_t) ((int8_t)v1.val >> (v2.val & 7)); break;
-            default: assert(0);
-            }
-            break;
+// resolve handler and operand accessors used to emulate <instr>. This is
+// done once when decoding: emulating an instruction again (e.g. in
+// unrolled loops) directly dispatches to code for its operand types
+void prepareEmulation(Instr* instr)
+{
+    instr->handler = getEmuHandler(instr);
+    instr->getDst = getOpGetter(&(instr->dst));
+    instr->getSrc = getOpGetter(&(instr->src));
+    instr->getSrc2 = getOpGetter(&(instr->src2));
+}
 
-        case VT_16:
-            switch (instr->type) {
-            case IT_SHL: vres.val = (uint16_t) (v1.val << (v2.val & 15)); break;
-            case IT_SHR: vres.val = (uint16_t) (v1.val >> (v2.val & 15)); break;
-            case IT_SAR:
-                vres.val = (uint16_t) ((int16_t)v1.val >> (v2.val & 15)); break;
-            default: assert(0);
-            }
-            break;
+// capture-only mode: 32/64bit GP register (not stack pointer) with
+// dynamic value
+static
+bool opIsDynamicReg(EmuState* es, Operand* o)
+{
+    if ((o->type != OT_Reg32) && (o->type != OT_Reg64)) return false;
+    if (!regIsGP(o->reg) || (o->reg.ri == RI_SP)) return false;
+    return es->reg_state[o->reg.ri].cState == CS_DYNAMIC;
+}
 
-        case VT_32:
-            switch (instr->type) {
-            case IT_SHL: vres.val = (uint32_t) (v1.val << (v2.val & 31)); break;
-            case IT_SHR: vres.val = (uint32_t) (v1.val >> (v2.val & 31)); break;
-            case IT_SAR:
-                vres.val = (uint32_t) ((int32_t)v1.val >> (v2.val & 31)); break;
-            default: assert(0);
-            }
-            break;
+// capture-only mode: immediate not resulting in static result, and
+// not without effect (emulation removes such operations)
+static
+bool opIsDynamicImm(Instr* instr, Operand* o)
+{
+    int64_t v;
 
-        case VT_64:
-            switch (instr->type) {
-            case IT_SHL: vres.val = v1.val << (v2.val & 63); break;
-            case IT_SHR: vres.val = v1.val >> (v2.val & 63); break;
-            case IT_SAR: vres.val = ((int64_t)v1.val >> (v2.val & 63)); break;
-            default: assert(0);
-            }
-            // Some weird trickery for handling flags. TODO: generalize.
-            if (v2.val & 63) {
-                es->flag[FT_Zero] = vres.val == 0;
-                initMetaState(&(es->flag_state[FT_Zero]), cs);
-            }
-            break;
+    if (!opIsImm(o)) return false;
+    v = (o->type == OT_Imm8) ? (int8_t) o->val : (int64_t) o->val;
+    switch(instr->type) {
+    case IT_AND:  return (v != 0) && (v != -1);
+    case IT_IMUL: return (v != 0) && (v != 1);
+    case IT_ADD: case IT_SUB:
+    case IT_OR:  case IT_XOR:
+        return v != 0;
+    default: break;
+    }
+    return true;
+}
 
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
+// capture-only mode: if all inputs of <instr> are dynamic, capture it
+// as-is and only update states of outputs, without emulating it.
+// Returns false if the instruction needs to be emulated
+static
+bool captureDynamicOnly(RContext* c, Instr* instr)
+{
+    EmuState* es = c->r->es;
+    bool dstIsInput = true;
+    int flagSet = FS_CZSOP;
 
-        captureBinaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
+    // affine expressions need emulation of arithmetic
+    if (affineAnalysis(c->r)) return false;
 
+    switch(instr->type) {
+    case IT_MOV:
+        dstIsInput = false;
+        flagSet = 0;
+        break;
+    case IT_IMUL:
+        // TODO: 3-operand form (not supported by generator)
+        if (instr->form != OF_2) return false;
+        break;
+    case IT_INC:
+    case IT_DEC:
+        flagSet = FS_ZSP | FS_Overflow;
+        break;
+    case IT_XOR:
     case IT_SUB:
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
-
-        vt = opValType(&(instr->dst));
-        // sign-extend src/v2 if needed
-        if (instr->src.type == OT_Imm8) {
-            // sign-extend to 64bit (may be cutoff later)
-            v2.val = (int64_t) (int8_t) v2.val;
-            v2.type = vt;
-        }
-        else if (instr->src.type == OT_Imm32 && vt == VT_64) {
-            // sign-extend to 64bit (may be cutoff later)
-            v2.val = (int64_t) (int32_t) v2.val;
-            v2.type = vt;
-        }
-
-        setFlagsSub(es, &v1, &v2);
-        assert(v1.type == v2.type);
-
-        switch(vt) {
-        case VT_32:
-            vres.val = ((uint32_t) v1.val - (uint32_t) v2.val);
-            break;
-
-        case VT_64:
-            vres.val = v1.val - v2.val;
-            break;
-
-        default:
-            setEmulatorError(c, instr, ET_UnsupportedOperands, 0);
-            return;
-        }
-        vres.type = vt;
-        cs = combineState(v1.state.cState, v2.state.cState, 0);
-        initMetaState(&(vres.state), cs);
-        // for capturing we need state of original dst, do before setting dst
-        captureBinaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
+        // xor/sub with same operands results in known zero
+        if (opIsEqual(&(instr->dst), &(instr->src))) return false;
+        if (instr->type == IT_XOR) flagSet = FS_ZSP;
         break;
-
-    case IT_TEST:
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
-
-        assert(v1.type == v2.type);
-        cs = setFlagsBit(es, IT_AND, &v1, &v2, false);
-        captureTest(c, instr, es, cs);
+    case IT_AND: case IT_OR: case IT_TEST:
+        // carry/overflow always cleared
+        flagSet = FS_ZSP;
+        break;
+    case IT_NEG:
+    case IT_ADD: case IT_CMP:
         break;
+    default:
+        return false;
+    }
 
-    case IT_XOR:
-    case IT_OR:
-    case IT_AND:
-        getOpValue(c, &v1, &(instr->dst));
-        getOpValue(c, &v2, &(instr->src));
+    if (dstIsInput) {
+        if (!opIsDynamicReg(es, &(instr->dst))) return false;
+    }
+    else {
+        if (!opIsGPReg(&(instr->dst)) || (instr->dst.reg.ri == RI_SP) ||
+            (opValType(&(instr->dst)) < VT_32))
+            return false;
+    }
+    // immediate allowed only in combination with a dynamic input
+    if ((instr->form == OF_2) || (instr->form == OF_3)) {
+        if (!opIsDynamicReg(es, &(instr->src)) &&
+            !(dstIsInput && opIsDynamicImm(instr, &(instr->src))))
+            return false;
+    }
 
-        assert(v1.type == v2.type);
-        cs = setFlagsBit(es, instr->type, &v1, &v2,
-                         opIsEqual(&(instr->dst), &(instr->src)));
-        switch(instr->type) {
-        case IT_AND: vres.val = v1.val & v2.val; break;
-        case IT_XOR: vres.val = v1.val ^ v2.val; break;
-        case IT_OR:  vres.val = v1.val | v2.val; break;
-        default: assert(0);
-        }
-        vres.type = v1.type;
-        initMetaState(&(vres.state), cs);
+    capture(c, instr);
+    if ((instr->type != IT_CMP) && (instr->type != IT_TEST))
+        initRegState(es, instr->dst.reg.ri, CS_DYNAMIC);
+    if (flagSet) {
+        setFlagsState(es, flagSet, CS_DYNAMIC);
+        es->flagsPending &= ~flagSet;
+    }
+    if (flagSet == FS_ZSP) {
+        es->flag[FT_Carry] = 0;
+        es->flag[FT_Overflow] = 0;
+        setFlagsState(es, FS_CO, CS_STATIC);
+        es->flagsPending &= ~FS_CO;
+    }
+    return true;
+}
 
-        // for capturing we need state of original dst
-        captureBinaryOp(c, instr, es, &vres);
-        setOpValue(&vres, es, &(instr->dst));
-        setOpState(vres.state, es, &(instr->dst));
-        break;
+// process an instruction
+// if this changes control flow, c.exit is set accordingly
+void processInstr(RContext* c, Instr* instr)
+{
+    // instructions not from the decoder (e.g. generated by the emulator)
+    // are prepared on first emulation
+    if (instr->handler == 0)
+        prepareEmulation(instr);
 
-    case IT_ADDSS:
-    case IT_ADDSD:
-    case IT_ADDPS:
-    case IT_ADDPD:
-        // just always capture without emulation
-        captureVec(c, instr, es);
-        break;
+    if (c->r->cc->capture_only && (instr->ptLen == 0) &&
+        captureDynamicOnly(c, instr))
+        return;
 
-    default:
-        setEmulatorError(c, instr, ET_UnsupportedInstr, 0);
-    }
+    (*instr->handler)(c, instr);
 }
 
 // process call or jump to known location
@@ -2837,6 +5698,17 @@ void processInstr(RContext* c, Instr* instr)
 uint64_t processKnownTargets(RContext* c, uint64_t f)
 {
     EmuState* es = c->r->es;
+    uint64_t target;
+
+    if (f == 0) return 0; // no exit from BB
+
+    // jumps into PLT entries directly go to the bound function
+    target = resolvePLT(f);
+    if (target != f) {
+        if (c->r->showEmuSteps)
+            printf("Resolved PLT entry %lx to %lx\n", f, target);
+        f = target;
+    }
 
     // special handling for known functions
     if ((f == (uint64_t) makeDynamic) &&
@@ -2847,11 +5719,11 @@ uint64_t processKnownTargets(RContext* c, uint64_t f)
                         getRegOp(getReg(RT_GP64, RI_DI)),
                         getImmOp(VT_64, es->reg[RI_DI]));
         capture(c, &i);
-        initMetaState(&(es->reg_state[RI_DI]), CS_DYNAMIC);
+        initRegState(es, RI_DI, CS_DYNAMIC);
     }
 
     if (f == (uint64_t) makeStatic) {
-        initMetaState(&(es->reg_state[RI_DI]), CS_STATIC2);
+        initRegState(es, RI_DI, CS_STATIC2);
     }
 
     // vector API
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "common.h"
 #include "printer.h"
@@ -49,6 +50,7 @@ Rewriter* allocRewriter(void)
     r->decBBCount = 0;
     r->decBBCapacity = 0;
     r->decBB = 0;
+    r->decEnd = 0;
 
     r->capInstrCount = 0;
     r->capInstrCapacity = 0;
@@ -60,21 +62,28 @@ Rewriter* allocRewriter(void)
     r->currentCapBB = 0;
     r->capStackTop = -1;
     r->genOrderCount = 0;
+    r->emuInstrCount = 0;
+    r->startTime = 0;
+    r->budgetExceeded = DBREW_BUDGET_NONE;
 
     r->savedStateCount = 0;
     for(i=0; i< SAVEDSTATE_MAX; i++)
         r->savedState[i] = 0;
+    for(i=0; i< SAVEDSTATE_HASHSIZE; i++)
+        r->savedStateBucket[i] = -1;
 
     r->capCodeCapacity = 0;
     r->cs = 0;
     r->generatedCodeAddr = 0;
     r->generatedCodeSize = 0;
+    r->constPool = 0;
 
     r->cc = 0;
     r->vreq = VR_None;
     r->vectorsize = 16;
     r->es = 0;
     r->next = 0;
+    r->cloneParStatic = -1;
     r->ePool = 0;
 
     // optimization passes
@@ -136,9 +145,43 @@ void initRewriter(Rewriter* r)
         r->generatedCodeAddr = 0;
         r->generatedCodeSize = 0;
     }
+    // constants only referenced by previously generated code
+    if (r->constPool)
+        r->constPool->used = 0;
+}
 
-    if (r->ePool == 0)
-        r->ePool = expr_allocPool(1000);
+static
+uint64_t timeUS(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// for DBREW_BUDGET_TIME_US, <used> is ignored
+bool checkBudget(RContext* c, DBrewBudget b, long used)
+{
+    static Error e;
+    static const char* desc[DBREW_BUDGET_MAX] = {
+        0,
+        "Budget for emulated instructions exceeded",
+        "Budget for emulation states exceeded",
+        "Budget for captured instructions exceeded",
+        "Budget for generated code size exceeded",
+        "Budget for rewrite time exceeded"
+    };
+    Rewriter* r = c->r;
+    long limit = r->cc ? r->cc->budget[b] : 0;
+
+    if (limit == 0) return true;
+    if (b == DBREW_BUDGET_TIME_US)
+        used = (long) (timeUS() - r->startTime);
+    if (used <= limit) return true;
+
+    r->budgetExceeded = b;
+    setError(&e, ET_BudgetExceeded, EM_Rewriter, r, desc[b]);
+    c->e = &e;
+    return false;
 }
 
 void freeRewriter(Rewriter* r)
@@ -149,13 +192,23 @@ void freeRewriter(Rewriter* r)
     free(r->decBB);
     free(r->capInstr);
     free(r->capBB);
-    free(r->cc);
+    config_free(r);
 
     freeEmuState(r);
     if (r->cs)
         freeCodeStorage(r->cs);
+    if (r->constPool)
+        freeCodeStorage(r->constPool);
     expr_freePool(r->ePool);
 
+    // related rewriters generated code used by code of this one
+    while(r->next) {
+        Rewriter* rr = r->next;
+        r->next = rr->next;
+        rr->next = 0;
+        freeRewriter(rr);
+    }
+
     free(r);
 }
 
@@ -173,18 +226,22 @@ void freeRewriter(Rewriter* r)
 
 /* See dbrew_emulate to see how to call this from a function
  * which acts almost as drop-in replacement (only one additional par).
+ * Parameter values in <par> are bit patterns according to configured
+ * parameter types (see vGetParameters).
  *
  * The state can be accessed as c->es afterwards (e.g. for the return
  * value of the emulated function)
  */
-static
 Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par)
 {
-    // calling convention x86-64: parameters are stored in registers
+    // calling convention x86-64: integer parameters are passed in
+    // registers, floating point in xmm0-7, all others on the stack
     // see https://en.wikipedia.org/wiki/X86_calling_conventions
     static RegIndex parReg[6] = { RI_DI, RI_SI, RI_D, RI_C, RI_8, RI_9 };
 
     int i, esID;
+    int gpCount, vCount, stackCount;
+    EmuValue stackVal[CC_MAXPARAM];
     EmuState* es;
     DBB *dbb;
     CBB *cbb;
@@ -195,29 +252,79 @@ Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par)
     // init context
     cxt.r = r;
     cxt.e = 0;
+    cxt.dbb = 0;
 
     if (!r->es)
-        r->es = allocEmuState(1024);
+        r->es = allocEmuState(16384);
+    setEmuAnalysis(r->es, !r->cc || (r->cc->analysis != DBREW_ANALYSIS_NONE));
     resetEmuState(r->es);
     es = r->es;
+    es->shadowMemory = r->cc ? r->cc->shadow_memory : false;
 
     resetCapturing(r);
     if (r->cs)
         r->cs->used = 0;
-
+    // expressions are only referenced by emulator states of previous runs,
+    // pool only needed if analysis is enabled
+    if (r->ePool)
+        expr_resetPool(r->ePool);
+    else if (!r->cc || (r->cc->analysis != DBREW_ANALYSIS_NONE))
+        r->ePool = expr_allocPool(1000);
+    r->emuInstrCount = 0;
+    if (r->cc)
+        config_reset_inline_counts(r);
+    r->startTime = timeUS();
+    r->budgetExceeded = DBREW_BUDGET_NONE;
+
+    assert(parCount <= CC_MAXPARAM);
+    gpCount = 0;
+    vCount = 0;
+    stackCount = 0;
     for(i=0;i<parCount;i++) {
-        MetaState* ms = &(es->reg_state[parReg[i]]);
-        es->reg[parReg[i]] = par[i];
-        if (r->cc && (i<CC_MAXPARAM))
-            *ms = r->cc->par_state[i];
-        else
-            initMetaState(ms, CS_DYNAMIC);
+        DBrewParType t = r->cc ? r->cc->par_type[i] : DBREW_PAR_INT;
+        MetaState ms;
+        ExprNode* dep = 0;
 
-        ms->parDep = expr_newPar(r->ePool, i,
-                                 r->cc ? r->cc->par_name[i] : 0);
+        if (r->cc)
+            ms = r->cc->par_state[i];
+        else
+            initMetaState(&ms, CS_DYNAMIC);
+        if (!r->cc || (r->cc->analysis != DBREW_ANALYSIS_NONE))
+            dep = expr_newPar(r->ePool, i, r->cc ? r->cc->par_name[i] : 0);
+
+        if ((t == DBREW_PAR_INT) && (gpCount < 6)) {
+            es->reg[parReg[gpCount]] = par[i];
+            es->reg_state[parReg[gpCount]] = ms;
+            if (es->regDep)
+                es->regDep[parReg[gpCount]] = dep;
+            gpCount++;
+        }
+        else if ((t != DBREW_PAR_INT) && (vCount < 8)) {
+            // value in lower lanes, upper lanes unknown
+            RegIndex ri = (RegIndex) (RI_XMM0 + vCount);
+            int lanes = (t == DBREW_PAR_DOUBLE) ? 2 : 1;
+            for(int j = 0; j < lanes; j++) {
+                es->vreg[ri][j] = (uint32_t) (par[i] >> (32 * j));
+                es->vreg_state[ri][j] = ms.cState;
+            }
+            vCount++;
+        }
+        else {
+            stackVal[stackCount].val = par[i];
+            stackVal[stackCount].type = VT_64;
+            stackVal[stackCount].state = ms;
+            stackVal[stackCount].parDep = dep;
+            stackCount++;
+        }
     }
 
+    // further parameters are passed on the stack above return address
+    for(i = 0; i < stackCount; i++)
+        setStackArg(es, 8 * (stackCount - i), &(stackVal[i]));
     es->reg[RI_SP] = (uint64_t) (es->stackStart + es->stackSize);
+    // with stack parameters, reserve slot for return address below them
+    if (stackCount > 0)
+        es->reg[RI_SP] -= 8 * (stackCount + 1);
     initMetaState(&(es->reg_state[RI_SP]), CS_STACKRELATIVE);
 
     // traverse all paths and generate CBBs
@@ -285,6 +392,7 @@ Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par)
         // decode and process instructions starting at bb_addr.
         // note: multiple original BBs may be combined into one CBB
         dbb = dbrew_decode(r, bb_addr);
+        cxt.dbb = dbb;
         for(i = 0; i < dbb->count; i++) {
             instr = dbb->instr + i;
 
@@ -297,7 +405,13 @@ Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par)
             es->regIP = instr->addr + instr->len;
 
             cxt.exit = 0;
+            r->emuInstrCount++;
             processInstr(&cxt, instr);
+            if (!cxt.e &&
+                checkBudget(&cxt, DBREW_BUDGET_EMU_INSTRS, r->emuInstrCount) &&
+                checkBudget(&cxt, DBREW_BUDGET_CAP_INSTRS, r->capInstrCount) &&
+                ((r->emuInstrCount & 255) == 0))
+                checkBudget(&cxt, DBREW_BUDGET_TIME_US, 0);
             if (cxt.e) {
                 assert(isErrorSet(cxt.e));
                 r->capBBCount = 0;
@@ -334,11 +448,12 @@ Error* emulateAndCapture(Rewriter* r, int parCount, uint64_t* par)
     return 0;
 }
 
-Error* vEmulateAndCapture(Rewriter* r, va_list args)
+// get parameter values from <args> into <par> according to configured
+// types: bit patterns of floating point values are stored
+Error* vGetParameters(Rewriter* r, va_list args, uint64_t* par)
 {
     static Error e;
     int i, parCount;
-    uint64_t par[6];
 
     parCount = r->cc->parCount;
     if (parCount == -1) {
@@ -347,17 +462,37 @@ Error* vEmulateAndCapture(Rewriter* r, va_list args)
         return &e;
     }
 
-    if (parCount > 6) {
+    if (parCount > CC_MAXPARAM) {
         setError(&e, ET_InvalidRequest, EM_Rewriter, r,
-                 "number of parameters >6 not supported");
+                 "too many parameters");
         return &e;
     }
 
     for(i = 0; i < parCount; i++) {
-        par[i] = va_arg(args, uint64_t);
+        union { uint64_t i; double d; float f; } v;
+
+        v.i = 0;
+        switch(r->cc->par_type[i]) {
+        case DBREW_PAR_INT:    v.i = va_arg(args, uint64_t); break;
+        case DBREW_PAR_DOUBLE: v.d = va_arg(args, double); break;
+        // float is promoted to double in variadic calls
+        case DBREW_PAR_FLOAT:  v.f = (float) va_arg(args, double); break;
+        default: assert(0);
+        }
+        par[i] = v.i;
     }
+    return 0;
+}
+
+Error* vEmulateAndCapture(Rewriter* r, va_list args)
+{
+    uint64_t par[CC_MAXPARAM];
+    Error* e;
 
-    return emulateAndCapture(r, parCount, par);
+    e = vGetParameters(r, args, par);
+    if (e) return e;
+
+    return emulateAndCapture(r, r->cc->parCount, par);
 }
 
 
@@ -440,6 +575,10 @@ void generateBinaryFromCaptured(RContext *c)
     int usedPass0 = r->cs->used;
     int genOrder0 = r->genOrderCount;
 
+    // start address of generated code is known in advance (the first
+    // CBB ends up at buf0): needed for recursive calls
+    r->generatedCodeAddr = (uint64_t) buf0;
+
     assert(r->capStackTop == -1);
     assert(r->capBBCount > 0);
     // start with first CBB created
@@ -469,6 +608,10 @@ void generateBinaryFromCaptured(RContext *c)
             pushCaptureBB(c, cbb->nextFallThrough);
             if (c->e) return;
         }
+        else if (cbb->endType == IT_JMP) {
+            pushCaptureBB(c, cbb->nextFallThrough);
+            if (c->e) return;
+        }
 
         // add a hole with size maximally needed (shrinks in pass 2)
         // pc-relative Jcc (6) + PC-relative Jmp (5) + alignment (15) = 26
@@ -498,6 +641,14 @@ void generateBinaryFromCaptured(RContext *c)
             for(int j=0; j<cbb->size; j++)
                 dst[j] = src[j];
         }
+        if (cbb->endType == IT_JMP) {
+            // unconditional jump to next BB if not following
+            if (cbb->nextFallThrough != r->genOrder[i+1]) {
+                cbb->genJump = true;
+                buf1 += 5;
+            }
+            continue;
+        }
         if (!instrIsJcc(cbb->endType)) continue;
 
         diff = cbb->nextBranch->addr1 - (cbb->addr1 + cbb->size);
@@ -526,11 +677,14 @@ void generateBinaryFromCaptured(RContext *c)
         int diff;
 
         cbb = r->genOrder[i];
-        if (!instrIsJcc(cbb->endType)) continue;
+        if (!instrIsJcc(cbb->endType) && (cbb->endType != IT_JMP)) continue;
 
         buf = (uint8_t*) (cbb->addr2 + cbb->size);
         buf_addr = (uint64_t) buf;
-        if (cbb->genJcc8) {
+        if (cbb->endType == IT_JMP) {
+            // no conditional branch
+        }
+        else if (cbb->genJcc8) {
             diff = cbb->nextBranch->addr2 - (buf_addr + 2);
             assert((diff > -128) && (diff < 127));
 
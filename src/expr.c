@@ -20,8 +20,10 @@
 #include "expr.h"
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 ExprPool* expr_allocPool(int s)
 {
@@ -29,26 +31,23 @@ ExprPool* expr_allocPool(int s)
 
     p = (ExprPool*) malloc(sizeof(ExprPool) + s * sizeof(ExprNode));
     p->size = s;
-    p->used = 0;
+    p->hashNext = (int*) malloc(s * sizeof(int));
+    expr_resetPool(p);
     return p;
 }
 
 void expr_freePool(ExprPool* p)
 {
+    if (!p) return;
+    free(p->hashNext);
     free(p);
 }
 
-ExprNode* expr_newNode(ExprPool* p, NodeType t)
+void expr_resetPool(ExprPool* p)
 {
-    ExprNode* e;
-
-    assert(p && (p->used < p->size));
-    e = p->n + p->used;
-    e->p = p;
-    e->type = t;
-
-    p->used++;
-    return e;
+    p->used = 0;
+    for(int i = 0; i < EXPR_HASHSIZE; i++)
+        p->hashHead[i] = -1;
 }
 
 int expr_nodeIndex(ExprPool* p, ExprNode* n)
@@ -57,102 +56,237 @@ int expr_nodeIndex(ExprPool* p, ExprNode* n)
     return (int)(n - p->n);
 }
 
-ExprNode* expr_newConst(ExprPool* p, int val)
+static
+uint64_t nodeHash(ExprNode* e)
 {
-    ExprNode* e = expr_newNode(p, NT_Const);
-    e->ival = val;
+    uint64_t h = e->type;
+
+    h = h * 31 + (uint64_t) e->ival;
+    h = h * 31 + e->ptr;
+    h = h * 31 + (uint64_t) e->left;
+    h = h * 31 + (uint64_t) e->right;
+    for(int i = 0; (i < EN_NAMELEN) && e->name[i]; i++)
+        h = h * 31 + (uint64_t) e->name[i];
 
-    return e;
+    return h ^ (h >> 29);
 }
 
-ExprNode* expr_newPar(ExprPool* p, int no, char *n)
+static
+bool nodeIsEqual(ExprNode* e1, ExprNode* e2)
+{
+    return (e1->type == e2->type) && (e1->ival == e2->ival) &&
+           (e1->ptr == e2->ptr) && (e1->left == e2->left) &&
+           (e1->right == e2->right) &&
+           (strncmp(e1->name, e2->name, EN_NAMELEN) == 0);
+}
+
+// return node equal to <e> from pool, add a new one if not existing.
+// Returns 0 if the pool is full
+static
+ExprNode* getNode(ExprPool* p, ExprNode* e)
+{
+    int h = nodeHash(e) % EXPR_HASHSIZE;
+    ExprNode* n;
+    int i;
+
+    assert(p);
+    for(i = p->hashHead[h]; i >= 0; i = p->hashNext[i])
+        if (nodeIsEqual(p->n + i, e)) return p->n + i;
+
+    if (p->used >= p->size) return 0;
+
+    i = p->used++;
+    n = p->n + i;
+    *n = *e;
+    n->p = p;
+    p->hashNext[i] = p->hashHead[h];
+    p->hashHead[h] = i;
+
+    return n;
+}
+
+// template for a node of type <t>, with all attributes cleared
+static
+void initNode(ExprNode* e, NodeType t)
+{
+    memset(e, 0, sizeof(ExprNode));
+    e->type = t;
+}
+
+static
+void setNodeName(ExprNode* e, const char* n)
 {
-    ExprNode* e = expr_newNode(p, NT_Par);
-    e->ival = no;
+    int i = 0;
+
     if (n) {
-        int i = 0;
         while(n[i] && (i < EN_NAMELEN-1)) {
             e->name[i] = n[i];
             i++;
         }
-        e->name[i] = 0;
     }
-    else
-        e->name[0] = 0;
+    e->name[i] = 0;
+}
 
-    return e;
+ExprNode* expr_newConst(ExprPool* p, int val)
+{
+    ExprNode e;
+
+    initNode(&e, NT_Const);
+    e.ival = val;
+
+    return getNode(p, &e);
 }
 
+ExprNode* expr_newPar(ExprPool* p, int no, char *n)
+{
+    ExprNode e;
+
+    initNode(&e, NT_Par);
+    e.ival = no;
+    setNodeName(&e, n);
+
+    return getNode(p, &e);
+}
+
+static
+bool fitsInt(int64_t v)
+{
+    return v == (int) v;
+}
+
+// folding of constants keeps expressions small, e.g. for loop counters
 ExprNode* expr_newScaled(ExprPool* p, int factor, ExprNode* exp)
 {
-    ExprNode* e = expr_newNode(p, NT_Scaled);
-    e->ival = factor;
-    e->left = expr_nodeIndex(p, exp);
+    ExprNode e;
+    int64_t v;
+
+    if (!exp) return 0;
+    if (factor == 1) return exp;
+
+    switch(exp->type) {
+    case NT_Const:
+        v = (int64_t) factor * exp->ival;
+        return fitsInt(v) ? expr_newConst(p, (int) v) : 0;
+
+    case NT_Scaled:
+        v = (int64_t) factor * exp->ival;
+        if (!fitsInt(v)) return 0;
+        return expr_newScaled(p, (int) v, p->n + exp->left);
 
-    return e;
+    default: break;
+    }
+
+    initNode(&e, NT_Scaled);
+    e.ival = factor;
+    e.left = expr_nodeIndex(p, exp);
+
+    return getNode(p, &e);
 }
 
 ExprNode* expr_newRef(ExprPool* p, uint64_t ptr, char* n, ExprNode* idx)
 {
-    ExprNode* e = expr_newNode(p, NT_Ref);
-    e->ptr = ptr;
-    e->left = expr_nodeIndex(p, idx);
-    if (n) {
-        int i = 0;
-        while(n[i] && (i < EN_NAMELEN-1)) {
-            e->name[i] = n[i];
-            i++;
-        }
-        e->name[i] = 0;
-    }
-    else
-        e->name[0] = 0;
+    ExprNode e;
 
-    return e;
+    if (!idx) return 0;
+
+    initNode(&e, NT_Ref);
+    e.ptr = ptr;
+    e.left = expr_nodeIndex(p, idx);
+    setNodeName(&e, n);
+
+    return getNode(p, &e);
 }
 
 ExprNode* expr_newSum(ExprPool* p, ExprNode* left, ExprNode* right)
 {
-    ExprNode* e = expr_newNode(p, NT_Sum);
-    e->left = expr_nodeIndex(p, left);
-    e->right = expr_nodeIndex(p, right);
+    ExprNode e;
+
+    ExprNode* c;
+    int64_t v;
+
+    if (!left || !right) return 0;
+
+    // constants go to the right
+    if (left->type == NT_Const) {
+        c = left;
+        left = right;
+        right = c;
+    }
+    if (right->type == NT_Const) {
+        if (left->type == NT_Const) {
+            v = (int64_t) left->ival + right->ival;
+            return fitsInt(v) ? expr_newConst(p, (int) v) : 0;
+        }
+        if (right->ival == 0) return left;
+        c = p->n + left->right;
+        if ((left->type == NT_Sum) && (c->type == NT_Const)) {
+            v = (int64_t) c->ival + right->ival;
+            if (!fitsInt(v)) return 0;
+            return expr_newSum(p, p->n + left->left,
+                               expr_newConst(p, (int) v));
+        }
+    }
 
-    return e;
+    initNode(&e, NT_Sum);
+    e.left = expr_nodeIndex(p, left);
+    e.right = expr_nodeIndex(p, right);
+
+    return getNode(p, &e);
+}
+
+// append at most <s>-1 characters, returns number of characters appended
+static
+int appendStr(char* b, int s, const char* str)
+{
+    int len = snprintf(b, s, "%s", str);
+    return (len < s) ? len : s - 1;
 }
 
 static
-int appendExpr(char* b, ExprNode* e)
+int appendExpr(char* b, int s, ExprNode* e)
 {
+    char tmp[30];
     int off = 0;
 
     switch(e->type) {
     case NT_Const:
-        return sprintf(b, "%d", e->ival);
+        sprintf(tmp, "%d", e->ival);
+        return appendStr(b, s, tmp);
 
     case NT_Par:
         if (e->name[0])
-            return sprintf(b, "%s", e->name);
-        return sprintf(b, "par%d", e->ival);
+            return appendStr(b, s, e->name);
+        sprintf(tmp, "par%d", e->ival);
+        return appendStr(b, s, tmp);
 
     case NT_Ref:
         if (e->name[0])
-            off = sprintf(b, "%s", e->name);
-        else
-            off = sprintf(b, "%lx", e->ptr);
-        b[off] = '[';
-        off += appendExpr(b+off, e->p->n + e->left);
-        off += sprintf(b, "]");
+            off = appendStr(b, s, e->name);
+        else {
+            sprintf(tmp, "%lx", e->ptr);
+            off = appendStr(b, s, tmp);
+        }
+        off += appendStr(b+off, s-off, "[");
+        off += appendExpr(b+off, s-off, e->p->n + e->left);
+        off += appendStr(b+off, s-off, "]");
         return off;
 
     case NT_Scaled:
-        off =  sprintf(b, "%d * ", e->ival);
-        off += appendExpr(b+off, e->p->n + e->left);
+        sprintf(tmp, "%d * ", e->ival);
+        off = appendStr(b, s, tmp);
+        if (e->p->n[e->left].type == NT_Sum) {
+            off += appendStr(b+off, s-off, "(");
+            off += appendExpr(b+off, s-off, e->p->n + e->left);
+            off += appendStr(b+off, s-off, ")");
+        }
+        else
+            off += appendExpr(b+off, s-off, e->p->n + e->left);
         return off;
 
     case NT_Sum:
-        off =  appendExpr(b, e->p->n + e->left);
-        off += sprintf(b+off, " + ");
-        off += appendExpr(b+off, e->p->n + e->right);
+        off =  appendExpr(b, s, e->p->n + e->left);
+        off += appendStr(b+off, s-off, " + ");
+        off += appendExpr(b+off, s-off, e->p->n + e->right);
         return off;
 
     default: assert(0);
@@ -160,11 +294,10 @@ int appendExpr(char* b, ExprNode* e)
     return 0;
 }
 
+// large expressions get truncated
 char *expr_toString(ExprNode *e)
 {
     static char buf[200];
-    int off;
-    off = appendExpr(buf, e);
-    assert(off < 200);
+    appendExpr(buf, sizeof(buf), e);
     return buf;
 }
@@ -584,6 +584,43 @@ int genRet(GContext* cxt)
     return 1;
 }
 
+// call to absolute address via r11 (scratch register in calling
+// convention), to be independent from the position of the code
+static
+int genCall(GContext* cxt, uint64_t target)
+{
+    uint8_t* buf = cxt->buf;
+
+    // movabs $target, %r11
+    buf[0] = 0x49;
+    buf[1] = 0xBB;
+    *(uint64_t*)(buf+2) = target;
+    // call *%r11
+    buf[10] = 0x41;
+    buf[11] = 0xFF;
+    buf[12] = 0xD3;
+    return 13;
+}
+
+// indirect call with target in register
+static
+int genCallReg(GContext* cxt)
+{
+    uint8_t* buf = cxt->buf;
+    int r = GP64RegEncoding(cxt->instr->dst.reg);
+
+    // call *%r: 'call r/m 64' (0xFF/2)
+    if (r > 7) {
+        buf[0] = 0x41; // REX with MASK_B
+        buf[1] = 0xFF;
+        buf[2] = 0xD0 + r - 8;
+        return 3;
+    }
+    buf[0] = 0xFF;
+    buf[1] = 0xD0 + r;
+    return 2;
+}
+
 static
 int genPush(GContext* cxt)
 {
@@ -819,22 +856,22 @@ int genCMov(GContext* cxt)
         case OT_Reg64:
             if (opValType(src) != opValType(dst)) return -1;
             switch(it) {
-            case IT_CMOVO:  opc = 0x40; break; // cmovo  r,r/m 32/64
-            case IT_CMOVNO: opc = 0x41; break; // cmovno r,r/m 32/64
-            case IT_CMOVC:  opc = 0x42; break; // cmovc  r,r/m 32/64
-            case IT_CMOVNC: opc = 0x43; break; // cmovnc r,r/m 32/64
-            case IT_CMOVZ:  opc = 0x44; break; // cmovz  r,r/m 32/64
-            case IT_CMOVNZ: opc = 0x45; break; // cmovnz r,r/m 32/64
-            case IT_CMOVBE: opc = 0x46; break; // cmovbe r,r/m 32/64
-            case IT_CMOVA:  opc = 0x47; break; // cmova  r,r/m 32/64
-            case IT_CMOVS:  opc = 0x48; break; // cmovs  r,r/m 32/64
-            case IT_CMOVNS: opc = 0x49; break; // cmovns r,r/m 32/64
-            case IT_CMOVP:  opc = 0x4A; break; // cmovp  r,r/m 32/64
-            case IT_CMOVNP: opc = 0x4B; break; // cmovnp r,r/m 32/64
-            case IT_CMOVL:  opc = 0x4C; break; // cmovl  r,r/m 32/64
-            case IT_CMOVGE: opc = 0x4D; break; // cmovge r,r/m 32/64
-            case IT_CMOVLE: opc = 0x4E; break; // cmovle r,r/m 32/64
-            case IT_CMOVG:  opc = 0x4F; break; // cmovg  r,r/m 32/64
+            case IT_CMOVO:  opc = 0x0F40; break; // cmovo  r,r/m 32/64
+            case IT_CMOVNO: opc = 0x0F41; break; // cmovno r,r/m 32/64
+            case IT_CMOVC:  opc = 0x0F42; break; // cmovc  r,r/m 32/64
+            case IT_CMOVNC: opc = 0x0F43; break; // cmovnc r,r/m 32/64
+            case IT_CMOVZ:  opc = 0x0F44; break; // cmovz  r,r/m 32/64
+            case IT_CMOVNZ: opc = 0x0F45; break; // cmovnz r,r/m 32/64
+            case IT_CMOVBE: opc = 0x0F46; break; // cmovbe r,r/m 32/64
+            case IT_CMOVA:  opc = 0x0F47; break; // cmova  r,r/m 32/64
+            case IT_CMOVS:  opc = 0x0F48; break; // cmovs  r,r/m 32/64
+            case IT_CMOVNS: opc = 0x0F49; break; // cmovns r,r/m 32/64
+            case IT_CMOVP:  opc = 0x0F4A; break; // cmovp  r,r/m 32/64
+            case IT_CMOVNP: opc = 0x0F4B; break; // cmovnp r,r/m 32/64
+            case IT_CMOVL:  opc = 0x0F4C; break; // cmovl  r,r/m 32/64
+            case IT_CMOVGE: opc = 0x0F4D; break; // cmovge r,r/m 32/64
+            case IT_CMOVLE: opc = 0x0F4E; break; // cmovle r,r/m 32/64
+            case IT_CMOVG:  opc = 0x0F4F; break; // cmovg  r,r/m 32/64
             default: assert(0);
             }
             // use 'cmov r,r/m 32/64' (opc RM)
@@ -1916,6 +1953,16 @@ GenerateError* generate(Rewriter* r, CBB* cbb)
             case IT_RET:
                 used = genRet(&cxt);
                 break;
+            case IT_CALL:
+                if (instr->dst.type == OT_Reg64) {
+                    used = genCallReg(&cxt);
+                    break;
+                }
+                // recursive calls go to the rewritten code
+                assert(instr->dst.type == OT_Imm64);
+                used = genCall(&cxt, (instr->dst.val == r->func) ?
+                                     r->generatedCodeAddr : instr->dst.val);
+                break;
             case IT_SUB:
                 used = genSub(&cxt);
                 break;
@@ -1984,6 +2031,11 @@ GenerateError* generate(Rewriter* r, CBB* cbb)
         printf(" fall-through to (%s)\n",
                cbb_prettyName(cbb->nextFallThrough));
         }
+        else if (cbb->endType == IT_JMP) {
+            assert(cbb->nextFallThrough != 0);
+            printf("  I%2d : continue at (%s)\n",
+                   i, cbb_prettyName(cbb->nextFallThrough));
+        }
     }
 
     cbb->size = usedTotal;
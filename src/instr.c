@@ -573,6 +573,7 @@ void copyInstr(Instr* dst, Instr* src)
     dst->type  = src->type;
     dst->vtype = src->vtype;
     dst->form  = src->form;
+    dst->handler = 0; // operands may be changed
 
     dst->dst.type = OT_None;
     dst->src.type = OT_None;
@@ -610,6 +611,7 @@ void initSimpleInstr(Instr* i, InstrType it)
 
     i->type = it;
     i->ptLen = 0; // no pass-through info
+    i->handler = 0;
     i->vtype = VT_None;
     i->form = OF_0;
     i->dst.type = OT_None;
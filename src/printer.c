@@ -279,19 +279,13 @@ char* prettyAddress(uint64_t a, FunctionConfig* fc)
         MemRangeConfig* mrc;
 
         assert(fc->cc);
-        mrc = fc->cc->range_configs;
-        while(mrc) {
-            if (mrc->name) {
-                if (a == mrc->start) {
-                    sprintf(buf, "%s", mrc->name);
-                    return buf;
-                }
-                else if ((a > mrc->start) && (a < mrc->start + mrc->size)) {
-                    sprintf(buf, "%s+%ld", mrc->name, a - mrc->start);
-                    return buf;
-                }
-            }
-            mrc = mrc->next;
+        mrc = config_find_named(fc->cc, a);
+        if (mrc) {
+            if (a == mrc->start)
+                snprintf(buf, sizeof(buf), "%s", mrc->name);
+            else
+                snprintf(buf, sizeof(buf), "%s+%ld", mrc->name, a - mrc->start);
+            return buf;
         }
     }
     sprintf(buf, "0x%lx", a);
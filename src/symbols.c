@@ -0,0 +1,355 @@
+/**
+ * This file is part of DBrew, the dynamic binary rewriting library.
+ *
+ * (c) 2015-2016, Josef Weidendorfer <josef.weidendorfer@gmx.de>
+ *
+ * DBrew is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License (LGPL)
+ * as published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * DBrew is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DBrew.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Discovery of function names and sizes from ELF symbol tables
+ * (.symtab/.dynsym) of the main program and loaded shared objects.
+ * Symbol tables are not necessarily part of loaded segments, so the
+ * ELF files are mapped from disk.
+ *
+ * Also, resolution of PLT entries to their final targets via the GOT
+ * or, if not yet bound by lazy binding, via the dynamic linker.
+ */
+
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct _FuncSym {
+    uint64_t addr;
+    int size;
+    bool isLocal;
+    const char* name;
+} FuncSym;
+
+typedef struct _SymList {
+    FuncSym* sym;
+    int count, capacity;
+} SymList;
+
+// sort by address; for aliases, prefer global names
+static
+int fs_cmp(const void* a, const void* b)
+{
+    FuncSym* sa = (FuncSym*) a;
+    FuncSym* sb = (FuncSym*) b;
+
+    if (sa->addr < sb->addr) return -1;
+    if (sa->addr > sb->addr) return 1;
+    return (int) sa->isLocal - (int) sb->isLocal;
+}
+
+static
+void sl_add(SymList* sl, uint64_t addr, int size, bool isLocal,
+            const char* name)
+{
+    if (sl->count == sl->capacity) {
+        sl->capacity = (sl->capacity == 0) ? 1024 : 2 * sl->capacity;
+        sl->sym = (FuncSym*) realloc(sl->sym, sl->capacity * sizeof(FuncSym));
+    }
+    sl->sym[sl->count].addr = addr;
+    sl->sym[sl->count].size = size;
+    sl->sym[sl->count].isLocal = isLocal;
+    sl->sym[sl->count].name = name;
+    sl->count++;
+}
+
+// collect defined function symbols with known size from section <sh>
+static
+void collectSymbols(SymList* sl, const char* elf, size_t len,
+                    ElfW(Shdr)* shdrs, int shnum, ElfW(Shdr)* sh,
+                    uint64_t loadAddr)
+{
+    if ((sh->sh_link >= (ElfW(Word)) shnum) ||
+        (sh->sh_entsize != sizeof(ElfW(Sym))) ||
+        (sh->sh_offset + sh->sh_size > len))
+        return;
+
+    ElfW(Shdr)* strh = shdrs + sh->sh_link;
+    if (strh->sh_offset + strh->sh_size > len) return;
+
+    const char* strtab = elf + strh->sh_offset;
+    ElfW(Sym)* sym = (ElfW(Sym)*) (elf + sh->sh_offset);
+    int count = sh->sh_size / sizeof(ElfW(Sym));
+
+    for(int i = 0; i < count; i++) {
+        ElfW(Sym)* s = sym + i;
+        if (ELF64_ST_TYPE(s->st_info) != STT_FUNC) continue;
+        if ((s->st_shndx == SHN_UNDEF) || (s->st_value == 0)) continue;
+        if ((s->st_size == 0) || (s->st_size > 0x7fffffff)) continue;
+        if ((s->st_name == 0) || (s->st_name >= strh->sh_size)) continue;
+
+        sl_add(sl, loadAddr + s->st_value, (int) s->st_size,
+               ELF64_ST_BIND(s->st_info) == STB_LOCAL, strtab + s->st_name);
+    }
+}
+
+// add functions from symbol tables of ELF file <path>, loaded at <loadAddr>
+static
+void loadSymbols(Rewriter* r, const char* path, uint64_t loadAddr)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return; // e.g. vdso: no file
+
+    if ((fstat(fd, &st) < 0) || ((size_t) st.st_size < sizeof(ElfW(Ehdr)))) {
+        close(fd);
+        return;
+    }
+
+    size_t len = st.st_size;
+    char* elf = (char*) mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (elf == MAP_FAILED) return;
+
+    ElfW(Ehdr)* eh = (ElfW(Ehdr)*) elf;
+    if ((memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) ||
+        (eh->e_ident[EI_CLASS] != ELFCLASS64) ||
+        (eh->e_shentsize != sizeof(ElfW(Shdr))) ||
+        (eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > len)) {
+        munmap(elf, len);
+        return;
+    }
+
+    SymList sl;
+    sl.sym = 0;
+    sl.count = 0;
+    sl.capacity = 0;
+
+    ElfW(Shdr)* shdrs = (ElfW(Shdr)*) (elf + eh->e_shoff);
+    for(int i = 0; i < eh->e_shnum; i++) {
+        if ((shdrs[i].sh_type == SHT_SYMTAB) ||
+            (shdrs[i].sh_type == SHT_DYNSYM))
+            collectSymbols(&sl, elf, len, shdrs, eh->e_shnum, shdrs + i,
+                           loadAddr);
+    }
+
+    // adding in address order keeps function index of config sorted
+    qsort(sl.sym, sl.count, sizeof(FuncSym), fs_cmp);
+    for(int i = 0; i < sl.count; i++) {
+        FuncSym* s = sl.sym + i;
+        config_add_function(r, s->addr, s->size, s->name);
+    }
+
+    free(sl.sym);
+    munmap(elf, len);
+}
+
+static
+int loadObjectSymbols(struct dl_phdr_info* info, size_t size, void* data)
+{
+    Rewriter* r = (Rewriter*) data;
+    (void) size;
+
+    // main program has empty name
+    if (info->dlpi_name[0] == 0)
+        loadSymbols(r, "/proc/self/exe", info->dlpi_addr);
+    else
+        loadSymbols(r, info->dlpi_name, info->dlpi_addr);
+
+    return 0;
+}
+
+/**
+ * Configure names and sizes of all functions found in the symbol tables
+ * of the main program and loaded shared objects. Functions already
+ * configured keep their name and size.
+ * Returns the number of function configurations added.
+ */
+int dbrew_config_function_load_symbols(Rewriter* r)
+{
+    int oldCount = r->cc ? r->cc->functions.count : 0;
+
+    dl_iterate_phdr(loadObjectSymbols, r);
+
+    return r->cc ? (r->cc->functions.count - oldCount) : 0;
+}
+
+
+//----------------------------------------------------------
+// PLT resolution
+//
+
+typedef struct _PLTLookup {
+    uint64_t slot;       // GOT slot used by PLT entry
+    bool found;          // slot is JUMP_SLOT target or in RELRO segment
+    const char* name;    // symbol of JUMP_SLOT relocation for slot
+    const char* version; // required symbol version, 0 if none
+} PLTLookup;
+
+// skip "endbr64" of PLTs with indirect branch tracking
+static
+uint8_t* skipEndbr(uint8_t* p)
+{
+    if ((p[0] == 0xf3) && (p[1] == 0x0f) && (p[2] == 0x1e) && (p[3] == 0xfa))
+        return p + 4;
+    return p;
+}
+
+// if <addr> looks like a PLT entry "jmp *slot(%rip)", return address of slot
+static
+uint64_t pltSlot(uint64_t addr)
+{
+    uint8_t* p = skipEndbr((uint8_t*) addr);
+
+    if (p[0] == 0xf2) p++; // "bnd" prefix of MPX-enabled PLTs
+    if ((p[0] != 0xff) || (p[1] != 0x25)) return 0;
+    return (uint64_t) (p + 6) + *(int32_t*)(p + 2);
+}
+
+// not yet bound: GOT slot points to lazy-binding code "push $index"
+static
+bool isLazyStub(uint64_t addr)
+{
+    uint8_t* p = skipEndbr((uint8_t*) addr);
+
+    return (p[0] == 0x68);
+}
+
+// name of version with index <idx> in version needs <vn>, or 0
+static
+const char* neededVersion(ElfW(Verneed)* vn, uint64_t count,
+                          const char* strtab, int idx)
+{
+    for(uint64_t i = 0; vn && (i < count); i++) {
+        ElfW(Vernaux)* aux = (ElfW(Vernaux)*) ((char*) vn + vn->vn_aux);
+        for(int j = 0; j < vn->vn_cnt; j++) {
+            if (aux->vna_other == idx)
+                return strtab + aux->vna_name;
+            aux = (ElfW(Vernaux)*) ((char*) aux + aux->vna_next);
+        }
+        if (vn->vn_next == 0) break;
+        vn = (ElfW(Verneed)*) ((char*) vn + vn->vn_next);
+    }
+    return 0;
+}
+
+// check that GOT slot belongs to a PLT in object with slot, and find the
+// name and version of the symbol bound to the slot
+static
+int findSlotSymbol(struct dl_phdr_info* info, size_t size, void* data)
+{
+    PLTLookup* pl = (PLTLookup*) data;
+    ElfW(Dyn)* dyn = 0;
+    bool hasSlot = false;
+    bool inRelro = false;
+    uint64_t base = info->dlpi_addr;
+    (void) size;
+
+    for(int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* ph = info->dlpi_phdr + i;
+        uint64_t start = base + ph->p_vaddr;
+        bool contains = (pl->slot >= start) &&
+                        (pl->slot + 8 <= start + ph->p_memsz);
+
+        if ((ph->p_type == PT_LOAD) && contains)
+            hasSlot = true;
+        if ((ph->p_type == PT_GNU_RELRO) && contains)
+            inRelro = true;
+        if (ph->p_type == PT_DYNAMIC)
+            dyn = (ElfW(Dyn)*) start;
+    }
+    if (!hasSlot) return 0;
+
+    // slots in RELRO segment are bound and not writable anymore
+    pl->found = inRelro;
+    if (!dyn) return 1;
+
+    ElfW(Rela)* rela = 0;
+    ElfW(Sym)* symtab = 0;
+    const char* strtab = 0;
+    ElfW(Half)* versym = 0;
+    ElfW(Verneed)* verneed = 0;
+    uint64_t relsz = 0, verneednum = 0;
+    for(; dyn->d_tag != DT_NULL; dyn++) {
+        // the dynamic linker usually relocates pointers in place
+        uint64_t ptr = dyn->d_un.d_ptr;
+        if (ptr < base) ptr += base;
+
+        switch(dyn->d_tag) {
+        case DT_JMPREL:     rela = (ElfW(Rela)*) ptr; break;
+        case DT_PLTRELSZ:   relsz = dyn->d_un.d_val; break;
+        case DT_SYMTAB:     symtab = (ElfW(Sym)*) ptr; break;
+        case DT_STRTAB:     strtab = (const char*) ptr; break;
+        case DT_VERSYM:     versym = (ElfW(Half)*) ptr; break;
+        case DT_VERNEED:    verneed = (ElfW(Verneed)*) ptr; break;
+        case DT_VERNEEDNUM: verneednum = dyn->d_un.d_val; break;
+        default: break;
+        }
+    }
+    if (!rela || !symtab || !strtab) return 1;
+
+    for(uint64_t i = 0; i < relsz / sizeof(ElfW(Rela)); i++) {
+        if (base + rela[i].r_offset != pl->slot) continue;
+        if (ELF64_R_TYPE(rela[i].r_info) != R_X86_64_JUMP_SLOT) break;
+
+        uint64_t sym = ELF64_R_SYM(rela[i].r_info);
+        pl->found = true;
+        pl->name = strtab + symtab[sym].st_name;
+        // version indexes 0 and 1 are local/global: no specific version
+        if (versym && ((versym[sym] & 0x7fff) > 1))
+            pl->version = neededVersion(verneed, verneednum, strtab,
+                                        versym[sym] & 0x7fff);
+        break;
+    }
+    return 1;
+}
+
+/**
+ * If <addr> is a PLT entry, return the final target of the jump, else
+ * <addr>. Only jumps via GOT slots with a JUMP_SLOT relocation or in the
+ * read-only part of the GOT (RELRO) are resolved. For entries not yet
+ * bound, the target is looked up by the name and version of the symbol
+ * to bind, avoiding emulation of the dynamic linker.
+ * Returns <addr> if that is not possible.
+ */
+uint64_t resolvePLT(uint64_t addr)
+{
+    PLTLookup pl;
+    uint64_t target;
+
+    pl.slot = pltSlot(addr);
+    if (pl.slot == 0) return addr;
+
+    pl.found = false;
+    pl.name = 0;
+    pl.version = 0;
+    dl_iterate_phdr(findSlotSymbol, &pl);
+    if (!pl.found) return addr;
+
+    target = *(uint64_t*) pl.slot;
+    if (!isLazyStub(target)) return target;
+    if (!pl.name) return addr;
+
+    if (pl.version)
+        target = (uint64_t) dlvsym(RTLD_DEFAULT, pl.name, pl.version);
+    else
+        target = (uint64_t) dlsym(RTLD_DEFAULT, pl.name);
+    return target ? target : addr;
+}
@@ -0,0 +1,16 @@
+//!driver = test-driver-decode.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // 8-bit immediates sign-extended to operand size
+    imul ax, bx, -2
+    imul eax, ebx, -2
+    imul rax, rbx, -2
+    imul ecx, dword ptr [rdi], 0x7f
+    add eax, -1
+    and rax, -16
+    sub word ptr [rdi], -3
+    cmp qword ptr [rdi], -128
+    ret
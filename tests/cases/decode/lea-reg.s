@@ -0,0 +1,10 @@
+//!driver = test-driver-decode.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    lea rax, [rdi + 8]
+    // lea rax, rax: register operand is invalid
+    .byte 0x48, 0x8d, 0xc0
+    ret
@@ -0,0 +1,13 @@
+//!driver = test-driver-decode.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // MOVSXD, Intel Vol. 2A 4-87: only supported with REX.W
+    movsxd rax, dword ptr [rdi]
+    movsxd r9, ebx
+    movsxd rcx, r10d
+    // movsxd eax, ebx (no REX.W)
+    .byte 0x63, 0xc3
+    ret
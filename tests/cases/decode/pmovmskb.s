@@ -0,0 +1,12 @@
+//!driver = test-driver-decode.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // PMOVMSKB, Intel Vol. 2B 4-327
+    pmovmskb eax, xmm1
+    pmovmskb r9d, xmm10
+    // pmovmskb eax, [rdi]: memory operand is invalid
+    .byte 0x66, 0x0f, 0xd7, 0x07
+    ret
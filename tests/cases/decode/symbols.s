@@ -0,0 +1,11 @@
+//!driver = test-driver-symbols.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // names/sizes of f1, f2 come from ELF symbol table
+    lea rax, [rip + f2]
+    add eax, 1
+    call f2
+    .size   f1, .-f1
@@ -0,0 +1,10 @@
+//!driver = test-driver-decode.c
+.intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    vaddps xmm0, xmm1, xmm2
+    // VEX3 with opcode map 0x0F38 is not supported
+    vpshufb xmm0, xmm1, xmm2
+    ret
@@ -0,0 +1,16 @@
+//!driver = test-driver-budget.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // loop with known trip count gets unrolled completely
+    xor eax, eax
+    xor ecx, ecx
+1:
+    lea rdx, [rsi + rcx]
+    add rax, rdx
+    add rcx, 1
+    cmp rcx, rdi
+    jl 1b
+    ret
@@ -0,0 +1,36 @@
+//!args=--nobytes --var --directive=inline,64,100,2 --parcount=64,8,0 --run 5
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // g1 has 8 parameters by its signature, the last two passed on the
+    // stack. It never is inlined by the directive, but a real call would
+    // lose the stack arguments: it gets inlined instead
+    sub rsp, 16
+    mov qword ptr [rsp], 7
+    mov qword ptr [rsp + 8], 8
+    mov rdx, 3
+    mov rcx, 4
+    mov r8, 5
+    mov r9, 6
+    call g1
+    add rsp, 16
+    ret
+    .p2align 4
+g1:
+    // rdi + 2*rsi + ... + 6*r9 + 7*[rsp+8] + 8*[rsp+16]
+    lea rax, [rdi + 2*rsi]
+    imul rdx, rdx, 3
+    add rax, rdx
+    lea rax, [rax + 4*rcx]
+    imul r8, r8, 5
+    add rax, r8
+    imul r9, r9, 6
+    add rax, r9
+    mov rdx, [rsp + 8]
+    imul rdx, rdx, 7
+    add rax, rdx
+    mov rdx, [rsp + 16]
+    lea rax, [rax + 8*rdx]
+    ret
@@ -0,0 +1,13 @@
+//!driver = test-driver-callcache.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // call via unknown function pointer, result added to parameter
+    push rbx
+    mov rbx, rdi
+    call rsi
+    add rax, rbx
+    pop rbx
+    ret
@@ -0,0 +1,17 @@
+//!args=--nobytes --capture-only --var --run 3
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // with known par, loop gets unrolled and arithmetic on unknown y
+    // is captured without emulation
+    mov rax, rsi
+    mov rcx, rdi
+1:
+    imul rax, rsi
+    add rax, 3
+    xor rax, 5
+    sub rcx, 1
+    jnz 1b
+    ret
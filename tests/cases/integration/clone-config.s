@@ -0,0 +1,22 @@
+//!driver = test-driver-clone.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // g1 with known 1st parameter: not inlined, but a clone called
+    sub rsp, 8
+    mov rdi, 3
+    call g1
+    add rsp, 8
+    ret
+    .globl  g1
+    .type   g1, @function
+g1:
+    // call via unknown function pointer, result added to 1st parameter
+    push rbx
+    mov rbx, rdi
+    call rsi
+    add rax, rbx
+    pop rbx
+    ret
@@ -0,0 +1,34 @@
+//!driver = test-driver-cxx.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // virtual call of 2nd function in vtable of object
+    mov rax, [rdi]
+    call [rax + 8]
+    ret
+m0:
+    mov rax, [rdi + 8]
+    ret
+m1:
+    mov rax, [rdi + 8]
+    imul rax, rsi
+    ret
+
+    // vtable: offset-to-top, RTTI, virtual functions
+    .section .data.rel.ro
+    .align 8
+.Lvtable:
+    .quad 0
+    .quad 0
+.Lvptr:
+    .quad m0
+    .quad m1
+
+    .data
+    .align 8
+    .globl obj
+obj:
+    .quad .Lvptr
+    .quad 7
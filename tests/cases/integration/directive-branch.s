@@ -0,0 +1,16 @@
+//!args=--nobytes --directive=branch,3,2,0 --run 5
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // the jump depends on unknown rsi. A directive tells it to be
+    // never taken, so the code for the other path is not generated
+    test rsi, rsi
+    js 1f
+    lea rax, [rdi + rsi]
+    ret
+1:
+    mov rax, rdi
+    neg rax
+    ret
@@ -0,0 +1,22 @@
+//!args=--nobytes --directive=dynamic,2,14,1 --run 5
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // both loops have known trip count. With results of the 1st loop
+    // forced unknown by a directive, only the 2nd loop gets unrolled
+    xor eax, eax
+    xor ecx, ecx
+1:
+    add rax, rsi
+    add rcx, 1
+    cmp rcx, rdi
+    jl 1b
+    xor ecx, ecx
+2:
+    add rax, rcx
+    add rcx, 1
+    cmp rcx, rdi
+    jl 2b
+    ret
@@ -0,0 +1,18 @@
+//!args=--nobytes --directive=inline,0,100,2 --directive=inline,14,5,1 --parcount=19,1,0 --run 5
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // calls into f1 are never inlined by the 1st directive, but the
+    // nested 2nd directive forces inlining of g1
+    call g1
+    mov rdi, rax
+    call g2
+    ret
+g1:
+    lea rax, [rdi + 1]
+    ret
+g2:
+    lea rax, [rdi + rdi]
+    ret
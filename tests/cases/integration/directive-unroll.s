@@ -0,0 +1,18 @@
+//!args=--nobytes --directive=unroll,4,1,4 --directive=unroll,4,20,2 --run 13
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // the unroll factor of the loop is given by two directives starting
+    // at the loop header: the smaller range takes precedence
+    xor eax, eax
+    xor ecx, ecx
+1:
+    lea rdx, [rsi + rcx]
+    imul rdx, rdi
+    add rax, rdx
+    add rcx, 1
+    cmp rcx, rdi
+    jl 1b
+    ret
@@ -0,0 +1,26 @@
+//!args=--nobytes --rodata --run
+//!ccflags=-std=c99 -g -Wl,--section-start=.fpconst=0x10000000
+    .intel_syntax noprefix
+    // fixed address keeps expected output independent of driver size
+    .section .fpconst,"a"
+    .align 8
+c1:
+    .double 1.5
+c2:
+    .double 2.0
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // static: folded, comparison resolves branch
+    movsd xmm0, [rip+c1]
+    mulsd xmm0, [rip+c2]
+    ucomisd xmm0, [rip+c2]
+    jbe 1f
+    addsd xmm0, xmm0
+1:
+    // dynamic: static operand is loaded from constant pool
+    movq xmm1, rsi
+    addsd xmm1, xmm0
+    movq rax, xmm1
+    ret
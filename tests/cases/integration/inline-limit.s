@@ -0,0 +1,31 @@
+//!driver = test-driver-inline.c
+    .intel_syntax noprefix
+    .text
+    .globl  big
+    .type   big, @function
+big:
+    mov rax, rdi
+    imul rax, rsi
+    add rax, rsi
+    ret
+
+    .globl  small
+    .type   small, @function
+small:
+    lea rax, [rdi + 1]
+    ret
+
+    .globl  f1
+    .type   f1, @function
+f1:
+    // big is called with known 2nd parameter: a specialized clone is
+    // called. small never is inlined
+    push rbx
+    mov rbx, rdi
+    mov rsi, 3
+    call big
+    add rbx, rax
+    mov rdi, rbx
+    call small
+    pop rbx
+    ret
@@ -0,0 +1,33 @@
+//!args=--nobytes --rodata --noanalysis --run -2 3
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // without analysis of values, the index bound still is known
+    cmp rdi, 4
+    ja 5f
+    lea rax, [rip + .Ltable]
+    jmp [rax + rdi*8]
+1:
+    mov rax, 10
+    ret
+2:
+    lea rax, [rsi + 20]
+    ret
+3:
+    mov rax, rsi
+    add rax, rdi
+    ret
+5:
+    mov rax, -1
+    ret
+
+    .section .data.rel.ro
+    .align 8
+.Ltable:
+    .quad 1b
+    .quad 2b
+    .quad 2b
+    .quad 3b
+    .quad 3b
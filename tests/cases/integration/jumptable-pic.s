@@ -0,0 +1,34 @@
+//!args=--nobytes --rodata --run -1 -3 6 -9
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // position-independent jump table with 32-bit relative entries
+    cmp edi, 3
+    ja 5f
+    lea rdx, [rip + .Ltable]
+    mov edi, edi
+    movsxd rax, dword ptr [rdx + rdi*4]
+    add rax, rdx
+    jmp rax
+1:
+    mov rax, 10
+    ret
+2:
+    lea rax, [rsi + 20]
+    ret
+3:
+    mov rax, rdi
+    ret
+5:
+    mov rax, -1
+    ret
+
+    .section .rodata
+    .align 4
+.Ltable:
+    .long 1b - .Ltable
+    .long 2b - .Ltable
+    .long 3b - .Ltable
+    .long 1b - .Ltable
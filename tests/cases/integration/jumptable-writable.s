@@ -0,0 +1,27 @@
+//!args=--nobytes --rodata --run -2
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // jump table in writable memory may change: not specialized
+    cmp rdi, 2
+    ja 5f
+    lea rax, [rip + .Ltable]
+    jmp [rax + rdi*8]
+1:
+    mov rax, 10
+    ret
+2:
+    lea rax, [rsi + 20]
+    ret
+5:
+    mov rax, -1
+    ret
+
+    .data
+    .align 8
+.Ltable:
+    .quad 1b
+    .quad 2b
+    .quad 2b
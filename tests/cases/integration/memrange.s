@@ -0,0 +1,18 @@
+//!driver = test-driver-memrange.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // only the load from the nested writable range is kept
+    mov rax, [rip + mdata]
+    add rax, [rip + mdata + 16]
+    add rax, [rip + mdata + 48]
+    add rax, [rip + mdata + 80]
+    ret
+
+    .data
+    .globl  mdata
+    .align 8
+mdata:
+    .quad 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12
@@ -0,0 +1,11 @@
+//!args=--nobytes --var --run
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // known destination kept if unknown condition is false
+    mov rax, 7
+    test rdi, rdi
+    cmovs rax, rdi
+    ret
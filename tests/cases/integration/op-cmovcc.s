@@ -0,0 +1,15 @@
+//!args=--var --run 3 10
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // absolute value: with unknown parameter, cmovcc is captured
+    // (2-byte opcode 0F 4x), else folded
+    mov rax, rdi
+    neg rax
+    cmovs rax, rdi
+    mov rcx, 10
+    cmp rax, rcx
+    cmovz rax, rsi
+    ret
@@ -0,0 +1,15 @@
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // signed overflow: 0x7fffffffffffffff - (-1) sets OF and SF
+    neg rdi
+    movabs rax, 0x7fffffffffffffff
+    cmp rax, rdi
+    jg 1f
+    xor eax, eax
+    ret
+1:
+    mov eax, 1
+    ret
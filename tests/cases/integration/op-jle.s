@@ -0,0 +1,14 @@
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // signed overflow: 0x8000000000000000 - 1 sets OF, but not SF
+    movabs rax, 0x8000000000000000
+    cmp rax, rdi
+    jle 1f
+    xor eax, eax
+    ret
+1:
+    mov eax, 1
+    ret
@@ -0,0 +1,18 @@
+//!args=--nobytes --rodata --run
+    .intel_syntax noprefix
+    .section .rodata
+    .align 8
+table:
+    .quad 10, 20, 30, 40
+
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // table is not registered, but read-only: load from known address
+    // is folded to a constant
+    lea rdx, [rip+table]
+    mov rax, [rdx+16]
+    // wdata is writable: load is kept
+    add rax, [wdata]
+    ret
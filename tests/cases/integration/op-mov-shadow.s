@@ -0,0 +1,18 @@
+//!args=--nobytes --shadow --run
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // store of known value to known address goes to shadow memory:
+    // load from same address is folded, store is kept
+    mov [wdata], rdi
+    mov rax, [wdata]
+    add rax, 5
+    // store to unknown address may alias (here: wdata+8 with 2nd par 1),
+    // so load afterwards is kept
+    mov [wdata+8], rax
+    lea rcx, [rip+wdata]
+    mov [rcx+8*rsi], rdi
+    add rax, [wdata+8]
+    ret
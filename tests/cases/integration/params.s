@@ -0,0 +1,17 @@
+//!driver = test-driver-params.c
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // x = xmm0, c = xmm1, known loop count n on stack: unrolled to
+    // Horner scheme with constant c
+    mov rcx, [rsp+8]
+    movapd xmm2, xmm1
+1:
+    mulsd xmm2, xmm0
+    addsd xmm2, xmm1
+    sub rcx, 1
+    jnz 1b
+    movapd xmm0, xmm2
+    ret
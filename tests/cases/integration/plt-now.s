@@ -0,0 +1,11 @@
+//!compile = {cc} {ccflags} -c -o {ofile} {infile} && {cc} {ccflags} -Wl,-z,now -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+//!args=--nobytes --run 2
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // PLT entry of labs resolved to libc function bound at load time
+    sub rdi, 5
+    call labs@PLT
+    ret
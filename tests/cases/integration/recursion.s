@@ -0,0 +1,22 @@
+//!args=--nobytes --run -3 3
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // recursion with unknown parameters: a real call to the rewritten
+    // function gets generated
+    test rdi, rdi
+    jle 1f
+    push rdi
+    push rsi
+    sub rdi, 1
+    call f1
+    pop rsi
+    pop rdi
+    imul rdi, rsi
+    add rax, rdi
+    ret
+1:
+    xor eax, eax
+    ret
@@ -0,0 +1,18 @@
+//!args=--nobytes --reroll --run 20
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // loop counter kept in a stack slot (as with spilling around calls)
+    // also gets re-rolled
+    xor eax, eax
+    mov dword ptr [rsp - 8], 0
+1:
+    movsxd rcx, dword ptr [rsp - 8]
+    lea rdx, [rsi + rcx]
+    add rax, rdx
+    add dword ptr [rsp - 8], 1
+    cmp dword ptr [rsp - 8], edi
+    jl 1b
+    ret
@@ -0,0 +1,22 @@
+//!args=--nobytes --reroll --run 20
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // 64-bit loop counter in a stack slot: when re-rolling, its upper
+    // half needs to be stored, too, as the slot was dirtied before
+    push rbp
+    mov rbp, rsp
+    mov rcx, rsi
+    neg rcx
+    mov qword ptr [rbp - 8], rcx
+    mov qword ptr [rbp - 8], 0
+    mov rax, rsi
+1:
+    add rax, qword ptr [rbp - 8]
+    add qword ptr [rbp - 8], 1
+    cmp qword ptr [rbp - 8], rdi
+    jl 1b
+    pop rbp
+    ret
@@ -0,0 +1,19 @@
+//!args=--nobytes --reroll --run 5 100
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // with known trip count, short loops get unrolled. Longer loops
+    // are re-rolled with the counter becoming unknown, while the known
+    // trip count stays specialized within the body
+    xor eax, eax
+    xor ecx, ecx
+1:
+    lea rdx, [rsi + rcx]
+    imul rdx, rdi
+    add rax, rdx
+    add rcx, 1
+    cmp rcx, rdi
+    jl 1b
+    ret
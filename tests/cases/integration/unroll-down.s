@@ -0,0 +1,17 @@
+//!args=--nobytes --unroll --run 13
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // counting down with "jnz": remaining iterations before re-rolling
+    // predicted from the decrement: 8 of 13 iterations are left for the
+    // loop over 4 copies
+    xor eax, eax
+    mov rcx, rdi
+1:
+    lea rdx, [rsi + rcx]
+    add rax, rdx
+    sub rcx, 1
+    jnz 1b
+    ret
@@ -0,0 +1,19 @@
+//!args=--nobytes --unroll --run 13 100
+    .intel_syntax noprefix
+    .text
+    .globl  f1
+    .type   f1, @function
+f1:
+    // loop with known trip count gets re-rolled into a loop over 4
+    // copies of the body. Iterations not filling the unrolled body
+    // are unrolled in front of the loop
+    xor eax, eax
+    xor ecx, ecx
+1:
+    lea rdx, [rsi + rcx]
+    imul rdx, rdi
+    add rax, rdx
+    add rcx, 1
+    cmp rcx, rdi
+    jl 1b
+    ret
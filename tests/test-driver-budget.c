@@ -0,0 +1,65 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+typedef long (*f1_t)(long, long);
+long f1(long, long);
+
+// rewrite f1 with known 1st parameter and limit <limit> for budget <b>
+f1_t rewrite(Rewriter* r, DBrewBudget b, long limit, bool degrade)
+{
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_parcount(r, 2);
+    dbrew_config_staticpar(r, 0);
+    dbrew_config_budget(r, b, limit);
+    dbrew_config_budget_degrade(r, degrade);
+    return (f1_t) dbrew_rewrite(r, 100, 0);
+}
+
+int main()
+{
+    const char* names[] = { "none", "emulated instructions", "states",
+                            "captured instructions", "code bytes", "time" };
+    DBrewBudget budgets[] = { DBREW_BUDGET_EMU_INSTRS,
+                              DBREW_BUDGET_CAP_INSTRS,
+                              DBREW_BUDGET_CODE_BYTES };
+    int res = 0;
+    f1_t ff;
+
+    // fully unrolling the loop exceeds budgets: original is returned
+    for(int i = 0; i < 3; i++) {
+        Rewriter* r = dbrew_new();
+        ff = rewrite(r, budgets[i], 50, false);
+        printf(">>> Budget for %s: exceeded %s, %s\n", names[budgets[i]],
+               names[dbrew_budget_exceeded(r)],
+               (ff == f1) ? "original returned" : "rewritten");
+        if ((ff != f1) || (dbrew_budget_exceeded(r) != budgets[i])) res = 1;
+        dbrew_free(r);
+    }
+
+    // degraded rewrite with unknown results keeps the loop
+    Rewriter* r = dbrew_new();
+    ff = rewrite(r, DBREW_BUDGET_EMU_INSTRS, 50, true);
+    printf(">>> Degraded: exceeded %s, %s\n", names[dbrew_budget_exceeded(r)],
+           (ff == f1) ? "original returned" : "rewritten");
+    if (ff == f1) res = 1;
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    long orig = f1(100, 1);
+    long rewritten = ff(100, 1);
+    printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+    if (orig != rewritten) res = 1;
+    return res;
+}
@@ -0,0 +1,53 @@
+//!compile = {cc} {ccflags} -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+typedef long (*g_t)(long);
+typedef long (*f1_t)(long, g_t);
+long f1(long, g_t);
+
+long add1(long x) { return x + 1; }
+long times3(long x) { return 3 * x; }
+long neg(long x) { return -x; }
+
+int main()
+{
+    g_t g[3] = { add1, times3, neg };
+    int res = 0;
+    f1_t ff;
+
+    Rewriter* r = dbrew_new();
+    dbrew_verbose(r, true, false, true);
+    dbrew_printer_showbytes(r, false);
+    dbrew_optverbose(r, false);
+
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_parcount(r, 2);
+    // calls via function pointer: inline cache for add1 and times3
+    dbrew_config_call_target(r, 0, (uint64_t) add1);
+    dbrew_config_call_target(r, 0, (uint64_t) times3);
+    // real call for other targets passes the argument as for add1
+    dbrew_config_function_parcount(r, (uint64_t) add1, 1, 0);
+    ff = (f1_t) dbrew_rewrite(r, 0, 0);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    for(int i = 0; i < 3; i++) {
+        long orig = f1(5, g[i]);
+        long rewritten = ff(5, g[i]);
+        printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+        if (orig != rewritten) res = 1;
+    }
+    return res;
+}
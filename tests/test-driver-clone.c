@@ -0,0 +1,58 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+typedef long (*g_t)(long);
+typedef long (*f1_t)(long, g_t);
+long f1(long, g_t);
+long g1(long, g_t);
+
+long add1(long x) { return x + 1; }
+long times3(long x) { return 3 * x; }
+
+int main()
+{
+    g_t g[2] = { add1, times3 };
+    int res = 0;
+    f1_t ff;
+
+    Rewriter* r = dbrew_new();
+    dbrew_printer_showbytes(r, false);
+
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 32);
+    dbrew_config_parcount(r, 2);
+    // g1 is called via a clone, which needs the same configuration for
+    // the indirect call in g1: expected target with known signature
+    dbrew_config_function_inline(r, (uint64_t) g1, DBREW_INLINE_NEVER);
+    dbrew_config_function_parcount(r, (uint64_t) g1, 2, 0);
+    dbrew_config_call_target(r, 0, (uint64_t) add1);
+    dbrew_config_function_parcount(r, (uint64_t) add1, 1, 0);
+    ff = (f1_t) dbrew_rewrite(r, 0, add1);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    // if rewriting the clone failed, the original g1 is called
+    uint64_t addr = (uint64_t) g1;
+    bool orig = memmem((void*) ff, dbrew_generated_size(r),
+                       &addr, sizeof(addr)) != 0;
+    printf(">>> Call to clone of g1: %s\n", orig ? "no" : "yes");
+
+    for(int i = 0; i < 2; i++) {
+        long orig = f1(5, g[i]);
+        long rewritten = ff(5, g[i]);
+        printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+        if (orig != rewritten) res = 1;
+    }
+    return res;
+}
@@ -0,0 +1,50 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+// object with vtable pointer and one data member
+typedef struct { void* vptr; long v; } Obj;
+extern Obj obj;
+
+typedef long (*f1_t)(Obj*, long);
+long f1(Obj*, long);
+
+int main()
+{
+    int res = 0;
+    f1_t ff;
+
+    Rewriter* r = dbrew_new();
+    dbrew_verbose(r, true, false, true);
+    dbrew_printer_showbytes(r, false);
+    dbrew_optverbose(r, false);
+
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_parcount(r, 2);
+    // object pointer known, data member not
+    dbrew_config_staticpar_shallow(r, 0);
+    dbrew_config_cxx_vtables(r, true);
+    ff = (f1_t) dbrew_rewrite(r, &obj, 0);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    for(int i = 0; i < 2; i++) {
+        obj.v = 7 + i;
+        long orig = f1(&obj, 5);
+        long rewritten = ff(&obj, 5);
+        printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+        if (orig != rewritten) res = 1;
+    }
+    return res;
+}
@@ -0,0 +1,53 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+typedef long (*f1_t)(long, long);
+long f1(long, long);
+long big(long, long);
+long small(long);
+
+int main()
+{
+    int res = 0;
+    f1_t ff;
+
+    Rewriter* r = dbrew_new();
+    dbrew_verbose(r, true, false, true);
+    dbrew_printer_showbytes(r, false);
+    dbrew_optverbose(r, false);
+
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) big, "big");
+    dbrew_config_function_setsize(r, (uint64_t) big, 40);
+    dbrew_config_function_parcount(r, (uint64_t) big, 2, 0);
+    dbrew_config_function_setname(r, (uint64_t) small, "small");
+    dbrew_config_function_setsize(r, (uint64_t) small, 5);
+    dbrew_config_function_parcount(r, (uint64_t) small, 1, 0);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_parcount(r, 2);
+    // big: 40 bytes, larger than 2 * 16 with one known parameter
+    dbrew_config_inline_limit(r, 16);
+    dbrew_config_function_inline(r, (uint64_t) small, DBREW_INLINE_NEVER);
+    ff = (f1_t) dbrew_rewrite(r, 0, 0);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    for(int i = 0; i < 2; i++) {
+        long orig = f1(5 + i, 1);
+        long rewritten = ff(5 + i, 1);
+        printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+        if (orig != rewritten) res = 1;
+    }
+    return res;
+}
@@ -0,0 +1,70 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+typedef long (*f1_t)(void);
+long f1(void);
+extern char mdata[];
+
+// ranges given as offsets into mdata
+struct {
+    char* name;
+    bool isWritable;
+    int off, size;
+} ranges[] = {
+    { "outer", false,  0, 80 },
+    { "inner", true,  16,  8 }, // nested
+    { "head",  false,  0,  8 }, // nested with same start
+    { "next",  false, 80, 16 }, // adjacent
+    { "cross", true,  72, 16 }, // partial overlap: rejected
+    { 0, false, 0, 0 }
+};
+
+void setRanges(Rewriter* r, bool verbose)
+{
+    for(int i = 0; ranges[i].name; i++) {
+        bool ok = dbrew_config_set_memrange(r, ranges[i].name,
+                                            ranges[i].isWritable,
+                                            (uint64_t) mdata + ranges[i].off,
+                                            ranges[i].size);
+        if (!verbose) continue;
+        printf("Range %-5s [%2d;%2d[ %s: %s\n",
+               ranges[i].name, ranges[i].off, ranges[i].off + ranges[i].size,
+               ranges[i].isWritable ? "writable" : "constant",
+               ok ? "accepted" : "rejected");
+    }
+}
+
+int main()
+{
+    f1_t ff;
+
+    // loads get names of innermost ranges, loads from constant ranges
+    // are folded
+    Rewriter* r = dbrew_new();
+    dbrew_printer_showbytes(r, false);
+    dbrew_set_function(r, (uint64_t) f1);
+    setRanges(r, true);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_parcount(r, 0);
+    dbrew_decode_print(r, (uint64_t) f1, 1);
+    ff = (f1_t) dbrew_rewrite(r);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    setRanges(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    long orig = f1();
+    long rewritten = ff();
+    printf(">>> Run orig/rewritten: %ld/%ld\n", orig, rewritten);
+    return (orig != rewritten) ? 1 : 0;
+}
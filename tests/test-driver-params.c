@@ -0,0 +1,53 @@
+//!compile = {cc} {ccflags} -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+// 7 integer parameters (last one on stack), 2 floating point ones
+typedef double (*f1_t)(long, long, long, long, long, long, long,
+                       double, double);
+double f1(long, long, long, long, long, long, long, double, double);
+
+int main()
+{
+    DBrewArg args[9];
+    f1_t ff;
+
+    Rewriter* r = dbrew_new();
+    dbrew_verbose(r, true, false, true);
+    dbrew_printer_showbytes(r, false);
+    dbrew_optverbose(r, false);
+
+    dbrew_set_function(r, (uint64_t) f1);
+    dbrew_config_function_setname(r, (uint64_t) f1, "test");
+    dbrew_config_function_setsize(r, (uint64_t) f1, 100);
+    dbrew_config_returnfp(r);
+    // known: stack parameter (loop count) and 2nd double
+    dbrew_config_staticpar(r, 6);
+    dbrew_config_staticpar(r, 8);
+
+    for(int i = 0; i < 7; i++) {
+        args[i].type = DBREW_PAR_INT;
+        args[i].v.i = i + 1;
+    }
+    args[7].type = DBREW_PAR_DOUBLE;
+    args[7].v.d = 1.0;
+    args[8].type = DBREW_PAR_DOUBLE;
+    args[8].v.d = 0.5;
+    ff = (f1_t) dbrew_rewrite_args(r, 9, args);
+
+    Rewriter* r2 = dbrew_new();
+    dbrew_printer_showbytes(r2, false);
+    dbrew_config_function_setname(r2, (uint64_t) ff, "gen");
+    dbrew_config_function_setsize(r2, (uint64_t) ff, dbrew_generated_size(r));
+    dbrew_decode_print(r2, (uint64_t) ff, dbrew_generated_size(r));
+
+    double orig = f1(1, 2, 3, 4, 5, 6, 7, 2.0, 0.5);
+    double rewritten = ff(1, 2, 3, 4, 5, 6, 7, 2.0, 0.5);
+    printf(">>> Run orig/rewritten: %f/%f\n", orig, rewritten);
+    return (orig != rewritten) ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+//!compile = as -c -o {ofile} {infile} && {cc} {ccflags} -o {outfile} {ofile} {driver} ../libdbrew.a -I../include
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dbrew.h"
+
+int f1(int);
+// call target
+int f2(int x) { return x; }
+
+int main()
+{
+    // Decode the function, with names from ELF symbols.
+    Rewriter* r = dbrew_new();
+    if (dbrew_config_function_load_symbols(r) == 0)
+        printf("Error: no function symbols found\n");
+    dbrew_decode_print(r, (uintptr_t) f1, 1);
+
+    return 0;
+}
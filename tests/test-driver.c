@@ -14,7 +14,52 @@ long f1(long, long);
 const uint64_t rdata[2] = {1,2}; // read-only data section (16 bytes)
 long wdata[2];                   // uninitialized data section (16 bytes)
 
-int runtest(Rewriter*r, long parameter, bool doRun, bool showBytes)
+// directives for code ranges given as offsets into f1
+#define MAX_DIRECTIVES 4
+int dirCount = 0;
+DBrewDirective dirType[MAX_DIRECTIVES];
+int dirOff[MAX_DIRECTIVES], dirSize[MAX_DIRECTIVES], dirArg[MAX_DIRECTIVES];
+
+// parse "<type>,<offset>,<size>,<arg>", returns false on error
+bool addDirective(const char* s)
+{
+    const char* names[] = { "none", "dynamic", "unroll", "inline", "branch" };
+    char name[16];
+    int i = dirCount;
+
+    if (i == MAX_DIRECTIVES) return false;
+    if (sscanf(s, "%15[a-z],%i,%i,%i",
+               name, &dirOff[i], &dirSize[i], &dirArg[i]) != 4)
+        return false;
+    for(int d = DBREW_DIRECTIVE_DYNAMIC; d < DBREW_DIRECTIVE_MAX; d++) {
+        if (strcmp(name, names[d]) != 0) continue;
+        dirType[i] = (DBrewDirective) d;
+        dirCount++;
+        return true;
+    }
+    return false;
+}
+
+// signatures of functions given as offsets into f1
+#define MAX_SIGNATURES 4
+int sigCount = 0;
+int sigOff[MAX_SIGNATURES], sigInt[MAX_SIGNATURES], sigFP[MAX_SIGNATURES];
+
+// parse "<offset>,<int parameters>,<fp parameters>", returns false on error
+bool addSignature(const char* s)
+{
+    int i = sigCount;
+
+    if (i == MAX_SIGNATURES) return false;
+    if (sscanf(s, "%i,%i,%i", &sigOff[i], &sigInt[i], &sigFP[i]) != 3)
+        return false;
+    sigCount++;
+    return true;
+}
+
+int runtest(Rewriter*r, long parameter, bool doRun, bool showBytes,
+            bool rodata, bool captureOnly, bool reroll, bool unroll,
+            bool shadow, bool noAnalysis)
 {
     f1_t ff;
 
@@ -31,6 +76,24 @@ int runtest(Rewriter*r, long parameter, bool doRun, bool showBytes)
     dbrew_config_function_setsize(r, (uint64_t) f1, 100);
     dbrew_config_set_memrange(r, "rdata", false, (uint64_t) rdata, 16);
     dbrew_config_set_memrange(r, "wdata", true, (uint64_t) wdata, 16);
+    if (rodata)
+        dbrew_config_readonly_constant(r, true);
+    if (captureOnly)
+        dbrew_config_capture_only(r, true);
+    if (shadow)
+        dbrew_config_shadow_memory(r, true);
+    if (noAnalysis)
+        dbrew_config_analysis(r, DBREW_ANALYSIS_NONE);
+    if (reroll)
+        dbrew_config_loop_reroll(r, 8);
+    if (unroll)
+        dbrew_config_loop_unroll(r, 0, 4);
+    for(int i = 0; i < dirCount; i++)
+        dbrew_config_directive(r, (uint64_t) f1 + dirOff[i], dirSize[i],
+                               dirType[i], dirArg[i]);
+    for(int i = 0; i < sigCount; i++)
+        dbrew_config_function_parcount(r, (uint64_t) f1 + sigOff[i],
+                                       sigInt[i], sigFP[i]);
     if (parameter >= 0)
         dbrew_config_staticpar(r, 0);
     else
@@ -64,11 +127,35 @@ int main(int argc, char** argv)
     bool run = false;
     bool var = false; // also generate version with variable parameter?
     bool showBytes = true;
+    bool rodata = false; // read-only mappings are constant data?
+    bool captureOnly = false; // capture dynamic instructions as-is?
+    bool reroll = false; // re-roll loops with known trip count?
+    bool unroll = false; // partially unroll re-rolled loops?
+    bool shadow = false; // emulated writes go to shadow memory?
+    bool noAnalysis = false; // no analysis of emulated values?
     while((arg<argc) && (argv[arg][0] == '-') && (argv[arg][1] == '-')) {
         if (strcmp(argv[arg], "--debug")==0) debug = true;
         if (strcmp(argv[arg], "--run")==0) run = true;
         if (strcmp(argv[arg], "--var")==0) var = true;
         if (strcmp(argv[arg], "--nobytes")==0) showBytes = false;
+        if (strcmp(argv[arg], "--rodata")==0) rodata = true;
+        if (strcmp(argv[arg], "--capture-only")==0) captureOnly = true;
+        if (strcmp(argv[arg], "--reroll")==0) reroll = true;
+        if (strcmp(argv[arg], "--unroll")==0) unroll = true;
+        if (strcmp(argv[arg], "--shadow")==0) shadow = true;
+        if (strcmp(argv[arg], "--noanalysis")==0) noAnalysis = true;
+        if (strncmp(argv[arg], "--directive=", 12)==0) {
+            if (!addDirective(argv[arg] + 12)) {
+                fprintf(stderr, "Error: wrong directive %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        if (strncmp(argv[arg], "--parcount=", 11)==0) {
+            if (!addSignature(argv[arg] + 11)) {
+                fprintf(stderr, "Error: wrong signature %s\n", argv[arg]);
+                return 1;
+            }
+        }
         arg++;
     }
 
@@ -81,16 +168,19 @@ int main(int argc, char** argv)
     dbrew_optverbose(r, false);
 
     if (var)
-        res += runtest(r, -1, run, showBytes);
+        res += runtest(r, -1, run, showBytes, rodata,
+                       captureOnly, reroll, unroll, shadow, noAnalysis);
 
     if (arg < argc) {
         // take parameter values for rewriting from command line
         for(; arg < argc; arg++)
-            res += runtest(r, atoi(argv[arg]), run, showBytes);
+            res += runtest(r, atoi(argv[arg]), run, showBytes, rodata,
+                           captureOnly, reroll, unroll, shadow, noAnalysis);
     }
     else {
         // default parameter "1"
-        res += runtest(r, 1, run, showBytes);
+        res += runtest(r, 1, run, showBytes, rodata,
+                       captureOnly, reroll, unroll, shadow, noAnalysis);
     }
 
     return res;